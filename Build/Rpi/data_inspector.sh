@@ -11,7 +11,7 @@ links="" #"-lstdc++fs -lpng"
 
 log_file="compile.log"
 
-flags="-Wall -O3 -Wno-psabi"
+flags="-Wall -O3 -pthread -Wno-psabi"
 std="-std=c++17"
 
 utils="../../utils"
@@ -24,7 +24,8 @@ dirhelper="$utils/dirhelper.cpp"
 cluster="$utils/cluster.cpp"
 config_reader="$utils/config_reader.cpp"
 libimage="$utils/libimage/libimage.cpp"
-utils_cpp="$dirhelper $cluster $config_reader $libimage"
+thread_pool="$utils/thread_pool.cpp"
+utils_cpp="$dirhelper $cluster $config_reader $libimage $thread_pool"
 
 # app
 data_adaptor="$DataAdaptor/data_adaptor.cpp"
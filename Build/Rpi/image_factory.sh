@@ -11,7 +11,7 @@ links="" #"-lstdc++fs -lpng"
 
 log_file="compile.log"
 
-flags="-Wall -O3 -Wno-psabi"
+flags="-Wall -O3 -pthread -Wno-psabi"
 std="-std=c++17"
 
 utils="../../utils"
@@ -21,7 +21,8 @@ ImageFactory="../../ImageFactory/src"
 config_reader="$utils/config_reader.cpp"
 dirhelper="$utils/dirhelper.cpp"
 libimage="$utils/libimage/libimage.cpp"
-utils_cpp="$config_reader $dirhelper $libimage"
+thread_pool="$utils/thread_pool.cpp"
+utils_cpp="$config_reader $dirhelper $libimage $thread_pool"
 
 image_factory="$ImageFactory/image_factory.cpp"
 main_cpp="$ImageFactory/image_factory_main.cpp"
@@ -22,7 +22,8 @@ rem utils
 set dirhelper=%utils%\dirhelper.cpp
 set config_reader=%utils%\config_reader.cpp
 set libimage=%utils%\libimage\libimage.cpp
-set utils_cpp=%dirhelper% %config_reader% %libimage%
+set thread_pool=%utils%\thread_pool.cpp
+set utils_cpp=%dirhelper% %config_reader% %libimage% %thread_pool%
 
 set image_factory=%ImageFactory%\image_factory.cpp
 set main_cpp=%ImageFactory%\image_factory_main.cpp
@@ -24,7 +24,8 @@ set dirhelper=%utils%\dirhelper.cpp
 set cluster=%utils%\cluster.cpp
 set config_reader=%utils%\config_reader.cpp
 set libimage=%utils%\libimage\libimage.cpp
-set utils_cpp=%dirhelper% %cluster% %config_reader% %libimage%
+set thread_pool=%utils%\thread_pool.cpp
+set utils_cpp=%dirhelper% %cluster% %config_reader% %libimage% %thread_pool%
 
 rem app
 set data_adaptor=%DataAdaptor%\data_adaptor.cpp
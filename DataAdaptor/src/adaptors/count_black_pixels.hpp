@@ -22,22 +22,34 @@ constexpr size_t MAX_FEATURE_IMAGE_SIZE = 10000;
 
 constexpr auto BITS32_MAX = UINT32_MAX;
 
+// read the count from a histogram of every shade instead of counting only the shades needed
+constexpr bool COUNT_FROM_HISTOGRAM = false;
+
+// part of each source image that is used, clipped to the image size
+// png rows below the range are not decoded and only the range is kept in memory
+constexpr img::pixel_range_t SOURCE_RANGE = img::FULL_RANGE;
+
 
 //======= HELPERS =================
 
 
-// counts the number
+// fraction of pixels that are in the shade range
 inline r64 count_shades(img::gray::view_t const& view)
 {
 	// min and max shade are both black
-	const size_t min_shade = 0;
-	const size_t max_shade = 0;	
+	const u8 min_shade = 0;
+	const u8 max_shade = 0;
 
-	const auto hist = img::calc_stats(view).hist;
+	const auto total = static_cast<r64>(view.width) * view.height;
 
-	assert(max_shade < hist.size());
+	if constexpr (!COUNT_FROM_HISTOGRAM)
+	{
+		return img::count_shade_range(view, min_shade, max_shade) / total;
+	}
 
-	const auto total = static_cast<r64>(view.width) * view.height;
+	const auto hist = img::calc_hist(view);
+
+	assert(max_shade < hist.size());
 
 	r64 count = 0;
 
@@ -93,8 +105,11 @@ namespace impl
 
 	inline features_t file_to_features(const char* src_file)
 	{
+		// image memory is reused for every file read by this thread
+		thread_local img::image_pool_t pool;
+
 		img::gray::image_t image;
-		img::read_image_from_file(src_file, image);
+		img::read_image_from_file(src_file, SOURCE_RANGE, image, pool);
 		const features_t data{ count_shades(img::make_view(image)) };
 
 		assert(data.size() == FEATURE_IMAGE_WIDTH);
@@ -4,6 +4,7 @@
 #include "../../../utils/libimage/libimage.hpp"
 
 #include <algorithm>
+#include <numeric>
 #include <cassert>
 #include <iterator>
 #include <ctime>
@@ -38,15 +39,13 @@ constexpr auto BITS32_MAX = UINT32_MAX;
 //======= HELPERS =================
 
 
-// counts the amount of each shade found in the image
+// converts the amount of each shade found in the image
 // returns a histogram of relative amounts from 0 - 1
-static features_t count_shades(img::gray::view_t const& view)
+static features_t count_shades(img::hist_t const& hist)
 {
-	const auto hist = img::calc_stats(view).hist;
-
 	features_t data(hist.size(), 0);
 
-	const auto total = static_cast<r64>(view.width) * view.height;
+	const auto total = static_cast<r64>(std::accumulate(hist.begin(), hist.end(), (u64)0));
 
 	for (size_t i = 0; i < hist.size(); ++i)
 	{
@@ -99,10 +98,11 @@ namespace impl
 
 	inline features_t file_to_features(const char* src_file)
 	{
-		img::gray::image_t image;
-		
-		img::read_image_from_file(src_file, image);
-		const auto data = count_shades(img::make_view(image));
+		// decode memory is reused for every file read by this thread
+		thread_local img::image_pool_t pool;
+
+		// shades are counted as the file is decoded
+		const auto data = count_shades(img::read_gray_hist_from_file(src_file, pool));
 
 		assert(data.size() == FEATURE_IMAGE_WIDTH);
 
@@ -3,6 +3,7 @@
 #include "../data_adaptor.hpp"
 #include "../../../utils/libimage/libimage.hpp"
 
+#include <algorithm>
 #include <cassert>
 
 #ifdef __linux
@@ -19,13 +20,35 @@ using features_t = data_adaptor::features_t;
 
 constexpr size_t HORIZONTAL_SECTIONS = 16;
 constexpr size_t VERTICAL_SECTIONS = 16;
+constexpr u32 GRID_LEVELS = 1; // each level adds a grid with half as many sections in each direction
+
+// part of each source image that is used, clipped to the image size
+// png rows below the range are not decoded and only the range is kept in memory
+constexpr img::pixel_range_t SOURCE_RANGE = img::FULL_RANGE;
 constexpr size_t MAX_FEATURE_IMAGE_SIZE = 300000;
 constexpr auto BITS32_MAX = UINT32_MAX;
 
 
 namespace impl
 {
-	constexpr size_t FEATURE_IMAGE_WIDTH = HORIZONTAL_SECTIONS * VERTICAL_SECTIONS;
+	static_assert(GRID_LEVELS > 0);
+	static_assert((HORIZONTAL_SECTIONS >> (GRID_LEVELS - 1)) > 0);
+	static_assert((VERTICAL_SECTIONS >> (GRID_LEVELS - 1)) > 0);
+
+
+	constexpr size_t count_sections()
+	{
+		size_t count = 0;
+		for (u32 level = 0; level < GRID_LEVELS; ++level)
+		{
+			count += (HORIZONTAL_SECTIONS >> level) * (VERTICAL_SECTIONS >> level);
+		}
+
+		return count;
+	}
+
+
+	constexpr size_t FEATURE_IMAGE_WIDTH = count_sections();
 	constexpr r64 FEATURE_MIN_VALUE = 0;
 	constexpr r64 FEATURE_MAX_VALUE = 1;
 
@@ -66,17 +89,53 @@ namespace impl
 
 	inline features_t file_to_features(const char* src_file)
 	{
-		img::image_t image;
-		img::read_image_from_file(src_file, image);
-
-		img::image_t resized;
-		resized.width = HORIZONTAL_SECTIONS;
-		resized.height = VERTICAL_SECTIONS;
-		auto view = img::make_resized_view(image, resized);
+		// image memory is reused for every file read by this thread
+		thread_local img::image_pool_t pool;
 
 		features_t data;
-
-		std::transform(view.begin(), view.end(), std::back_inserter(data), feature_pixel_to_value);
+		data.reserve(FEATURE_IMAGE_WIDTH);
+
+		auto const append_sections = [&](img::view_t const& view)
+		{
+			img::for_each_row(view, [&](img::row_span_t const& row)
+			{
+				for (auto const& p : row)
+				{
+					data.push_back(feature_pixel_to_value(p.value));
+				}
+			});
+		};
+
+		// each section is the average color of its block of pixels
+		img::image_t sections;
+		sections.width = HORIZONTAL_SECTIONS;
+		sections.height = VERTICAL_SECTIONS;
+
+		if constexpr (GRID_LEVELS == 1)
+		{
+			img::read_downscaled_image_from_file(src_file, SOURCE_RANGE, sections, pool);
+			append_sections(img::make_view(sections));
+		}
+		else
+		{
+			img::image_t image;
+			img::read_image_from_file(src_file, SOURCE_RANGE, image, pool);
+
+			// every grid is made from one pass over the pixels
+			thread_local img::rgba_integral_image_t table;
+			img::make_integral_image(img::make_view(image), table);
+
+			for (u32 level = 0; level < GRID_LEVELS; ++level)
+			{
+				sections.width = HORIZONTAL_SECTIONS >> level;
+				sections.height = VERTICAL_SECTIONS >> level;
+				img::make_image(sections, sections.width, sections.height, pool);
+
+				auto const view = img::make_view(sections);
+				img::downscale_image(table, view);
+				append_sections(view);
+			}
+		}
 
 		assert(data.size() == FEATURE_IMAGE_WIDTH);
 
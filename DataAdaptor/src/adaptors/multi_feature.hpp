@@ -0,0 +1,213 @@
+#pragma once
+
+#include "../data_adaptor.hpp"
+#include "../../../utils/libimage/libimage.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+
+#ifdef __linux
+
+#define sprintf_s sprintf
+
+#endif
+
+// impl::feature_sets() is defined below
+#define DATA_ADAPTOR_FEATURE_SETS
+
+namespace img = libimage;
+
+
+using feature_pixel_t = data_adaptor::feature_pixel_t;
+using features_t = data_adaptor::features_t;
+
+
+//======= DATA PROPERTIES =================
+
+constexpr size_t NUM_GRAY_SHADES = 256;
+constexpr size_t HORIZONTAL_SECTIONS = 16;
+constexpr size_t VERTICAL_SECTIONS = 16;
+constexpr size_t MAX_FEATURE_IMAGE_SIZE = 500 * 500;
+
+// part of each source image that is used, clipped to the image size
+// png rows below the range are not decoded and only the range is kept in memory
+constexpr img::pixel_range_t SOURCE_RANGE = img::FULL_RANGE;
+
+constexpr auto BITS32_MAX = UINT32_MAX;
+
+
+//======= EXTRACTORS =================
+
+// each source file is decoded once and given to every extractor
+typedef struct decoded_image_t
+{
+	img::view_t color;
+	img::gray::view_t gray;
+
+} source_t;
+
+
+// appends the features of the source image to dst
+using extract_func_t = void (*)(source_t const& src, features_t& dst, img::image_pool_t& pool);
+
+
+typedef struct feature_extractor_t
+{
+	const char* name;
+	size_t width;
+	extract_func_t extract;
+
+} extractor_t;
+
+
+// relative amount of each gray shade, same as image_file_adaptor.hpp
+static void extract_shades(source_t const& src, features_t& dst, img::image_pool_t&)
+{
+	const auto hist = img::calc_hist(src.gray);
+	const auto total = static_cast<r64>(src.gray.width) * src.gray.height;
+
+	for (auto count : hist)
+	{
+		dst.push_back(count / total);
+	}
+}
+
+
+// relative amount of black pixels, same as count_black_pixels.hpp
+static void extract_black(source_t const& src, features_t& dst, img::image_pool_t&)
+{
+	const auto total = static_cast<r64>(src.gray.width) * src.gray.height;
+
+	dst.push_back(img::count_shade_range(src.gray, 0, 0) / total);
+}
+
+
+// average color of each section, same as image_sections.hpp
+static void extract_sections(source_t const& src, features_t& dst, img::image_pool_t& pool)
+{
+	img::image_t sections;
+	img::make_image(sections, HORIZONTAL_SECTIONS, VERTICAL_SECTIONS, pool);
+
+	const auto view = img::make_view(sections);
+	img::downscale_image(src.color, view);
+
+	img::for_each_row(view, [&](img::row_span_t const& row)
+	{
+		for (auto const& p : row)
+		{
+			dst.push_back(static_cast<r64>(p.value) / BITS32_MAX);
+		}
+	});
+}
+
+
+// choose the extractors and the order of their features
+constexpr std::array<extractor_t, 3> EXTRACTORS =
+{ {
+	{ "shades", NUM_GRAY_SHADES, extract_shades },
+	{ "black", 1, extract_black },
+	{ "sections", HORIZONTAL_SECTIONS * VERTICAL_SECTIONS, extract_sections },
+} };
+
+
+constexpr size_t count_features()
+{
+	size_t count = 0;
+	for (auto const& extractor : EXTRACTORS)
+	{
+		count += extractor.width;
+	}
+
+	return count;
+}
+
+
+namespace impl
+{
+	constexpr size_t FEATURE_IMAGE_WIDTH = count_features();
+	constexpr r64 FEATURE_MIN_VALUE = 0;
+	constexpr r64 FEATURE_MAX_VALUE = 1;
+
+
+	// Define how to name save files
+	inline std::string make_numbered_file_name(u32 index, size_t index_length)
+	{
+		index_length = index_length < 2 ? 2 : index_length;
+
+		char idx_str[10];
+		sprintf_s(idx_str, "%0*d", (int)index_length, index); // zero pad index number
+
+		return std::string(idx_str) + data_adaptor::FEATURE_IMAGE_EXTENSION;
+	}
+
+
+	inline feature_pixel_t value_to_feature_pixel(r64 val)
+	{
+		assert(val >= FEATURE_MIN_VALUE);
+		assert(val <= FEATURE_MAX_VALUE);
+
+		const auto ratio = (val - FEATURE_MIN_VALUE) / (FEATURE_MAX_VALUE - FEATURE_MIN_VALUE);
+
+		img::pixel_t color{};
+		color.value = static_cast<u32>(ratio * BITS32_MAX);
+
+		return color.value;
+	}
+
+
+	inline r64 feature_pixel_to_value(feature_pixel_t const& pix)
+	{
+		return static_cast<r64>(pix) / BITS32_MAX;
+	}
+
+
+	inline features_t file_to_features(const char* src_file)
+	{
+		// image memory is reused for every file read by this thread
+		thread_local img::image_pool_t pool;
+
+		img::image_t image;
+		img::read_image_from_file(src_file, SOURCE_RANGE, image, pool);
+
+		img::gray::image_t gray;
+		img::make_image(gray, image.width, image.height, pool);
+
+		source_t src;
+		src.color = img::make_view(image);
+		src.gray = img::make_view(gray);
+		img::convert_to_gray(src.color, src.gray);
+
+		features_t data;
+		data.reserve(FEATURE_IMAGE_WIDTH);
+
+		for (auto const& extractor : EXTRACTORS)
+		{
+			const auto begin = data.size();
+
+			extractor.extract(src, data, pool);
+
+			assert(data.size() - begin == extractor.width);
+		}
+
+		assert(data.size() == FEATURE_IMAGE_WIDTH);
+
+		return data;
+	}
+
+
+	// one feature set for each extractor
+	inline data_adaptor::feature_set_list_t feature_sets()
+	{
+		data_adaptor::feature_set_list_t sets;
+
+		size_t begin = 0;
+		for (auto const& extractor : EXTRACTORS)
+		{
+			sets.push_back({ extractor.name, begin, extractor.width });
+			begin += extractor.width;
+		}
+
+		return sets;
+	}
+}
\ No newline at end of file
@@ -1,6 +1,8 @@
 #include "data_adaptor.hpp"
 #include "../../utils/libimage/libimage.hpp"
 
+#include <algorithm>
+
 namespace img = libimage;
 
 /*
@@ -14,6 +16,7 @@ Allows for changing implementation without having to modify the source file list
 #include "adaptors/image_file_adaptor.hpp" 
 //#include "adaptors/count_black_pixels.hpp"
 //#include "adaptors/image_sections.hpp"
+//#include "adaptors/multi_feature.hpp"
 
 
 namespace data_adaptor
@@ -22,17 +25,18 @@ namespace data_adaptor
 
 	static void save_data_range(data_itr_t const& first, data_itr_t const& last, path_t const& dst_file_path)
 	{
-		const auto width = impl::FEATURE_IMAGE_WIDTH;
+		const auto width = first->size();
 		const auto dist = std::distance(first, last);
 
 		assert(dist > 0);
+		assert(std::all_of(first, last, [&](auto const& row) { return row.size() == width; }));
 
 		const auto height = static_cast<u32>(dist);
 
 		assert(static_cast<size_t>(height) <= MAX_FEATURE_IMAGE_SIZE / width);
 
 		img::image_t image;
-		img::make_image(image, width, height);
+		img::make_image(image, static_cast<u32>(width), height);
 
 		for (u32 y = 0; y < image.height; ++y)
 		{
@@ -63,7 +67,13 @@ namespace data_adaptor
 
 	void save_feature_images(features_list_t const& data, const char* dst_dir)
 	{
-		const auto max_height = MAX_FEATURE_IMAGE_SIZE / impl::FEATURE_IMAGE_WIDTH;
+		if (data.empty())
+		{
+			return;
+		}
+
+		// feature sets can be saved on their own so the width is taken from the data
+		const auto max_height = MAX_FEATURE_IMAGE_SIZE / data.front().size();
 
 		unsigned idx = 1;
 
@@ -100,6 +110,37 @@ namespace data_adaptor
 	}
 
 
+	void save_feature_stores(features_list_t const& data, const char* dst_dir)
+	{
+		auto const dst_root = fs::path(dst_dir);
+
+		for (auto const& set : feature_sets())
+		{
+			features_list_t set_data;
+			set_data.reserve(data.size());
+
+			for (auto const& features : data)
+			{
+				assert(set.begin + set.width <= features.size());
+
+				auto const first = features.begin() + set.begin;
+				set_data.emplace_back(first, first + set.width);
+			}
+
+			auto const set_dir = dst_root / set.name;
+			fs::create_directories(set_dir);
+
+			save_feature_images(set_data, set_dir);
+		}
+	}
+
+
+	void save_feature_stores(features_list_t const& data, path_t const& dst_dir)
+	{
+		save_feature_stores(data, dst_dir.string().c_str());
+	}
+
+
 	features_t feature_image_row_to_data(pixel_row_t const& pixel_row)
 	{
 		assert(pixel_row.size() == impl::FEATURE_IMAGE_WIDTH);
@@ -154,4 +195,18 @@ namespace data_adaptor
 	{
 		return impl::FEATURE_MAX_VALUE;
 	}
+
+
+	feature_set_list_t feature_sets()
+	{
+#ifdef DATA_ADAPTOR_FEATURE_SETS
+
+		return impl::feature_sets();
+
+#else
+
+		return { { "features", 0, impl::FEATURE_IMAGE_WIDTH } };
+
+#endif // DATA_ADAPTOR_FEATURE_SETS
+	}
 }
\ No newline at end of file
@@ -33,6 +33,18 @@ namespace data_adaptor
 	using feature_pixel_t = u32;                      // One feature value converted to a pixel (4 x 8bit)
 	using pixel_row_t = std::vector<feature_pixel_t>; // A single row of data pixels
 
+
+	// A named range of values in each feature vector e.g. the features from one extractor
+	typedef struct feature_set_t
+	{
+		std::string name;
+		size_t begin;
+		size_t width;
+
+	} feature_set_t;
+
+	using feature_set_list_t = std::vector<feature_set_t>;
+
 	constexpr auto FEATURE_IMAGE_EXTENSION = ".png";
 
 	/*
@@ -63,6 +75,12 @@ namespace data_adaptor
 	r64 feature_max_value();
 
 
+	// The feature sets that make up each feature vector, in order
+	// Implementations with more than one set define DATA_ADAPTOR_FEATURE_SETS and impl::feature_sets()
+	// Otherwise all of the features are one set
+	feature_set_list_t feature_sets();
+
+
 	/*
 
 	These functions are implemented in data_adaptor.cpp using the above functions
@@ -79,6 +97,12 @@ namespace data_adaptor
 	void save_feature_images(features_list_t const& data, path_t const& dst_dir);
 
 
+	// Save each feature set as its own "data images" in a sub directory of dst_dir named after the set
+	// Each store can be used as if it were made by an implementation that only has that set
+	void save_feature_stores(features_list_t const& data, const char* dst_dir);
+	void save_feature_stores(features_list_t const& data, path_t const& dst_dir);
+
+
 	// Convert one row of a "data image" back to source data
 	features_t feature_image_row_to_data(pixel_row_t const& pixel_row);
 	
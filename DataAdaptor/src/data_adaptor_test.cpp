@@ -2,6 +2,7 @@
 #include "../../utils/dirhelper.hpp"
 #include "../../utils/test_dir.hpp"
 #include "../../utils/libimage/libimage.hpp"
+#include "../../utils/thread_pool.hpp"
 
 #include <string>
 #include <iostream>
@@ -9,6 +10,10 @@
 #include <numeric>
 #include <cmath>
 #include <cstdio>
+#include <type_traits>
+#include <random>
+#include <utility>
+#include <atomic>
 
 namespace data = data_adaptor;
 namespace dir = dirhelper;
@@ -87,9 +92,23 @@ bool file_list_to_features_size_test();
 bool file_list_to_features_values_test();
 bool save_feature_images_create_file_test();
 bool save_feature_images_height_test();
+bool feature_sets_width_test();
+bool save_feature_stores_height_test();
 bool pixel_conversion_test();
 bool feature_image_row_to_data_size_test();
 bool feature_image_row_to_data_values_test();
+bool image_pool_mixed_reads_test();
+bool image_move_test();
+bool row_span_test();
+bool calc_stats_test();
+bool downscale_image_test();
+bool integral_image_test();
+bool count_shade_range_test();
+bool read_gray_hist_test();
+bool read_range_test();
+bool read_rows_test();
+bool read_downscaled_test();
+bool nested_parallel_test();
 
 void delete_files(std::string dir);
 
@@ -117,9 +136,23 @@ int main()
 	run_test("file_list_to_features()   matching values", file_list_to_features_values_test);
 	run_test("save_feature_images()     file(s) created", save_feature_images_create_file_test);
 	run_test("save_feature_images()      file(s) height", save_feature_images_height_test);
+	run_test("feature_sets()                      width", feature_sets_width_test);
+	run_test("save_feature_stores()      file(s) height", save_feature_stores_height_test);
 	run_test("pixel_conversion_test()      close enough", pixel_conversion_test);
 	run_test("feature_image_row_to_data()          size", feature_image_row_to_data_size_test);
 	run_test("feature_image_row_to_data()  close enough", feature_image_row_to_data_values_test);
+	run_test("image_pool_t        pooled and not pooled", image_pool_mixed_reads_test);
+	run_test("image_t                    move ownership", image_move_test);
+	run_test("for_each_row()           same as iterator", row_span_test);
+	run_test("calc_stats()          same as pixel count", calc_stats_test);
+	run_test("downscale_image()      same as block mean", downscale_image_test);
+	run_test("integral_image_t       same as pixel sums", integral_image_test);
+	run_test("count_shade_range()   same as pixel count", count_shade_range_test);
+	run_test("read_gray_hist_from_file() same as decode", read_gray_hist_test);
+	run_test("read_image_from_file()    range of pixels", read_range_test);
+	run_test("read_rows_from_file()      same as decode", read_rows_test);
+	run_test("read_downscaled_image_from_file() by rows", read_downscaled_test);
+	run_test("execute_in_parallel()        nested calls", nested_parallel_test);
 
 	std::cout << "\nTests complete.  Enter 'y' to generate data images\n";
 		
@@ -259,6 +292,62 @@ bool save_feature_images_height_test()
 }
 
 
+// feature sets cover every feature once and in order
+bool feature_sets_width_test()
+{
+	const auto sets = data::feature_sets();
+
+	size_t begin = 0;
+
+	for (auto const& set : sets)
+	{
+		if (set.begin != begin || !set.width)
+			return false;
+
+		begin += set.width;
+	}
+
+	return !sets.empty() && begin == data::feature_image_width();
+}
+
+
+// each feature set is saved in its own directory
+// with one row of pixels for each file and one column for each feature in the set
+bool save_feature_stores_height_test()
+{
+	const auto file_list = data::file_list_t(src_files.begin(), src_files.end());
+	const auto data = data::file_list_to_features(file_list);
+
+	delete_files(dst_root);
+
+	data::save_feature_stores(data, dst_root.c_str());
+
+	const auto pred = [&](data::feature_set_t const& set)
+	{
+		const auto feature_images = dir::get_files_of_type(fs::path(dst_root) / set.name, dst_file_ext);
+
+		size_t total_height = 0;
+
+		for (auto const& file : feature_images)
+		{
+			img::image_t image;
+			img::read_image_from_file(file, image);
+
+			if (image.width != set.width)
+				return false;
+
+			total_height += image.height;
+		}
+
+		return total_height == file_list.size();
+	};
+
+	const auto sets = data::feature_sets();
+
+	return std::all_of(sets.begin(), sets.end(), pred);
+}
+
+
 bool pixel_conversion_test()
 {
 	const size_t test_index = 2;
@@ -349,6 +438,604 @@ bool feature_image_row_to_data_values_test()
 }
 
 
+// an image that borrowed from a pool gives its memory back when it is given memory that is not from the pool
+// memory that is not from the pool is never given to it
+bool image_pool_mixed_reads_test()
+{
+	img::image_pool_t pool;
+	img::image_t image;
+
+	img::make_image(image, 16, 16, pool);
+	auto const pooled = image.data;
+
+	img::read_image_from_file(src_files[0].c_str(), image);
+	if (image.pool)
+		return false;
+
+	// the only buffer in the pool is the one that was returned
+	auto const buffer = pool.acquire(sizeof(img::pixel_t) * 16 * 16);
+	auto const is_returned = buffer == pooled;
+	pool.release(buffer);
+
+	img::read_image_from_file(src_files[1].c_str(), image, pool);
+	if (image.pool != &pool)
+		return false;
+
+	img::make_image(image, 16, 16);
+	if (image.pool)
+		return false;
+
+	img::read_image_from_file(src_files[2].c_str(), image, pool);
+	img::read_image_from_file(src_files[3].c_str(), image);
+
+	img::gray::image_t gray;
+	img::read_image_from_file(src_files[4].c_str(), gray, pool);
+	img::read_image_from_file(src_files[5].c_str(), gray);
+	img::make_image(gray, 16, 16, pool);
+	img::make_image(gray, 16, 16);
+
+	auto const is_cleared = !image.pool && !gray.pool;
+
+	image.clear();
+	gray.clear();
+	pool.purge();
+
+	return is_returned && is_cleared;
+}
+
+
+// images can only be moved, the memory and pool go with the image and the moved from image is empty
+bool image_move_test()
+{
+	static_assert(!std::is_copy_constructible_v<img::image_t>);
+	static_assert(!std::is_copy_assignable_v<img::image_t>);
+	static_assert(!std::is_copy_constructible_v<img::gray::image_t>);
+	static_assert(!std::is_copy_assignable_v<img::gray::image_t>);
+
+	img::image_pool_t pool;
+
+	const auto is_moved = [&](auto const& src, auto const& dst, auto const* data)
+	{
+		return !src.data && !src.pool && !src.width && !src.height 
+			&& dst.data == data && dst.pool == &pool && dst.width == 8 && dst.height == 4;
+	};
+
+	img::image_t image;
+	img::make_image(image, 8, 4, pool);
+	auto const data = image.data;
+
+	img::image_t moved(std::move(image));
+	if (!is_moved(image, moved, data))
+		return false;
+
+	// memory that was in the image is freed
+	img::image_t assigned;
+	img::make_image(assigned, 2, 2);
+	assigned = std::move(moved);
+	if (!is_moved(moved, assigned, data))
+		return false;
+
+	img::gray::image_t gray;
+	img::make_image(gray, 8, 4, pool);
+	auto const gray_data = gray.data;
+
+	img::gray::image_t gray_moved(std::move(gray));
+	if (!is_moved(gray, gray_moved, gray_data))
+		return false;
+
+	img::gray::image_t gray_assigned;
+	img::make_image(gray_assigned, 2, 2);
+	gray_assigned = std::move(gray_moved);
+
+	return is_moved(gray_moved, gray_assigned, gray_data);
+}
+
+
+// the rows of a sub view have the same pixels in the same order as its iterator
+bool row_span_test()
+{
+	img::image_t image;
+	img::make_image(image, 7, 5);
+
+	u32 value = 0;
+	for (auto& p : image)
+	{
+		p.value = value++;
+	}
+
+	img::pixel_range_t range = { 2, 6, 1, 4 };
+	auto const view = img::sub_view(image, range);
+
+	std::vector<u32> from_rows;
+	u32 n_rows = 0;
+
+	img::for_each_row(view, [&](img::row_span_t const& row)
+	{
+		if (row.length == view.width && row.data == view.row_begin(n_rows))
+		{
+			std::transform(row.begin(), row.end(), std::back_inserter(from_rows), [](img::pixel_t const& p) { return p.value; });
+		}
+
+		++n_rows;
+	});
+
+	std::vector<u32> from_iterator;
+	std::transform(view.begin(), view.end(), std::back_inserter(from_iterator), [](img::pixel_t const& p) { return p.value; });
+
+	// rows of a pair of views are copied
+	img::image_t copy;
+	img::make_image(copy, view.width, view.height);
+
+	img::for_each_row(view, img::make_view(copy), [](img::row_span_t const& src, img::row_span_t const& dst)
+	{
+		std::copy(src.begin(), src.end(), dst.begin());
+	});
+
+	std::vector<u32> from_copy;
+	std::transform(copy.begin(), copy.end(), std::back_inserter(from_copy), [](img::pixel_t const& p) { return p.value; });
+
+	return n_rows == view.height && from_rows == from_iterator && from_copy == from_iterator;
+}
+
+
+// histograms and statistics are the same as counting each pixel one at a time
+bool calc_stats_test()
+{
+	std::mt19937 gen(7);
+	std::uniform_int_distribution<u32> dist(0, 255);
+
+	// large enough to be split into tiles
+	img::gray::image_t gray;
+	img::make_image(gray, 1031, 1029);
+	std::generate(gray.begin(), gray.end(), [&]() { return (u8)dist(gen); });
+
+	img::image_t color;
+	img::make_image(color, 1031, 1029);
+	std::generate(color.begin(), color.end(), [&]() { return img::to_pixel((u8)dist(gen), (u8)dist(gen), (u8)dist(gen)); });
+
+	const auto count_stats = [](std::vector<u8> const& shades)
+	{
+		img::stats_t stats = {};
+
+		r64 total = 0.0;
+		for (auto const shade : shades)
+		{
+			++stats.hist[shade];
+			total += shade;
+		}
+
+		auto const mean = total / shades.size();
+
+		r64 diff_sq_total = 0.0;
+		for (auto const shade : shades)
+		{
+			diff_sq_total += (shade - mean) * (shade - mean);
+		}
+
+		stats.mean = (r32)mean;
+		stats.std_dev = (r32)std::sqrt(diff_sq_total / shades.size());
+
+		return stats;
+	};
+
+	const auto is_same = [](img::stats_t const& lhs, img::stats_t const& rhs)
+	{
+		return lhs.hist == rhs.hist && std::abs(lhs.mean - rhs.mean) < 0.001 && std::abs(lhs.std_dev - rhs.std_dev) < 0.001;
+	};
+
+	// odd widths leave pixels after the unrolled loops
+	std::vector<img::pixel_range_t> ranges = { { 0, 1031, 0, 1029 }, { 3, 1030, 1, 1027 }, { 5, 18, 7, 10 } };
+
+	for (auto const& range : ranges)
+	{
+		auto const gray_view = img::sub_view(gray, range);
+
+		std::vector<u8> shades(gray_view.begin(), gray_view.end());
+		auto const expected = count_stats(shades);
+
+		if (!is_same(img::calc_stats(gray_view), expected) || img::calc_hist(gray_view) != expected.hist)
+			return false;
+
+		auto const color_view = img::sub_view(color, range);
+		auto const rgb_stats = img::calc_stats(color_view);
+		auto const rgb_hist = img::calc_hist(color_view);
+
+		for (u32 c = 0; c < img::RGB_CHANNELS; ++c)
+		{
+			shades.clear();
+			std::transform(color_view.begin(), color_view.end(), std::back_inserter(shades), [&](img::pixel_t const& p) { return p.channels[c]; });
+
+			auto const channel_expected = count_stats(shades);
+
+			if (!is_same(rgb_stats.stats[c], channel_expected) || rgb_hist[c] != channel_expected.hist)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+
+// each destination pixel is the rounded mean of the source pixels it covers
+// sources smaller than the destination repeat their pixels
+bool downscale_image_test()
+{
+	std::mt19937 gen(11);
+	std::uniform_int_distribution<u32> dist(0, 255);
+
+	// source first and last pixel covered by destination position i
+	const auto block = [](u32 size_src, u32 size_dst, u32 i)
+	{
+		auto const begin = size_src * i / size_dst;
+		auto const end = std::max(size_src * (i + 1) / size_dst, begin + 1);
+		return std::make_pair(begin, end);
+	};
+
+	const auto is_block_mean = [&](auto const& view_src, auto const& view_dst, u32 n_channels, auto const& shade)
+	{
+		for (u32 y = 0; y < view_dst.height; ++y)
+		{
+			auto const [y_begin, y_end] = block(view_src.height, view_dst.height, y);
+
+			for (u32 x = 0; x < view_dst.width; ++x)
+			{
+				auto const [x_begin, x_end] = block(view_src.width, view_dst.width, x);
+				auto const count = (x_end - x_begin) * (y_end - y_begin);
+
+				for (u32 c = 0; c < n_channels; ++c)
+				{
+					u32 total = 0;
+					for (u32 y_src = y_begin; y_src < y_end; ++y_src)
+					{
+						for (u32 x_src = x_begin; x_src < x_end; ++x_src)
+						{
+							total += shade(view_src.xy_at(x_src, y_src), c);
+						}
+					}
+
+					if (shade(view_dst.xy_at(x, y), c) != (total + count / 2) / count)
+						return false;
+				}
+			}
+		}
+
+		return true;
+	};
+
+	const auto color_shade = [](img::pixel_t const* p, u32 c) { return (u32)p->channels[c]; };
+	const auto gray_shade = [](img::gray::pixel_t const* p, u32) { return (u32)*p; };
+
+	// smaller, larger and mixed sizes compared to a 16 x 16 grid
+	std::vector<std::pair<u32, u32>> sizes = { { 500, 500 }, { 37, 23 }, { 3, 2 }, { 20, 5 }, { 1, 1 } };
+
+	for (auto const& [width, height] : sizes)
+	{
+		img::image_t color;
+		img::make_image(color, width, height);
+		std::generate(color.begin(), color.end(), [&]() { return img::to_pixel((u8)dist(gen), (u8)dist(gen), (u8)dist(gen), (u8)dist(gen)); });
+
+		img::image_t color_dst;
+		color_dst.width = 16;
+		color_dst.height = 16;
+		img::downscale_image(color, color_dst);
+
+		if (!is_block_mean(img::make_view(color), img::make_view(color_dst), img::RGBA_CHANNELS, color_shade))
+			return false;
+
+		img::gray::image_t gray;
+		img::make_image(gray, width, height);
+		std::generate(gray.begin(), gray.end(), [&]() { return (u8)dist(gen); });
+
+		img::gray::image_t gray_dst;
+		gray_dst.width = 16;
+		gray_dst.height = 16;
+		img::downscale_image(gray, gray_dst);
+
+		if (!is_block_mean(img::make_view(gray), img::make_view(gray_dst), 1, gray_shade))
+			return false;
+	}
+
+	return true;
+}
+
+
+// rectangle totals are the same as adding the pixels
+// a grid made from the table is the same as one made from the pixels
+bool integral_image_test()
+{
+	std::mt19937 gen(13);
+	std::uniform_int_distribution<u32> dist(0, 255);
+
+	img::gray::image_t gray;
+	img::make_image(gray, 61, 47);
+	std::generate(gray.begin(), gray.end(), [&]() { return (u8)dist(gen); });
+
+	img::integral_image_t table;
+	img::make_integral_image(img::make_view(gray), table);
+
+	for (u32 i = 0; i < 100; ++i)
+	{
+		img::pixel_range_t range;
+		range.x_begin = dist(gen) % gray.width;
+		range.x_end = range.x_begin + 1 + dist(gen) % (gray.width - range.x_begin);
+		range.y_begin = dist(gen) % gray.height;
+		range.y_end = range.y_begin + 1 + dist(gen) % (gray.height - range.y_begin);
+
+		auto const view = img::sub_view(gray, range);
+		auto const total = std::accumulate(view.begin(), view.end(), (u64)0);
+		auto const count = (r64)view.width * view.height;
+
+		if (img::rect_sum(table, range) != total || std::abs(img::rect_mean(table, range) - total / count) > 0.001)
+			return false;
+	}
+
+	img::image_t color;
+	img::make_image(color, 61, 47);
+	std::generate(color.begin(), color.end(), [&]() { return img::to_pixel((u8)dist(gen), (u8)dist(gen), (u8)dist(gen), (u8)dist(gen)); });
+
+	img::rgba_integral_image_t color_table;
+	img::make_integral_image(img::make_view(color), color_table);
+
+	// grids larger than the image repeat pixels
+	for (u32 size : { 16u, 5u, 61u, 100u })
+	{
+		img::gray::image_t gray_expected;
+		gray_expected.width = size;
+		gray_expected.height = size;
+		img::downscale_image(gray, gray_expected);
+
+		img::gray::image_t gray_grid;
+		img::make_image(gray_grid, size, size);
+		img::downscale_image(table, img::make_view(gray_grid));
+
+		if (!std::equal(gray_grid.begin(), gray_grid.end(), gray_expected.begin()))
+			return false;
+
+		img::image_t color_expected;
+		color_expected.width = size;
+		color_expected.height = size;
+		img::downscale_image(color, color_expected);
+
+		img::image_t color_grid;
+		img::make_image(color_grid, size, size);
+		img::downscale_image(color_table, img::make_view(color_grid));
+
+		const auto same_value = [](img::pixel_t const& lhs, img::pixel_t const& rhs) { return lhs.value == rhs.value; };
+
+		if (!std::equal(color_grid.begin(), color_grid.end(), color_expected.begin(), same_value))
+			return false;
+	}
+
+	return true;
+}
+
+
+// the number of shades in a range is the same as checking each pixel
+bool count_shade_range_test()
+{
+	std::mt19937 gen(17);
+	std::uniform_int_distribution<u32> dist(0, 255);
+
+	// large enough to be split into bands, with rows that do not fill the last vector
+	img::gray::image_t gray;
+	img::make_image(gray, 1031, 1029);
+	std::generate(gray.begin(), gray.end(), [&]() { return (u8)dist(gen); });
+
+	// long runs of one shade fill the 8 bit counters
+	std::fill_n(gray.begin(), 5000, (u8)0);
+	std::fill_n(gray.begin() + 10000, 5000, (u8)255);
+
+	std::vector<img::pixel_range_t> ranges = { { 0, 1031, 0, 1029 }, { 3, 1030, 1, 1027 }, { 1, 18, 2, 5 }, { 4, 9, 0, 1 } };
+	std::vector<std::pair<u8, u8>> shades = { { 0, 0 }, { 0, 255 }, { 10, 200 }, { 255, 255 }, { 100, 100 }, { 0, 31 } };
+
+	for (auto const& range : ranges)
+	{
+		auto const view = img::sub_view(gray, range);
+
+		for (auto const& [min_shade, max_shade] : shades)
+		{
+			auto const in_range = [&](u8 shade) { return shade >= min_shade && shade <= max_shade; };
+			auto const expected = (u32)std::count_if(view.begin(), view.end(), in_range);
+
+			if (img::count_shade_range(view, min_shade, max_shade) != expected)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+
+// counting rows as they are inflated gives the histogram of the decoded image
+bool read_gray_hist_test()
+{
+	img::image_pool_t pool;
+
+	// a file written by stb has other filters and codes than the source files
+	img::gray::image_t written;
+	img::make_image(written, 301, 67);
+	std::generate(written.begin(), written.end(), [n = 0]() mutable { return (u8)(n++ * 7 / 5); });
+
+	auto const written_file = dst_root + "/read_gray_hist_test.png";
+	img::write_image(written, written_file.c_str());
+
+	auto files = src_files;
+	files.push_back(written_file);
+
+	auto result = true;
+
+	for (auto const& file : files)
+	{
+		img::gray::image_t gray;
+		img::read_image_from_file(file.c_str(), gray);
+
+		result &= img::read_gray_hist_from_file(file.c_str(), pool) == img::calc_hist(img::make_view(gray));
+	}
+
+	fs::remove(written_file);
+
+	return result;
+}
+
+
+// reading a range of a file keeps the same pixels as a view of the whole file
+bool read_range_test()
+{
+	img::image_pool_t pool;
+
+	auto const file = src_files[2].c_str();
+
+	img::image_t image;
+	img::read_image_from_file(file, image);
+
+	img::pixel_range_t top = { 0, image.width, 0, image.height / 2 };
+	img::pixel_range_t inner = { image.width / 4, image.width / 2, image.height / 3, image.height / 2 };
+	img::pixel_range_t full = { 0, image.width, 0, image.height };
+
+	const auto same_value = [](img::pixel_t const& lhs, img::pixel_t const& rhs) { return lhs.value == rhs.value; };
+
+	// the range read and the pixels that are kept
+	std::vector<std::pair<img::pixel_range_t, img::pixel_range_t>> ranges = { { img::FULL_RANGE, full }, { top, top }, { inner, inner } };
+
+	for (auto const& [range, kept] : ranges)
+	{
+		img::image_t part;
+		img::read_image_from_file(file, range, part, pool);
+
+		auto const view = img::sub_view(image, kept);
+
+		if (part.width != view.width || part.height != view.height || !std::equal(view.begin(), view.end(), part.begin(), same_value))
+			return false;
+	}
+
+	return true;
+}
+
+
+// rows handed out while reading are the rows of the whole file
+bool read_rows_test()
+{
+	img::image_pool_t pool;
+
+	const auto same_value = [](img::pixel_t const& lhs, img::pixel_t const& rhs) { return lhs.value == rhs.value; };
+
+	for (auto const& file : src_files)
+	{
+		img::image_t image;
+		img::read_image_from_file(file.c_str(), image);
+
+		auto same_size = false;
+		auto same_rows = true;
+		u32 n_rows = 0;
+
+		auto const on_size = [&](u32 width, u32 height) { return same_size = width == image.width && height == image.height; };
+
+		auto const on_row = [&](u32 y, img::row_span_t const& row)
+		{
+			same_rows &= y == n_rows++ && std::equal(row.begin(), row.end(), image.row_begin(y), same_value);
+
+			return true;
+		};
+
+		if (!img::read_rows_from_file(file.c_str(), pool, on_size, on_row) || !same_size || !same_rows || n_rows != image.height)
+			return false;
+	}
+
+	return true;
+}
+
+
+// downscaling rows as they are read is the same as downscaling a range of the whole file
+bool read_downscaled_test()
+{
+	img::image_pool_t pool;
+
+	auto const file = src_files[3].c_str();
+
+	img::image_t image;
+	img::read_image_from_file(file, image);
+
+	img::gray::image_t gray;
+	img::read_image_from_file(file, gray);
+
+	img::pixel_range_t inner = { image.width / 4, image.width / 2, image.height / 3, image.height / 2 };
+
+	const auto same_value = [](img::pixel_t const& lhs, img::pixel_t const& rhs) { return lhs.value == rhs.value; };
+
+	// the second grid is taller than the inner range
+	std::vector<std::pair<u32, u32>> sizes = { { 16, 16 }, { 7, 200 } };
+
+	for (auto const& range : { img::FULL_RANGE, inner })
+	{
+		auto const kept = range.x_end == UINT32_MAX ? img::pixel_range_t{ 0, image.width, 0, image.height } : range;
+
+		for (auto const& [width, height] : sizes)
+		{
+			img::image_t expected;
+			img::make_image(expected, width, height);
+			img::downscale_image(img::sub_view(image, kept), img::make_view(expected));
+
+			img::image_t part;
+			part.width = width;
+			part.height = height;
+			img::read_downscaled_image_from_file(file, range, part, pool);
+
+			if (!std::equal(expected.begin(), expected.end(), part.begin(), same_value))
+				return false;
+
+			img::gray::image_t gray_expected;
+			img::make_image(gray_expected, width, height);
+			img::downscale_image(img::sub_view(gray, kept), img::make_view(gray_expected));
+
+			img::gray::image_t gray_part;
+			gray_part.width = width;
+			gray_part.height = height;
+			img::read_downscaled_image_from_file(file, range, gray_part, pool);
+
+			if (!std::equal(gray_expected.begin(), gray_expected.end(), gray_part.begin()))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+
+bool nested_parallel_test()
+{
+	u32 const n_outer = 8;
+	u32 const n_inner = 16;
+
+	std::vector<std::atomic<u32>> runs(n_outer * n_inner);
+	std::atomic<u32> active = 0;
+	std::atomic<u32> max_active = 0;
+
+	auto const n_threads = thread_pool::parallel_thread_count();
+
+	thread_pool::execute_in_parallel(n_outer, [&](u32 i)
+	{
+		thread_pool::execute_in_parallel(n_inner, [&](u32 j)
+		{
+			auto const n_active = ++active;
+			for (auto m = max_active.load(); n_active > m && !max_active.compare_exchange_weak(m, n_active);) {}
+
+			++runs[i * n_inner + j];
+
+			--active;
+		});
+	});
+
+	// every inner task runs once and never on more threads than the outer call may use
+	if (!std::all_of(runs.begin(), runs.end(), [](auto const& r) { return r == 1; }))
+		return false;
+
+	if (max_active > n_threads)
+		return false;
+
+	return thread_pool::parallel_thread_count() == n_threads;
+}
+
+
 // ======= HELPERS ==================
 
 
@@ -5,8 +5,16 @@
 #include "../../utils/libimage/libimage.hpp"
 #include "../../utils/dirhelper.hpp"
 #include "../../utils/cluster_config.hpp"
+#include "../../utils/config_reader.hpp"
 
+#include <array>
 #include <cassert>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <sstream>
 
 
 
@@ -14,6 +22,7 @@ namespace data = data_adaptor;
 namespace model = model_generator;
 namespace img = libimage;
 namespace dir = dirhelper;
+namespace cr = config_reader;
 
 
 using index_list_t = std::vector<size_t>;
@@ -74,93 +83,491 @@ static centroid_list_t read_model(const char* model_file)
 }
 
 
-static r64 data_value_to_model_value(r64 data_val)
+typedef struct
 {
-	// convert a value from a data image to model/centroid value
-	// uses feature pixel as intermediary
+	mlclass::class_clusters_t class_clusters;
 
-	model::data_pixel_t pixel{};
-	pixel.value = data::value_to_feature_pixel(data_val);
+	cluster::projection_t projection; // no components if the data is not projected
+	bool has_error = false;           // the model can not be compared with the data
 
-	return model::feature_pixel_to_model_value(pixel);
+	cluster::centroid_tree_t tree; // no nodes if the model is not a tree
+	size_t tree_beam = 0;
+
+	cluster::product_quantizer_t pq; // no codes if the index is not used, the codebook is the last rows of the model
+	size_t pq_first_row = 0;
+	size_t pq_rerank = 0;
+
+} model_info_t;
+
+
+static cluster::index_list_t to_index_list(std::string const& str)
+{
+	cluster::index_list_t list;
+
+	std::istringstream iss(str);
+	size_t index = 0;
+	while (iss >> index)
+	{
+		list.push_back(index);
+	}
+
+	return list;
 }
 
 
-namespace data_inspector
+static cluster::value_row_t to_value_list(std::string const& str)
 {
-	using model_row_t = std::vector<r64>;
+	cluster::value_row_t list;
 
-	static model_row_t to_model_value_row(src_data_t const& data_row)
+	std::istringstream iss(str);
+	r64 value = 0.0;
+	while (iss >> value)
 	{
-		model_row_t row;
+		list.push_back(value);
+	}
+
+	return list;
+}
 
-		std::transform(data_row.begin(), data_row.end(), std::back_inserter(row), data_value_to_model_value);
 
-		return row;
+static size_t read_size(cr::config_t& config, std::string const& key)
+{
+	return std::strtoull(config[key].c_str(), nullptr, 10);
+}
+
+
+static bool read_model_projection(cr::config_t& config, size_t row_width, model_info_t& info)
+{
+	// the data is projected to the first positions of each row
+
+	auto& projection = info.projection;
+
+	auto const n_dims = read_size(config, model::PROJECTION_DIMS_KEY);
+	auto const scale = to_value_list(config[model::PROJECTION_SCALE_KEY]);
+
+	projection.inputs = to_index_list(config[model::PROJECTION_INPUTS_KEY]);
+	projection.mean = to_value_list(config[model::PROJECTION_MEAN_KEY]);
+
+	auto const n_inputs = projection.inputs.size();
+	auto const in_row = [&](size_t i) { return i < row_width; };
+
+	if (!n_dims || n_dims > row_width || scale.size() != 1 || !n_inputs || projection.mean.size() != n_inputs)
+	{
+		return false;
 	}
 
+	if (!std::all_of(projection.inputs.begin(), projection.inputs.end(), in_row))
+	{
+		return false;
+	}
+
+	projection.scale = scale[0];
 
-	MLClass inspect(src_data_t const& data_row , const char* model_dir)
+	for (size_t d = 0; d < n_dims; ++d)
 	{
-		if (data_row.empty())
+		auto component = to_value_list(config[model::projection_component_key(d)]);
+		if (component.size() != n_inputs)
 		{
-			return MLClass::Error;
+			return false;
 		}
-			
 
-		/*
-		
-		The following must done every time data is provided
-		A class can be created with centroids, cluster, centroid_class_map in memory and may be faster without the file read on each inspection.
-		This implementation allows for changing the model during runtime.
+		projection.components.push_back(std::move(component));
+	}
+
+	return true;
+}
+
+
+static bool read_model_tree(cr::config_t& config, size_t n_rows, model_info_t& info)
+{
+	// the rows after the class centroids are the other nodes of the tree
+
+	auto& tree = info.tree;
 
-		*/
+	tree.leaf_count = std::accumulate(info.class_clusters.begin(), info.class_clusters.end(), (size_t)0);
+	tree.nodes.resize(n_rows);
+	tree.roots = to_index_list(config[model::TREE_ROOTS_KEY]);
+	info.tree_beam = read_size(config, model::TREE_BEAM_KEY);
 
-		// use the first model found in the directory
-		auto const model_file = dir::get_first_file_of_type(model_dir, model::MODEL_FILE_EXTENSION);
-		if (model_file.empty())
+	auto const in_model = [&](cluster::index_list_t const& rows)
+	{
+		return std::all_of(rows.begin(), rows.end(), [&](size_t row) { return row < n_rows; });
+	};
+
+	if (!info.tree_beam || tree.roots.empty() || !in_model(tree.roots))
+	{
+		return false;
+	}
+
+	// every node has at most one parent and roots have none, so a search always ends
+	std::vector<uint8_t> has_parent(n_rows, 0);
+	for (auto const root : tree.roots)
+	{
+		has_parent[root] = 1;
+	}
+
+	for (auto row = tree.leaf_count; row < n_rows; ++row)
+	{
+		auto& children = tree.nodes[row].children;
+		children = to_index_list(config[model::tree_node_key(row)]);
+
+		if (children.empty() || !in_model(children))
 		{
-			return MLClass::Error;
+			return false;
 		}
 
-		auto const centroids = read_model(model_file.c_str());
-		if(centroids.empty())
+		for (auto const child : children)
 		{
-			return MLClass::Error;
+			if (has_parent[child])
+			{
+				return false;
+			}
+
+			has_parent[child] = 1;
+		}
+	}
+
+	return true;
+}
+
+
+static bool read_model_quantizer(cr::config_t& config, size_t n_leaves, size_t n_rows, size_t row_width, model_info_t& info)
+{
+	// the codebook is in the last rows of the model
+
+	auto& pq = info.pq;
+
+	auto const n_codewords = read_size(config, model::PQ_CODEWORDS_KEY);
+	info.pq_first_row = read_size(config, model::PQ_FIRST_ROW_KEY);
+	info.pq_rerank = read_size(config, model::PQ_RERANK_KEY);
+
+	if (read_size(config, model::PQ_SEARCH_KEY) != 1 || !info.pq_rerank)
+	{
+		return false;
+	}
+
+	if (!n_codewords || n_codewords > cluster::PQ_MAX_CODEWORDS || info.pq_first_row < n_leaves || info.pq_first_row + n_codewords != n_rows)
+	{
+		return false;
+	}
+
+	for (size_t m = 0; config.count(model::pq_subspace_key(m)); ++m)
+	{
+		auto dims = to_index_list(config[model::pq_subspace_key(m)]);
+
+		auto const in_row = [&](size_t d) { return d < row_width; };
+		if (dims.empty() || !std::all_of(dims.begin(), dims.end(), in_row))
+		{
+			return false;
 		}
 
-		auto const data_indeces = find_positions(centroids[0]);
+		pq.subspaces.push_back(std::move(dims));
+	}
 
-		cluster_t cluster;
-		cluster.set_distance(model::build_cluster_distance(data_indeces));
-		
+	if (pq.subspaces.empty())
+	{
+		return false;
+	}
 
-		// cluster will find a centroid and the centroid will be mapped to a MLClass
-		auto const class_clusters = mlclass::make_class_clusters(cluster::CLUSTER_COUNT);
+	for (size_t row = 0; row < n_leaves; ++row)
+	{
+		auto const codes = to_index_list(config[model::pq_codes_key(row)]);
 
-		// map centroid index to class
-		std::vector<MLClass> centroid_class_map;
-		auto const update_map = [&](auto c)
+		auto const in_codebook = [&](size_t k) { return k < n_codewords; };
+		if (codes.size() != pq.subspaces.size() || !std::all_of(codes.begin(), codes.end(), in_codebook))
 		{
-			for (size_t i = 0; i < class_clusters[c]; ++i)
-			{
-				centroid_class_map.push_back(mlclass::to_class(c));
-			}
-		};
+			return false;
+		}
+
+		pq.codes.emplace_back(codes.begin(), codes.end());
+	}
+
+	return true;
+}
+
+
+static model_info_t read_model_info(std::string const& model_file, size_t n_rows, size_t row_width)
+{
+	// the number of centroids of each class is saved next to the model
+	// without it, every MLClass is assumed to have the same number
+
+	model_info_t info;
+	info.class_clusters = mlclass::make_class_clusters(n_rows / mlclass::ML_CLASS_COUNT);
+
+	auto info_path = fs::path(model_file);
+	info_path.replace_extension(model::MODEL_INFO_EXTENSION);
+
+	if (!fs::exists(info_path))
+	{
+		return info;
+	}
+
+	auto config = cr::read_config(info_path.string().c_str());
+
+	// every class that is listed, in order
+	mlclass::class_clusters_t class_clusters;
+	size_t total = 0;
+
+	for (size_t c = 0; config.count(model::class_clusters_key(c)); ++c)
+	{
+		class_clusters.push_back(read_size(config, model::class_clusters_key(c)));
+		total += class_clusters.back();
+	}
+
+	if (!total || total > n_rows)
+	{
+		return info;
+	}
+
+	info.class_clusters = class_clusters;
+
+	if (config.count(model::PROJECTION_DIMS_KEY) && !read_model_projection(config, row_width, info))
+	{
+		// the rows are projected values
+		info.has_error = true;
+		return info;
+	}
+
+	// the codebook rows are not part of the tree
+	auto n_tree_rows = n_rows;
+	if (config.count(model::PQ_FIRST_ROW_KEY))
+	{
+		n_tree_rows = std::min(read_size(config, model::PQ_FIRST_ROW_KEY), n_rows);
+	}
+
+	if (!read_model_quantizer(config, total, n_rows, row_width, info))
+	{
+		info.pq = {};
+	}
 
-		mlclass::for_each_class(update_map);
+	if (total < n_tree_rows && !read_model_tree(config, n_tree_rows, info))
+	{
+		// only the class centroids can be used
+		info.tree = {};
+	}
+
+	return info;
+}
+
+
+// changes to either file of a model while it is in use
+typedef struct
+{
+	fs::file_time_type model_time;
+	fs::file_time_type info_time;
+	uintmax_t model_size = 0;
+	uintmax_t info_size = 0;
+
+} model_version_t;
+
+
+static bool same_version(model_version_t const& lhs, model_version_t const& rhs)
+{
+	return lhs.model_time == rhs.model_time && lhs.info_time == rhs.info_time && lhs.model_size == rhs.model_size && lhs.info_size == rhs.info_size;
+}
+
+
+// a model read from file with everything needed to search it
+typedef struct
+{
+	model_version_t version;
+	bool has_error = false; // the model can not be used
+
+	model_info_t info;         // tree nodes hold their centroids and the quantizer holds its codebook
+	centroid_list_t centroids; // the class centroids
+	index_list_t centroid_class_map;
+	cluster_t cluster;
+
+} model_t;
+
+using model_ptr_t = std::shared_ptr<model_t const>;
+
+
+static model_version_t read_model_version(std::string const& model_file)
+{
+	// a missing info file has no time or size
+
+	auto info_path = fs::path(model_file);
+	info_path.replace_extension(model::MODEL_INFO_EXTENSION);
+
+	model_version_t version;
+	std::error_code ec;
+
+	version.model_time = fs::last_write_time(model_file, ec);
+	version.model_size = fs::file_size(model_file, ec);
+	version.info_time = fs::last_write_time(info_path, ec);
+	version.info_size = fs::file_size(info_path, ec);
+
+	return version;
+}
+
+
+static model_ptr_t load_model(std::string const& model_file, model_version_t const& version)
+{
+	auto model = std::make_shared<model_t>();
+	model->version = version;
+
+	auto& centroids = model->centroids;
+
+	centroids = read_model(model_file.c_str());
+	if (centroids.empty())
+	{
+		model->has_error = true;
+		return model;
+	}
+
+	auto const data_indeces = find_positions(centroids[0]);
+	model->cluster.set_distance(model::build_cluster_distance(data_indeces));
+
+	// cluster will find a centroid and the centroid will be mapped to a class index
+	auto& info = model->info;
+	info = read_model_info(model_file, centroids.size(), centroids[0].size());
+	if (info.has_error)
+	{
+		model->has_error = true;
+		return model;
+	}
+
+	auto const& class_clusters = info.class_clusters;
+
+	// map centroid index to class
+	for (size_t c = 0; c < class_clusters.size(); ++c)
+	{
+		model->centroid_class_map.insert(model->centroid_class_map.end(), class_clusters[c], c);
+	}
+
+	for (size_t i = 0; i < info.tree.nodes.size(); ++i)
+	{
+		info.tree.nodes[i].centroid = centroids[i];
+	}
+
+	if (!info.pq.codes.empty())
+	{
+		info.pq.codebook.assign(centroids.begin() + info.pq_first_row, centroids.end());
+	}
+
+	// rows after the class centroids are not compared
+	centroids.resize(model->centroid_class_map.size());
+
+	return model;
+}
+
+
+static model_ptr_t get_model(const char* model_dir)
+{
+	// each model is read once and read again when its files change
+	// the model can be changed during runtime
+
+	static std::mutex cache_mutex;
+	static std::map<std::string, model_ptr_t> model_cache;
+
+	// use the first model found in the directory
+	auto const model_file = dir::get_first_file_of_type(model_dir, model::MODEL_FILE_EXTENSION);
+	if (model_file.empty())
+	{
+		return nullptr;
+	}
+
+	auto const version = read_model_version(model_file);
+
+	std::lock_guard<std::mutex> lock(cache_mutex);
+
+	auto& model = model_cache[model_file];
+	if (!model || !same_version(model->version, version))
+	{
+		model = load_model(model_file, version);
+	}
+
+	return model;
+}
+
+
+namespace data_inspector
+{
+	static cluster::data_row_t to_cluster_data_row(src_data_t const& data_row)
+	{
+		// convert values to feature pixels, the same data that the model was trained with
+		// they are converted to model values when compared to the centroids
 
-		/*****************************************************************/
+		cluster::data_row_t row;
+		row.reserve(data_row.size());
 
-		// convert data into values for the model
-		auto const model_row = to_model_value_row(data_row);	
+		std::transform(data_row.begin(), data_row.end(), std::back_inserter(row), data::value_to_feature_pixel);
 
-		auto centroid_index = cluster.find_centroid(model_row, centroids);
+		return row;
+	}
+
+
+	size_t inspect_class_index(src_data_t const& data_row, const char* model_dir)
+	{
+		if (data_row.empty())
+		{
+			return mlclass::NO_CLASS_INDEX;
+		}
+
+		auto const model = get_model(model_dir);
+		if (!model || model->has_error)
+		{
+			return mlclass::NO_CLASS_INDEX;
+		}
+
+		auto const& info = model->info;
+		auto const& cluster = model->cluster;
+		auto const& centroid_class_map = model->centroid_class_map;
+
+		// convert data into the packed format used by the model
+		auto cluster_row = to_cluster_data_row(data_row);
+
+		if (!info.projection.components.empty())
+		{
+			cluster_row = cluster::project_row(cluster_row, info.projection);
+		}
+
+		auto const& centroids = model->centroids;
+
+		if (!info.pq.codes.empty())
+		{
+			auto const centroid_index = cluster.find_centroid(cluster_row, centroids, info.pq, info.pq_rerank);
+
+			return centroid_class_map[centroid_index];
+		}
+
+		if (!info.tree.nodes.empty())
+		{
+			// the leaves are the class centroids
+			auto const leaf_index = cluster.find_centroid(cluster_row, info.tree, info.tree_beam);
+
+			return centroid_class_map[leaf_index];
+		}
+
+		auto centroid_index = cluster.find_centroid(cluster_row, centroids);
 
 		return centroid_class_map[centroid_index];
 	}
 
 
+	size_t inspect_class_index(const char* data_file, const char* model_dir)
+	{
+		auto const data = data::file_to_features(data_file);
+
+		return inspect_class_index(data, model_dir);
+	}
+
+
+	MLClass inspect(src_data_t const& data, const char* model_dir)
+	{
+		auto const class_index = inspect_class_index(data, model_dir);
+
+		if (class_index == mlclass::NO_CLASS_INDEX)
+		{
+			return MLClass::Error;
+		}
+
+		// classes added at runtime have no MLClass value
+		return class_index < mlclass::ML_CLASS_COUNT ? mlclass::to_class(class_index) : MLClass::Unknown;
+	}
+
+
 	MLClass inspect(const char* data_file, const char* model_dir)
 	{
 		auto const data = data::file_to_features(data_file);
@@ -23,11 +23,17 @@ namespace data_inspector
 
 	MLClass inspect(const char* data_file, const char* model_dir);
 
+	// the index of the class for models with classes added at runtime
+	// returns mlclass::NO_CLASS_INDEX if the data can not be classified
+	size_t inspect_class_index(src_data_t const& data, const char* model_dir);
+
+	size_t inspect_class_index(const char* data_file, const char* model_dir);
+
 	/*
 
-	Reading and converting model cluster data on each data read may be slow.
-	Consider implementing with a class to store the model in memory.
-	Current implementation allows for classifying with multiple models using their directories.
+	Each model is read and converted once and kept in memory.
+	It is read again when its files change, so the model can be changed during runtime.
+	Classifying with multiple models using their directories is allowed.
 
 	*/
 
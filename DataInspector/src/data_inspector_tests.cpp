@@ -1,12 +1,18 @@
 #include "../src/data_inspector.hpp"
+#include "../../DataAdaptor/src/data_adaptor.hpp"
+#include "../../ModelGenerator/src/pixel_conversion.hpp"
+#include "../../utils/cluster_config.hpp"
 #include "../../utils/dirhelper.hpp"
 #include "../../utils/test_dir.hpp"
 
 #include <iostream>
 #include <algorithm>
+#include <fstream>
 
 namespace ins = data_inspector;
 namespace dir = dirhelper;
+namespace data = data_adaptor;
+namespace model = model_generator;
 
 std::string src_fail_root;
 std::string src_pass_root;
@@ -41,6 +47,9 @@ bool src_fail_files_ext_test();
 bool src_pass_files_ext_test();
 bool src_fail_inspect_test();
 bool src_pass_inspect_test();
+bool class_index_test();
+bool model_swap_test();
+bool pq_index_test();
 
 
 int main()
@@ -64,6 +73,9 @@ int main()
 	run_test("src_pass_files_ext_test()  same ext", src_pass_files_ext_test);
 	run_test("src_fail_inspect_test()    all fail", src_fail_inspect_test);
 	run_test("src_pass_inspect_test()    all pass", src_pass_inspect_test);
+	run_test("class_index_test()        N classes", class_index_test);
+	run_test("model_swap_test()     model re-read", model_swap_test);
+	run_test("pq_index_test()   same as centroids", pq_index_test);
 
 	std::cout << "\nTests complete.\n";
 }
@@ -186,3 +198,173 @@ bool src_pass_inspect_test()
 {
 	return expected_class(src_pass_root, MLClass::Pass);
 }
+
+
+// a model with more classes than MLClass has and a different number of centroids for each
+bool class_index_test()
+{
+	auto const width = data::feature_image_width();
+
+	// every position of a centroid has the same value, as a fraction of the value range
+	std::vector<r64> const rows = { 0.1, 0.4, 0.6, 0.9 };
+	std::vector<size_t> const class_counts = { 1, 2, 1 };
+
+	auto const model_dir = fs::temp_directory_path() / "class_index_test";
+	fs::remove_all(model_dir);
+	fs::create_directories(model_dir);
+
+	img::image_t image;
+	img::make_image(image, (u32)width, (u32)rows.size());
+
+	for (u32 y = 0; y < image.height; ++y)
+	{
+		auto const value = cluster::MODEL_VALUE_MIN + rows[y] * (cluster::MODEL_VALUE_MAX - cluster::MODEL_VALUE_MIN);
+		std::fill(image.row_begin(y), image.row_begin(y) + width, model::model_value_to_model_pixel(value));
+	}
+
+	img::write_image(image, model_dir / (std::string("model") + model::MODEL_FILE_EXTENSION));
+
+	std::ofstream info(model_dir / (std::string("model") + model::MODEL_INFO_EXTENSION));
+	for (size_t c = 0; c < class_counts.size(); ++c)
+	{
+		info << model::class_clusters_key(c) << " = " << class_counts[c] << '\n';
+	}
+
+	info.close();
+
+	auto const inspect = [&](r64 value)
+	{
+		auto const feature_value = data::feature_min_value() + value * (data::feature_max_value() - data::feature_min_value());
+
+		return ins::inspect_class_index(ins::src_data_t(width, feature_value), model_dir.string().c_str());
+	};
+
+	auto const result = inspect(0.05) == 0 && inspect(0.35) == 1 && inspect(0.65) == 1 && inspect(0.95) == 2;
+
+	fs::remove_all(model_dir);
+
+	return result;
+}
+
+
+// a model that is changed after it was used is read again
+bool model_swap_test()
+{
+	auto const width = data::feature_image_width();
+
+	auto const model_dir = fs::temp_directory_path() / "model_swap_test";
+	fs::remove_all(model_dir);
+	fs::create_directories(model_dir);
+
+	auto const model_file = model_dir / (std::string("model") + model::MODEL_FILE_EXTENSION);
+	auto const info_file = model_dir / (std::string("model") + model::MODEL_INFO_EXTENSION);
+
+	// two centroids, one for each class in the order given
+	auto const write_model = [&](std::vector<r64> const& rows)
+	{
+		img::image_t image;
+		img::make_image(image, (u32)width, (u32)rows.size());
+
+		for (u32 y = 0; y < image.height; ++y)
+		{
+			auto const value = cluster::MODEL_VALUE_MIN + rows[y] * (cluster::MODEL_VALUE_MAX - cluster::MODEL_VALUE_MIN);
+			std::fill(image.row_begin(y), image.row_begin(y) + width, model::model_value_to_model_pixel(value));
+		}
+
+		img::write_image(image, model_file);
+
+		std::ofstream info(info_file);
+		info << model::class_clusters_key(0) << " = 1\n";
+		info << model::class_clusters_key(1) << " = 1\n";
+	};
+
+	auto const inspect = [&](r64 value)
+	{
+		auto const feature_value = data::feature_min_value() + value * (data::feature_max_value() - data::feature_min_value());
+
+		return ins::inspect_class_index(ins::src_data_t(width, feature_value), model_dir.string().c_str());
+	};
+
+	write_model({ 0.2, 0.8 });
+	auto result = inspect(0.1) == 0 && inspect(0.9) == 1;
+
+	// the write time is set so the change is seen on file systems with coarse times
+	write_model({ 0.8, 0.2 });
+	fs::last_write_time(model_file, fs::last_write_time(model_file) + std::chrono::seconds(2));
+	result &= inspect(0.1) == 1 && inspect(0.9) == 0;
+
+	fs::remove(info_file);
+	fs::remove(model_file);
+	result &= inspect(0.1) == mlclass::NO_CLASS_INDEX;
+
+	fs::remove_all(model_dir);
+
+	return result;
+}
+
+
+// a model searched with its product quantization index finds the same classes
+bool pq_index_test()
+{
+	auto const width = data::feature_image_width();
+
+	// the class centroids followed by the codebook, in reverse order
+	std::vector<r64> const rows = { 0.1, 0.4, 0.6, 0.9, 0.9, 0.6, 0.4, 0.1 };
+	std::vector<size_t> const class_counts = { 1, 2, 1 };
+	std::vector<size_t> const codes = { 3, 2, 1, 0 };
+
+	auto const model_dir = fs::temp_directory_path() / "pq_index_test";
+	fs::remove_all(model_dir);
+	fs::create_directories(model_dir);
+
+	img::image_t image;
+	img::make_image(image, (u32)width, (u32)rows.size());
+
+	for (u32 y = 0; y < image.height; ++y)
+	{
+		auto const value = cluster::MODEL_VALUE_MIN + rows[y] * (cluster::MODEL_VALUE_MAX - cluster::MODEL_VALUE_MIN);
+		std::fill(image.row_begin(y), image.row_begin(y) + width, model::model_value_to_model_pixel(value));
+	}
+
+	img::write_image(image, model_dir / (std::string("model") + model::MODEL_FILE_EXTENSION));
+
+	std::ofstream info(model_dir / (std::string("model") + model::MODEL_INFO_EXTENSION));
+	for (size_t c = 0; c < class_counts.size(); ++c)
+	{
+		info << model::class_clusters_key(c) << " = " << class_counts[c] << '\n';
+	}
+
+	// only the best candidate is compared exactly
+	info << model::PQ_SEARCH_KEY << " = 1\n";
+	info << model::PQ_RERANK_KEY << " = 1\n";
+	info << model::PQ_FIRST_ROW_KEY << " = " << codes.size() << '\n';
+	info << model::PQ_CODEWORDS_KEY << " = " << rows.size() - codes.size() << '\n';
+
+	info << model::pq_subspace_key(0) << " =";
+	for (size_t d = 0; d < width; ++d)
+	{
+		info << ' ' << d;
+	}
+
+	info << '\n';
+
+	for (size_t row = 0; row < codes.size(); ++row)
+	{
+		info << model::pq_codes_key(row) << " = " << codes[row] << '\n';
+	}
+
+	info.close();
+
+	auto const inspect = [&](r64 value)
+	{
+		auto const feature_value = data::feature_min_value() + value * (data::feature_max_value() - data::feature_min_value());
+
+		return ins::inspect_class_index(ins::src_data_t(width, feature_value), model_dir.string().c_str());
+	};
+
+	auto const result = inspect(0.05) == 0 && inspect(0.35) == 1 && inspect(0.65) == 1 && inspect(0.95) == 2;
+
+	fs::remove_all(model_dir);
+
+	return result;
+}
@@ -1,6 +1,7 @@
 #include "../../utils/libimage/libimage.hpp"
 #include "image_factory.hpp"
 
+#include <algorithm>
 #include <random>
 #include <vector>
 #include <array>
@@ -97,7 +98,7 @@ static range_list_t get_letter_ranges(img::view_t const& img_v)
 	{
 		for (u32 y = range.y_begin; y < range.y_end; ++y)
 		{
-			auto row = img::row_view(img_v, range.x_begin, range.x_end, y);
+			auto row = img::row_view(img_v, range.x_begin, range.x_end, y).row_span(0);
 			bool has_black = std::any_of(row.begin(), row.end(), is_black_pred);
 
 			if (!found && has_black)
@@ -189,25 +190,33 @@ static void assemble_blocks(
 	};
 
 	// iterate over every pixel and set its color
+	// large images are split into bands of rows that are colored in parallel
+
+	const u32 band_height = 64;
 
 	for (auto& view : dst_list)
 	{
-		for (u32 y = 0; y < view.height; ++y)
+		img::parallel_for_tiles(view, view.width, band_height, [&](img::view_t const& band)
 		{
-			auto ptr = view.row_begin(y);
-			for (u32 x = 0; x < view.width; ++x)
+			const auto y_offset = band.y_begin - view.y_begin;
+
+			for (u32 y = 0; y < band.height; ++y)
 			{
-				auto c = GREY;
-				if (is_letter(x, y))
-					c = letter_c;
-				else if (is_surface(x, y))
-					c = surface_c;
-				else if (is_border(x, y))
-					c = BLACK;
-
-				ptr[x] = c;
+				auto ptr = band.row_begin(y);
+				for (u32 x = 0; x < band.width; ++x)
+				{
+					auto c = GREY;
+					if (is_letter(x, y + y_offset))
+						c = letter_c;
+					else if (is_surface(x, y + y_offset))
+						c = surface_c;
+					else if (is_border(x, y + y_offset))
+						c = BLACK;
+
+					ptr[x] = c;
+				}
 			}
-		}
+		});
 	}
 }
 
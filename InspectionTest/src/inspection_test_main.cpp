@@ -3,6 +3,7 @@
 #include "../../DataAdaptor/src/data_adaptor.hpp"
 #include "../../ModelGenerator/src/ModelGenerator.hpp"
 #include "../../DataInspector/src/data_inspector.hpp"
+#include "../../utils/cluster_config.hpp"
 
 #include <iostream>
 #include <iomanip>
@@ -10,11 +11,13 @@
 #include <numeric>
 #include <random>
 #include <cassert>
+#include <filesystem>
 
 namespace dir = dirhelper;
 namespace da = data_adaptor;
 namespace mg = model_generator;
 namespace di = data_inspector;
+namespace fs = std::filesystem;
 
 using index_list_t = std::vector<size_t>;
 using file_list_t = dir::file_list_t;
@@ -52,17 +55,20 @@ typedef struct
 
 constexpr auto IMG_EXT = ".png";
 
+// clustering settings used when no file is given on the command line, in the directory above the model
+constexpr auto CLUSTER_CONFIG_FILE = "cluster_config.txt";
+
 
 
 void print_title();
 file_div_t divide_files_for_testing(file_list_t&& files);
 void save_data_images(file_list_t const&, std::string const& dst_dir);
-void save_model(std::string const& pass_dir, std::string const& fail_dir, std::string const& model_dir);
+void save_model(std::string const& pass_dir, std::string const& fail_dir, std::string const& model_dir, std::string const& config_file);
 void test_files(file_list_t const& files, std::string const& model_dir, const char* label);
 void print_file_div(file_div_t const& div, const char* label);
 
 
-int main()
+int main(int argc, char* argv[])
 {
 	if (!get_directories())
 	{
@@ -99,8 +105,10 @@ int main()
 	std::cout << "done.\n";
 
 	// generate model
+	auto const config_file = argc > 1 ? std::string(argv[1]) : (fs::path(model_root).parent_path() / CLUSTER_CONFIG_FILE).string();
+
 	std::cout << "\ngenerating model... ";
-	save_model(data_pass_root, data_fail_root, model_root);
+	save_model(data_pass_root, data_fail_root, model_root, config_file);
 	std::cout << "done.\n";
 
 	// test fail files
@@ -187,16 +195,20 @@ void save_data_images(file_list_t const& files, std::string const& dst_dir)
 }
 
 
-void save_model(std::string const& pass_dir, std::string const& fail_dir, std::string const& model_dir)
+void save_model(std::string const& pass_dir, std::string const& fail_dir, std::string const& model_dir, std::string const& config_file)
 {
 	delete_files(model_dir);
 
+	// missing settings keep their defaults
+	auto const settings = cluster::read_cluster_settings(config_file.c_str());
+
 	mg::ModelGenerator gen;
+	gen.set_cluster_settings(settings);
 
 	gen.add_class_data(pass_dir.c_str(), MLClass::Pass);
 	gen.add_class_data(fail_dir.c_str(), MLClass::Fail);
 
-	gen.save_model(model_dir.c_str());
+	gen.save_model(model_dir.c_str(), settings.time_limit);
 }
 
 
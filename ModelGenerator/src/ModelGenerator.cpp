@@ -3,9 +3,12 @@
 #include "cluster_distance.hpp"
 #include "../../utils/cluster_config.hpp"
 #include "../../utils/dirhelper.hpp"
+#include "../../utils/config_reader.hpp"
+#include "../../utils/thread_pool.hpp"
 #include "../../DataAdaptor/src/data_adaptor.hpp"
 
 #include <algorithm>
+#include <chrono>
 #include <numeric>
 #include <functional>
 #include <iomanip>
@@ -15,31 +18,42 @@
 #include <ctime>
 #include <cstdlib>
 #include <string>
+#include <fstream>
+#include <limits>
+#include <unordered_map>
 
 namespace dir = dirhelper;
 namespace data = data_adaptor;
 
-constexpr auto N_CLASSES = mlclass::ML_CLASS_COUNT;
-constexpr auto N_CLUSTERS = cluster::CLUSTER_COUNT;
+// statistics for every column in the feature image
+using running_stats_t = cluster::running_stats_t;
+using column_stats_t = cluster::column_stats_t;
 
-constexpr u32 MAX_COLOR_VALUE = 255;
+// column statistics for each class
+using class_column_stats_t = std::vector<column_stats_t>;
 
-constexpr u32 MAX_RELATIVE_QTY = 255;
+using cluster_t = cluster::Cluster;
+using centroid_list_t = cluster::value_row_list_t;
 
-// provides a count for every shade that is found
-using color_hist_t = std::array<u32, MAX_COLOR_VALUE>;
+using data_list_t = std::vector<cluster::data_row_t>;
+using class_cluster_data_t = std::vector<data_list_t>;
 
-// provides shade counts for every column in the feature image
-using column_hists_t = std::vector<color_hist_t>;
+using weight_list_t = cluster::weight_list_t;
+using class_weights_t = std::vector<weight_list_t>;
 
-// shade counts by column for each class
-using class_column_hists_t = std::array<column_hists_t, N_CLASSES>;
+using tree_t = cluster::centroid_tree_t;
+using class_trees_t = std::vector<tree_t>;
 
-using cluster_t = cluster::Cluster;
-using centroid_list_t = cluster::value_row_list_t;
+using class_clusters_t = mlclass::class_clusters_t;
 
-using data_list_t = std::vector<cluster::data_row_t>;
-using class_cluster_data_t = std::array<data_list_t, N_CLASSES>;
+using quantizer_t = cluster::product_quantizer_t;
+
+using projection_t = cluster::projection_t;
+
+constexpr size_t PQ_RECALL_SAMPLES = 1000;
+
+// rows of each class used to compare the accuracy before and after centroids are merged
+constexpr size_t MERGE_ACCURACY_SAMPLES = 1000;
 
 using index_list_t = std::vector<size_t>;
 
@@ -77,16 +91,9 @@ namespace model_generator
 	}
 
 
-	//======= CONVERSION =============
-
-	
-	static u32 to_hist_value(data_pixel_t const& pix)
+	static std::string class_data_key(size_t class_index)
 	{
-		// converts a feature pixel to a value between 0 and MAX_COLOR_VALUE
-
-		auto const ratio = (r64)(pix.value) / UINT32_MAX;
-
-		return (u32)(ratio * MAX_COLOR_VALUE);
+		return "CLASS_" + std::to_string(class_index) + "_DATA";
 	}
 
 
@@ -98,62 +105,23 @@ namespace model_generator
 		r64 min;
 		r64 max;
 		r64 mean;
+		r64 sigma;
 	} stats_t;
 
+	// stats of one position for each class
+	using class_stats_t = std::vector<stats_t>;
+
 	
-	static stats_t get_stats(color_hist_t const& hist)
+	static stats_t get_stats(running_stats_t const& running)
 	{
-		auto const calc_mean = [](color_hist_t const& hist)
-		{
-			size_t qty_total = 0;
-			r64 val_total = 0.0;
+		auto const m = running.mean;
+		auto const s = running.count == 0 ? 0.0 : std::sqrt(running.m2 / running.count);
 
-			for (size_t shade = 0; shade < hist.size(); ++shade)
-			{
-				auto qty = hist[shade];
-				if (!qty)
-				{
-					continue;
-				}
-
-				qty_total += qty;
-				val_total += qty * shade;
-			}
-
-			return qty_total == 0 ? 0.0 : val_total / qty_total;
-		};
-
-		auto const calc_sigma = [](color_hist_t const& hist, r64 mean)
-		{
-			r64 total = 0.0;
-			size_t qty_total = 0;
-			for (size_t shade = 0; shade < hist.size(); ++shade)
-			{
-				auto val = shade;
-				auto qty = hist[shade];
-
-				if (!qty)
-				{
-					continue;
-				}
-
-				qty_total += qty;
-				auto const diff = val - mean;
-
-				total += qty * diff * diff;
-			}
-
-			return qty_total == 0 ? 0 : std::sqrt(total / qty_total);
-		};
-
-		auto const m = calc_mean(hist);
-		auto const s = calc_sigma(hist, m);
-
-		return{ m - s, m + s, m };
+		return{ m - s, m + s, m, s };
 	}
 
 
-	static bool is_same(std::array<stats_t, mlclass::ML_CLASS_COUNT> const& stats_list)
+	static bool is_same(class_stats_t const& stats_list)
 	{
 		auto upper = stats_list[0].max;
 		auto lower = stats_list[0].min;
@@ -183,25 +151,24 @@ namespace model_generator
 	}
 
 	
-	static index_list_t try_find_indeces(class_column_hists_t const& class_pos_hists)
+	static index_list_t try_find_indeces(class_column_stats_t const& class_pos_stats)
 	{
 		// An attempt at programatically finding feature image indeces that contribute to classification
 		// Finds the indeces of the data that contribute to determining the class
 		// Princpal Component Analysis, Dimensionality Reduction
 
-		const size_t num_pos = class_pos_hists[0].size();
+		const size_t num_pos = class_pos_stats[0].size();
 		size_t pos = 0;
 
-		std::array<stats_t, mlclass::ML_CLASS_COUNT> class_stats;
+		class_stats_t class_stats(class_pos_stats.size());
 
-		auto const set_class_range = [&](auto c) { class_stats[c] = get_stats(class_pos_hists[c][pos]); };
+		auto const set_class_range = [&](auto c) { class_stats[c] = get_stats(class_pos_stats[c][pos]); };
 
 		index_list_t list;
 
 		for (pos = 0; pos < num_pos; ++pos)
 		{
-			class_stats = { 0 };
-			mlclass::for_each_class(set_class_range);
+			mlclass::for_each_class(class_pos_stats.size(), set_class_range);
 
 			if (is_same(class_stats))
 			{
@@ -215,123 +182,525 @@ namespace model_generator
 	}
 
 
-	static index_list_t set_indeces_manually(class_column_hists_t const& class_pos_hists)
+	static r64 fisher_score(class_stats_t const& stats_list)
+	{
+		// spread of the class means compared to the spread within the classes
+		// every class counts the same
+
+		r64 mean = 0.0;
+		for (auto const& stats : stats_list)
+		{
+			mean += stats.mean / stats_list.size();
+		}
+
+		r64 between = 0.0;
+		r64 within = 0.0;
+		for (auto const& stats : stats_list)
+		{
+			between += (stats.mean - mean) * (stats.mean - mean);
+			within += stats.sigma * stats.sigma;
+		}
+
+		if (within > 0)
+		{
+			return between / within;
+		}
+
+		// classes without any spread are separated perfectly if their means differ
+		return between > 0 ? std::numeric_limits<r64>::max() : 0.0;
+	}
+
+
+	static index_list_t keep_best_positions(class_column_stats_t const& class_pos_stats, index_list_t const& positions, size_t budget)
+	{
+		// the budget positions with the highest Fisher score, in position order
+
+		if (!budget || positions.size() <= budget)
+		{
+			return positions;
+		}
+
+		class_stats_t class_stats(class_pos_stats.size());
+		std::vector<r64> scores;
+		scores.reserve(positions.size());
+
+		for (auto const pos : positions)
+		{
+			mlclass::for_each_class(class_pos_stats.size(), [&](auto c) { class_stats[c] = get_stats(class_pos_stats[c][pos]); });
+
+			scores.push_back(fisher_score(class_stats));
+		}
+
+		index_list_t order(positions.size());
+		std::iota(order.begin(), order.end(), 0);
+
+		// ties keep the lower position
+		std::stable_sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) { return scores[lhs] > scores[rhs]; });
+		order.resize(budget);
+		std::sort(order.begin(), order.end());
+
+		index_list_t list;
+		list.reserve(budget);
+
+		std::transform(order.begin(), order.end(), std::back_inserter(list), [&](size_t i) { return positions[i]; });
+
+		return list;
+	}
+
+
+	static index_list_t set_indeces_manually(class_column_stats_t const& class_pos_stats)
 	{
 		// here you can cheat by choosing indeces after inspecting the data images
 
 		//index_list_t list{ 0 }; // uses only the first index of the data image values
 
 		// just return all of the indeces
-		index_list_t list(class_pos_hists[0].size());
+		index_list_t list(class_pos_stats[0].size());
 		std::iota(list.begin(), list.end(), 0);
 
 		return list;
 	}
 
 		
-	static index_list_t find_relevant_positions(class_column_hists_t const& class_pos_hists)
+	static index_list_t find_relevant_positions(class_column_stats_t const& class_pos_stats, size_t budget)
 	{
 		// finds the indeces of the data that contribute to determining the class
+		// no more than budget are kept if it is not 0
 
-		auto const indeces = try_find_indeces(class_pos_hists);
+		auto indeces = try_find_indeces(class_pos_stats);
 
 		if (indeces.empty())
 		{
-			return set_indeces_manually(class_pos_hists);
+			indeces = set_indeces_manually(class_pos_stats);
 		}			
 
-		return indeces;
+		return keep_best_positions(class_pos_stats, indeces, budget);
 	}
 
 
-	//======= HISTOGRAM ============================
-
-	
-	static void update_histograms(column_hists_t& pos_hists, img::image_t const& feature_image)
+	static centroid_list_t cluster_class(cluster_t const& cluster, data_list_t const& data, weight_list_t const& weights, cluster::cluster_settings_t const& settings)
 	{
-		// update the counts in the histograms with data from a data image
+		// clusters the data of one class
+		// when a range of cluster counts is allowed, every count is tried in parallel
+		// the fewest clusters that remove settings.quality of the distance from a single centroid are kept
+
+		auto const max_count = settings.count;
+		auto const min_count = std::max(std::min(settings.min_count, max_count), (size_t)1);
 
-		u32 column = 0;
-		auto const update_pred = [&](auto const& p)
+		if (min_count == max_count)
 		{
-			data_pixel_t dp{ p };
+			auto class_cluster = cluster;
+			class_cluster.set_settings(settings);
+
+			return class_cluster.cluster_data(data, weights, max_count);
+		}
 
-			++pos_hists[column][to_hist_value(dp)];
+		// a single centroid is always tried for comparison
+		index_list_t counts = { 1 };
+		for (auto k = std::max(min_count, (size_t)2); k <= max_count; ++k)
+		{
+			counts.push_back(k);
+		}
+
+		std::vector<centroid_list_t> results(counts.size());
+		std::vector<r64> distances(counts.size());
+
+		// tasks share the time when there are more of them than threads
+		auto task_settings = settings;
+		size_t const n_threads = thread_pool::parallel_thread_count();
+		if (counts.size() > n_threads)
+		{
+			task_settings.time_limit = settings.time_limit * n_threads / counts.size();
+		}
+
+		auto const try_count = [&](u32 i)
+		{
+			// each thread gets its own copy
+			auto task_cluster = cluster;
+			task_cluster.set_settings(task_settings);
+
+			results[i] = task_cluster.cluster_data(data, weights, counts[i]);
+			distances[i] = task_cluster.stats().average_distance;
 		};
 
-		for (; column < feature_image.width; ++column)
+		thread_pool::execute_in_parallel((u32)counts.size(), try_count);
+
+		auto const base = distances[0];
+
+		for (size_t i = (min_count == 1 ? 0 : 1); i < counts.size(); ++i)
 		{
-			auto column_view = img::column_view(feature_image, column);
+			auto const quality = base > 0 ? 1.0 - distances[i] / base : 1.0;
+			if (quality >= settings.quality)
+			{
+				return std::move(results[i]);
+			}
+		}
+
+		return std::move(results.back());
+	}
 
-			std::for_each(column_view.begin(), column_view.end(), update_pred);
+
+	static tree_t join_trees(class_trees_t& class_trees)
+	{
+		// one tree that is searched from the roots of every class
+		// the leaves of every class come first, in class order, so that they line up with the class counts
+
+		tree_t tree;
+
+		for (auto const& class_tree : class_trees)
+		{
+			tree.leaf_count += class_tree.leaf_count;
+			tree.nodes.resize(tree.nodes.size() + class_tree.nodes.size());
 		}
+
+		size_t leaf_begin = 0;
+		size_t branch_begin = tree.leaf_count;
+
+		for (auto& class_tree : class_trees)
+		{
+			auto const to_model_index = [&](size_t i)
+			{
+				return i < class_tree.leaf_count ? leaf_begin + i : branch_begin + i - class_tree.leaf_count;
+			};
+
+			for (size_t i = 0; i < class_tree.nodes.size(); ++i)
+			{
+				auto& node = tree.nodes[to_model_index(i)];
+				node.centroid = std::move(class_tree.nodes[i].centroid);
+
+				for (auto const child : class_tree.nodes[i].children)
+				{
+					node.children.push_back(to_model_index(child));
+				}
+			}
+
+			for (auto const root : class_tree.roots)
+			{
+				tree.roots.push_back(to_model_index(root));
+			}
+
+			leaf_begin += class_tree.leaf_count;
+			branch_begin += class_tree.nodes.size() - class_tree.leaf_count;
+		}
+
+		return tree;
 	}
 
-	
-	static void append_data(data_list_t& data, img::image_t const& feature_image)
+
+	typedef struct
 	{
-		// add converted data from a feature image
+		class_clusters_t class_clusters;
+
+		// when same class centroids are merged
+		size_t merged = 0;
+		r64 accuracy_before_merge = 0.0;
+		r64 accuracy_after_merge = 0.0;
+
+		// applied to the data before it is compared with the rows when it has components
+		projection_t projection;
+
+		// rows after the class centroids when tree_beam > 0
+		tree_t tree;
+		size_t tree_beam = 0;
 
-		auto const height = feature_image.height;
+		// rows after the tree when pq_subspaces > 0
+		quantizer_t pq;
+		size_t pq_first_row = 0;
+		size_t pq_rerank = 0;
+		r64 pq_recall = 0.0;
 
-		for (u32 y = 0; y < height; ++y)
+	} model_info_t;
+
+
+	template <typename T>
+	static void write_list(std::ofstream& file, std::string const& key, std::vector<T> const& list)
+	{
+		file << key << " =";
+		for (auto const val : list)
 		{
-			cluster::data_row_t data_row;
+			file << ' ' << (size_t)val;
+		}
+		file << '\n';
+	}
 
-			auto row_view = img::row_view(feature_image, y);
-			std::transform(row_view.begin(), row_view.end(), std::back_inserter(data_row), feature_pixel_to_model_value);
 
-			data.push_back(std::move(data_row));
+	static void write_values(std::ofstream& file, std::string const& key, cluster::value_row_t const& values)
+	{
+		// every digit is kept so that the values read back are the same
+
+		auto const precision = file.precision(std::numeric_limits<r64>::max_digits10);
+
+		file << key << " =";
+		for (auto const val : values)
+		{
+			file << ' ' << val;
 		}
+		file << '\n';
+
+		file.precision(precision);
 	}
 
-	
-	static void normalize_histograms(column_hists_t& pos, u32 max_value)
+
+	static void save_model_info(fs::path const& model_path, model_info_t const& info)
 	{
-		// sets all values in the histograms to a value between 0 and max_value
+		// the number of centroids of each class in the model
+		// and how the other rows are used
+
+		auto info_path = model_path;
+		info_path.replace_extension(MODEL_INFO_EXTENSION);
 
-		std::vector<u32> hists;
-		hists.reserve(pos.size());
+		std::ofstream file(info_path);
 
-		auto const max_val = [](auto const& list)
+		file << "# number of centroids for each class in " << model_path.filename().string() << '\n';
+
+		for (size_t c = 0; c < info.class_clusters.size(); ++c)
 		{
-			auto it = std::max_element(list.begin(), list.end());
-			return *it;
-		};
+			file << class_clusters_key(c) << " = " << info.class_clusters[c] << '\n';
+		}
+
+		if (info.merged > 0)
+		{
+			file << "\n# centroids removed by merging them with a close centroid of the same class\n";
+			file << MERGED_CENTROIDS_KEY << " = " << info.merged << '\n';
+			file << "# fraction of the training data that is closest to a centroid of its own class\n";
+			file << ACCURACY_BEFORE_MERGE_KEY << " = " << info.accuracy_before_merge << '\n';
+			file << ACCURACY_AFTER_MERGE_KEY << " = " << info.accuracy_after_merge << '\n';
+		}
+
+		auto const& projection = info.projection;
+		if (!projection.components.empty())
+		{
+			file << "\n# projection of the data to the first PROJECTION_DIMS positions of each row\n";
+			file << PROJECTION_DIMS_KEY << " = " << projection.components.size() << '\n';
+			file << "# fraction of the variance of the training data that is kept\n";
+			file << PROJECTION_VARIANCE_KEY << " = " << projection.variance << '\n';
+
+			write_values(file, PROJECTION_SCALE_KEY, { projection.scale });
+			write_list(file, PROJECTION_INPUTS_KEY, projection.inputs);
+			write_values(file, PROJECTION_MEAN_KEY, projection.mean);
+
+			for (size_t d = 0; d < projection.components.size(); ++d)
+			{
+				write_values(file, projection_component_key(d), projection.components[d]);
+			}
+		}
+
+		auto const& tree = info.tree;
+		if (!tree.nodes.empty())
+		{
+			file << "\n# centroid tree\n";
+			file << TREE_BEAM_KEY << " = " << info.tree_beam << '\n';
+
+			write_list(file, TREE_ROOTS_KEY, tree.roots);
+
+			for (size_t row = tree.leaf_count; row < tree.nodes.size(); ++row)
+			{
+				write_list(file, tree_node_key(row), tree.nodes[row].children);
+			}
+		}
 
-		std::transform(pos.begin(), pos.end(), std::back_inserter(hists), max_val);
+		auto const& pq = info.pq;
+		if (!pq.codes.empty())
+		{
+			file << "\n# product quantization index, set PQ_SEARCH = 0 to compare every centroid\n";
+			file << PQ_SEARCH_KEY << " = 1\n";
+			file << PQ_RERANK_KEY << " = " << info.pq_rerank << '\n';
+			file << "# found the same centroid as an exact search for this fraction of the training data\n";
+			file << PQ_RECALL_KEY << " = " << info.pq_recall << '\n';
+			file << PQ_FIRST_ROW_KEY << " = " << info.pq_first_row << '\n';
+			file << PQ_CODEWORDS_KEY << " = " << pq.codebook.size() << '\n';
+
+			for (size_t m = 0; m < pq.subspaces.size(); ++m)
+			{
+				write_list(file, pq_subspace_key(m), pq.subspaces[m]);
+			}
 
-		const auto max = (r64)max_val(hists);
+			for (size_t row = 0; row < pq.codes.size(); ++row)
+			{
+				write_list(file, pq_codes_key(row), pq.codes[row]);
+			}
+		}
+	}
 
-		auto const norm = [&](u32 count)
+
+	static data_list_t sample_rows(class_cluster_data_t const& cluster_data, size_t n_samples)
+	{
+		// rows spread evenly over the data of each class
+
+		data_list_t samples;
+
+		for (auto const& data : cluster_data)
 		{
-			return (u32)(max_value * count / max);
+			auto const n = std::min(n_samples, data.size());
+			for (size_t i = 0; i < n; ++i)
+			{
+				samples.push_back(data[i * data.size() / n]);
+			}
+		}
+
+		return samples;
+	}
+
+
+	static r64 training_accuracy(cluster_t const& cluster, class_cluster_data_t const& cluster_data, class_weights_t const& cluster_weights, centroid_list_t const& centroids, class_clusters_t const& class_clusters)
+	{
+		// weighted fraction of rows spread evenly over the data of each class
+		// that are closest to a centroid of their own class
+
+		index_list_t centroid_class;
+		for (size_t c = 0; c < class_clusters.size(); ++c)
+		{
+			centroid_class.insert(centroid_class.end(), class_clusters[c], c);
+		}
+
+		r64 correct = 0.0;
+		r64 total = 0.0;
+
+		for (size_t c = 0; c < class_clusters.size(); ++c)
+		{
+			auto const& data = cluster_data[c];
+			auto const n = std::min(MERGE_ACCURACY_SAMPLES, data.size());
+
+			for (size_t i = 0; i < n; ++i)
+			{
+				auto const row = i * data.size() / n;
+				auto const weight = cluster_weights[c][row];
+
+				total += weight;
+				if (centroid_class[cluster.find_centroid(data[row], centroids)] == c)
+				{
+					correct += weight;
+				}
+			}
+		}
+
+		return total > 0 ? correct / total : 0.0;
+	}
+
+
+	//======= STATISTICS ============================
+
+
+	typedef struct
+	{
+		data_list_t data;
+		column_stats_t stats;
+
+	} read_result_t;
+
+	
+	static void append_data(data_list_t& data, img::row_span_t const& row)
+	{
+		// add packed data from a row of a feature image
+		// values are converted for the model when clustering
+
+		cluster::data_row_t data_row(row.length);
+
+		std::transform(row.begin(), row.end(), data_row.begin(), [](data_pixel_t const& p) { return p.value; });
+
+		data.push_back(std::move(data_row));
+	}
+
+
+	static weight_list_t remove_duplicates(data_list_t& data)
+	{
+		// keeps one copy of each row and returns how many times each remaining row was found
+		// clustering the weighted rows gives the same result as clustering all of them
+
+		using row_t = cluster::data_row_t;
+
+		auto const hash = [](row_t const* row)
+		{
+			// FNV-1a
+			u64 h = 14695981039346656037ull;
+			for (auto val : *row)
+			{
+				h = (h ^ val) * 1099511628211ull;
+			}
+
+			return (size_t)h;
 		};
 
-		for (auto& list : pos)
+		auto const equal = [](row_t const* lhs, row_t const* rhs) { return *lhs == *rhs; };
+
+		// maps a unique row to its position in the data
+		std::unordered_map<row_t const*, size_t, decltype(hash), decltype(equal)> unique(data.size(), hash, equal);
+
+		weight_list_t weights;
+		weights.reserve(data.size());
+
+		// unique rows are moved to the front of the list
+		size_t n_unique = 0;
+		for (size_t i = 0; i < data.size(); ++i)
 		{
-			for (auto& count : list)
+			auto it = unique.find(&data[i]);
+			if (it != unique.end())
 			{
-				count = norm(count);
+				++weights[it->second];
+				continue;
 			}
+
+			if (i != n_unique)
+			{
+				data[n_unique] = std::move(data[i]);
+			}
+
+			unique.emplace(&data[n_unique], n_unique);
+			weights.push_back(1.0);
+			++n_unique;
 		}
+
+		unique.clear();
+		data.resize(n_unique);
+
+		return weights;
+	}
+
+	
+	static column_stats_t make_empty_stats()
+	{
+		return column_stats_t(data::feature_image_width());
 	}
 
 
-	static class_column_hists_t make_empty_histograms()
+	static cluster::covariance_t data_covariance(class_cluster_data_t const& cluster_data, class_weights_t const& cluster_weights, index_list_t const& inputs)
 	{
-		class_column_hists_t position_hists;
+		// covariance of the inputs over the weighted rows of every class
+		// each task adds a block of the rows of each class and the blocks are merged in order
 
-		auto const width = data::feature_image_width();
+		auto const n_tasks = thread_pool::parallel_thread_count();
 
-		auto const set_column_zeros = [&](auto c)
+		std::vector<cluster::covariance_t> results(n_tasks);
+
+		auto const add_rows = [&](u32 t)
 		{
-			position_hists[c] = column_hists_t(width, { 0 });
+			auto& result = results[t];
+			result.inputs = inputs;
+
+			for (size_t c = 0; c < cluster_data.size(); ++c)
+			{
+				auto const& data = cluster_data[c];
+				auto const& weights = cluster_weights[c];
+
+				auto const end = data.size() * (t + 1) / n_tasks;
+				for (auto i = data.size() * t / n_tasks; i < end; ++i)
+				{
+					cluster::update_covariance(result, data[i], weights[i]);
+				}
+			}
 		};
 
-		mlclass::for_each_class(set_column_zeros);
+		thread_pool::execute_in_parallel(n_tasks, add_rows);
 
-		return position_hists;
+		cluster::covariance_t covariance;
+		covariance.inputs = inputs;
+
+		for (auto const& result : results)
+		{
+			cluster::merge_covariance(covariance, result);
+		}
+
+		return covariance;
 	}
 	
 
@@ -343,7 +712,10 @@ namespace model_generator
 	{
 		// for cleaning up after reading data
 
-		mlclass::for_each_class([&](auto c) { m_class_data[c].clear(); });
+		for (auto& files : m_class_data)
+		{
+			files.clear();
+		}
 	}
 
 	
@@ -362,14 +734,56 @@ namespace model_generator
 		// reads directory of raw data for a given class
 		
 		// convert the class enum to an array index
-		auto const index = mlclass::to_class_index(class_index);
+		add_class_data(src_dir, mlclass::to_class_index(class_index));
+	}
+
+
+	void ModelGenerator::add_class_data(const char* src_dir, size_t class_index)
+	{
+		if (class_index >= m_class_data.size())
+		{
+			m_class_data.resize(class_index + 1);
+		}
 
 		// data is organized in directories by class
-		m_class_data[index] = dir::get_files_of_type(src_dir, data::FEATURE_IMAGE_EXTENSION);
+		m_class_data[class_index] = dir::get_files_of_type(src_dir, data::FEATURE_IMAGE_EXTENSION);
+	}
+
+
+	void ModelGenerator::set_class_clusters(size_t class_index, size_t n_clusters)
+	{
+		if (class_index >= m_class_clusters.size())
+		{
+			m_class_clusters.resize(class_index + 1, 0);
+		}
+
+		m_class_clusters[class_index] = n_clusters;
+	}
+
+
+	void ModelGenerator::read_class_config(const char* config_file)
+	{
+		// classes are read in order until one has no data directory
+
+		auto config = config_reader::read_config(config_file);
+
+		for (size_t c = 0; config.count(class_data_key(c)); ++c)
+		{
+			add_class_data(config[class_data_key(c)].c_str(), c);
+
+			auto const& count = config[class_clusters_key(c)];
+			set_class_clusters(c, std::strtoull(count.c_str(), nullptr, 10));
+		}
 	}
 
 	
 	void ModelGenerator::save_model(const char* save_dir)
+	{
+		save_model(save_dir, m_cluster_settings.time_limit);
+	}
+
+
+	void ModelGenerator::save_model(const char* save_dir, r64 time_limit)
 	{
 		// saves properties based on all of the data read
 
@@ -378,50 +792,241 @@ namespace model_generator
 			return;
 		}
 
+		using steady_clock_t = std::chrono::steady_clock;
+		auto const start = steady_clock_t::now();
+
 		/* get all of the data */
 
-		class_cluster_data_t cluster_data;
+		auto const n_classes = m_class_data.size();
+
+		class_cluster_data_t cluster_data(n_classes);
+		class_weights_t cluster_weights(n_classes);
+
+		class_column_stats_t class_stats(n_classes);
 
-		auto hists = make_empty_histograms();
+		size_t const n_threads = thread_pool::parallel_thread_count();
 
 		auto const get_data = [&](auto class_index)
 		{
-			for (auto const& data_file : m_class_data[class_index])
+			auto const& files = m_class_data[class_index];
+
+			// each task reads a block of the files into its own results
+			auto const n_tasks = (u32)(std::min(files.size(), n_threads));
+			std::vector<read_result_t> results(n_tasks);
+
+			auto const read_files = [&](u32 t)
 			{
-				img::image_t feature_image;
-				img::read_image_from_file(data_file, feature_image);
+				auto& result = results[t];
+				result.stats = make_empty_stats();
+
+				// decoder memory is reused for each feature image
+				img::image_pool_t pool;
+
+				auto const on_size = [&](u32 width, u32 height)
+				{
+					assert((size_t)(width) == data::feature_image_width());
+
+					result.data.reserve(result.data.size() + height);
+
+					return true;
+				};
+
+				// each row is converted and counted as it is decoded
+				// the whole feature image is never in memory
+				auto const on_row = [&](u32, img::row_span_t const& row)
+				{
+					append_data(result.data, row);
+
+					cluster::update_stats(result.stats, result.data.back());
+
+					return true;
+				};
+
+				auto const end = files.size() * (t + 1) / n_tasks;
+				for (auto i = files.size() * t / n_tasks; i < end; ++i)
+				{
+					img::read_rows_from_file(files[i], pool, on_size, on_row);
+				}
+			};
 
-				assert((size_t)(feature_image.width) == data::feature_image_width());
+			thread_pool::execute_in_parallel(n_tasks, read_files);
 
-				append_data(cluster_data[class_index], feature_image);
+			// merged in file order
+			auto& class_data = cluster_data[class_index];
+			class_stats[class_index] = make_empty_stats();
 
-				update_histograms(hists[class_index], feature_image);
+			for (auto& result : results)
+			{
+				class_data.insert(class_data.end(), std::make_move_iterator(result.data.begin()), std::make_move_iterator(result.data.end()));
+				cluster::merge_stats(class_stats[class_index], result.stats);
 			}
 
-			normalize_histograms(hists[class_index], MAX_RELATIVE_QTY);
+			cluster_weights[class_index] = remove_duplicates(class_data);
 		};
 
-		mlclass::for_each_class(get_data);
+		mlclass::for_each_class(n_classes, get_data);
 
 
 		/* cluster the data */
 
-		auto const data_indeces = find_relevant_positions(hists); // This needs to be right
+		auto const data_indeces = find_relevant_positions(class_stats, m_cluster_settings.position_budget); // This needs to be right
+
+		model_info_t info;
+
+		// the projected positions are clustered instead of the relevant positions
+		auto cluster_indeces = data_indeces;
+		if (m_cluster_settings.projection_dims > 0)
+		{
+			auto const covariance = data_covariance(cluster_data, cluster_weights, data_indeces);
+			info.projection = cluster::make_projection(covariance, m_cluster_settings.projection_dims);
+		}
+
+		if (!info.projection.components.empty())
+		{
+			for (auto& class_data : cluster_data)
+			{
+				for (auto& row : class_data)
+				{
+					row = cluster::project_row(row, info.projection);
+				}
+			}
+
+			cluster_indeces.resize(info.projection.components.size());
+			std::iota(cluster_indeces.begin(), cluster_indeces.end(), 0);
+		}
 
 		cluster_t cluster;
-		centroid_list_t centroids;
+		cluster.set_distance(build_cluster_distance(cluster_indeces));
+		cluster.set_settings(m_cluster_settings);
 
-		auto const class_clusters = mlclass::make_class_clusters(N_CLUSTERS);
+		// chosen for each class if a range is allowed
+		class_clusters_t class_clusters(n_classes);
+		std::vector<centroid_list_t> class_centroids(n_classes);
+
+		// used instead of centroids when tree_beam is set
+		class_trees_t class_trees(n_classes);
+
+		// the centroids before same class centroids are merged
+		auto const merge = m_cluster_settings.merge_distance > 0 && m_cluster_settings.tree_beam == 0;
+		auto const merge_distance = m_cluster_settings.merge_distance * (cluster::MODEL_VALUE_MAX - cluster::MODEL_VALUE_MIN);
+		std::vector<centroid_list_t> class_unmerged(n_classes);
+
+		// classes are clustered in parallel, the largest first so that it does not finish last
+		index_list_t class_order(n_classes);
+		std::iota(class_order.begin(), class_order.end(), 0);
+		std::stable_sort(class_order.begin(), class_order.end(), [&](size_t lhs, size_t rhs) { return cluster_data[lhs].size() > cluster_data[rhs].size(); });
+
+		size_t total_size = 0;
+		for (auto const& data : cluster_data)
+		{
+			total_size += data.size();
+		}
 
-		cluster.set_distance(build_cluster_distance(data_indeces));
+		auto const elapsed = std::chrono::duration<r64>(steady_clock_t::now() - start).count();
+		auto const time_left = std::max(time_limit - elapsed, 1e-6);
 
-		auto const cluster_class_data = [&](auto c)
+		auto const cluster_class_data = [&](u32 i)
 		{
-			auto const cents = cluster.cluster_data(cluster_data[c], class_clusters[c]);
-			centroids.insert(centroids.end(), cents.begin(), cents.end());
+			auto const c = class_order[i];
+
+			auto settings = m_cluster_settings;
+			settings.time_limit = 0;
+
+			if (c < m_class_clusters.size() && m_class_clusters[c] > 0)
+			{
+				// a fixed count stays fixed
+				settings.min_count = settings.min_count < settings.count ? std::min(settings.min_count, m_class_clusters[c]) : m_class_clusters[c];
+				settings.count = m_class_clusters[c];
+			}
+
+			if (time_limit > 0)
+			{
+				// each class gets time for its share of the data on the threads available
+				// a class that is out of time still gets one attempt
+				auto const share = total_size ? (r64)n_threads * cluster_data[c].size() / total_size : 1.0;
+				settings.time_limit = time_left * std::min(share, 1.0);
+			}
+
+			// each thread gets its own copy
+			auto class_cluster = cluster;
+			class_cluster.set_settings(settings);
+
+			// large amounts of data are reduced to a weighted sample when settings.coreset_size is set
+			class_cluster.reduce_to_coreset(cluster_data[c], cluster_weights[c], settings.count);
+
+			if (settings.tree_beam > 0)
+			{
+				class_trees[c] = class_cluster.cluster_tree(cluster_data[c], cluster_weights[c], settings.count);
+				class_clusters[c] = class_trees[c].leaf_count;
+				return;
+			}
+
+			auto cents = cluster_class(class_cluster, cluster_data[c], cluster_weights[c], settings);
+
+			if (merge)
+			{
+				class_unmerged[c] = cents;
+
+				cents = class_cluster.merge_centroids(cluster_data[c], cluster_weights[c], cents, merge_distance);
+			}
+
+			class_clusters[c] = cents.size();
+			class_centroids[c] = std::move(cents);
 		};
 
-		mlclass::for_each_class(cluster_class_data);
+		thread_pool::execute_in_parallel((u32)n_classes, cluster_class_data);
+
+		// the centroids of each class in class order
+		centroid_list_t centroids;
+		centroid_list_t unmerged;
+		class_clusters_t unmerged_clusters(n_classes);
+
+		for (size_t c = 0; c < n_classes; ++c)
+		{
+			centroids.insert(centroids.end(), class_centroids[c].begin(), class_centroids[c].end());
+			unmerged.insert(unmerged.end(), class_unmerged[c].begin(), class_unmerged[c].end());
+			unmerged_clusters[c] = class_unmerged[c].size();
+		}
+
+		auto const& settings = m_cluster_settings;
+
+		info.class_clusters = class_clusters;
+
+		if (merge && unmerged.size() > centroids.size())
+		{
+			info.merged = unmerged.size() - centroids.size();
+			info.accuracy_before_merge = training_accuracy(cluster, cluster_data, cluster_weights, unmerged, unmerged_clusters);
+			info.accuracy_after_merge = training_accuracy(cluster, cluster_data, cluster_weights, centroids, class_clusters);
+		}
+
+		// every node of the tree is saved as a row of the model
+		if (settings.tree_beam > 0)
+		{
+			info.tree = join_trees(class_trees);
+			info.tree_beam = settings.tree_beam;
+
+			for (auto const& node : info.tree.nodes)
+			{
+				centroids.push_back(node.centroid);
+			}
+		}
+
+		// an index of the class centroids, its codebook is saved as rows of the model
+		// it is left out when there are too few centroids for it to be faster than comparing all of them
+		auto const n_leaves = std::accumulate(class_clusters.begin(), class_clusters.end(), (size_t)0);
+		auto const n_codewords = std::min(settings.pq_codewords, cluster::PQ_MAX_CODEWORDS);
+
+		if (settings.pq_subspaces > 0 && n_leaves >= cluster::PQ_MIN_CENTROIDS_PER_CODEWORD * n_codewords)
+		{
+			centroid_list_t const leaves(centroids.begin(), centroids.begin() + n_leaves);
+
+			info.pq = cluster.make_quantizer(leaves, cluster_indeces, settings.pq_subspaces);
+			info.pq_first_row = centroids.size();
+			info.pq_rerank = settings.pq_rerank;
+			info.pq_recall = cluster.quantizer_recall(sample_rows(cluster_data, PQ_RECALL_SAMPLES), leaves, info.pq, info.pq_rerank);
+
+			centroids.insert(centroids.end(), info.pq.codebook.begin(), info.pq.codebook.end());
+		}
 
 
 		/* create the model and save it */
@@ -436,16 +1041,20 @@ namespace model_generator
 
 		for(u32 y = 0; y < height; ++y)
 		{
-			auto const centroid = centroids[y];
+			auto const& centroid = centroids[y];
 			auto ptr = image.row_begin(y);
 			for (u32 x = 0; x < width; ++x)
 			{
-				auto is_counted = std::find(data_indeces.begin(), data_indeces.end(), x) != data_indeces.end();
-				ptr[x] = model_value_to_model_pixel(centroid[x], is_counted);
+				// projected rows are shorter than the image
+				auto is_counted = std::find(cluster_indeces.begin(), cluster_indeces.end(), x) != cluster_indeces.end();
+				auto const value = x < centroid.size() ? centroid[x] : cluster::MODEL_VALUE_MIN;
+				ptr[x] = model_value_to_model_pixel(value, is_counted);
 			}
 		}
 
 		img::write_image(image, save_path);
+
+		save_model_info(save_path, info);
 	}
 
 		
@@ -1,9 +1,9 @@
 #pragma once
 
 #include "../../utils/ml_class.hpp"
+#include "../../utils/cluster_config.hpp"
 
 #include <filesystem>
-#include <array>
 #include <vector>
 
 namespace fs = std::filesystem;
@@ -16,6 +16,11 @@ It is saved as png for later use.
 A binary file could be used as well but an image is more visual and user-friendly
 Each row in the model image is a centroid found by the clustering algorithm
 
+Classes can be defined at runtime with a config file, see read_class_config():
+CLASS_<c>_DATA = directory of data images for class index c
+CLASS_<c>_CLUSTERS = number of clusters for class c, optional
+Class indeces start at 0 and the first one without data ends the list.
+
 */
 
 namespace model_generator
@@ -25,11 +30,18 @@ namespace model_generator
 	public:
 		using file_path_t = fs::path;
 		using file_list_t = std::vector<file_path_t>;
-		using class_file_list_t = std::array<file_list_t, mlclass::ML_CLASS_COUNT>;
+		using class_file_list_t = std::vector<file_list_t>;
 
 	private:
 		// file paths of raw data images by class
-		class_file_list_t m_class_data;		
+		// every MLClass needs data, more classes can be added by index
+		class_file_list_t m_class_data = class_file_list_t(mlclass::ML_CLASS_COUNT);
+
+		// number of clusters by class, 0 to use the cluster settings
+		mlclass::class_clusters_t m_class_clusters = mlclass::make_class_clusters(0);
+
+		// how much work is done finding clusters
+		cluster::cluster_settings_t m_cluster_settings;
 
 	public:
 		// for cleaning up after reading data
@@ -41,7 +53,24 @@ namespace model_generator
 		// reads directory of data images for a given class
 		void add_class_data(const char* src_dir, MLClass class_index);
 
+		// same as above for classes that are only known at runtime
+		void add_class_data(const char* src_dir, size_t class_index);
+
+		// clusters for a class instead of the count in the cluster settings, 0 to use the settings
+		void set_class_clusters(size_t class_index, size_t n_clusters);
+
+		// adds the classes listed in a config file
+		void read_class_config(const char* config_file);
+
+		// reads clustering settings from a config file, see cluster_config.hpp
+		void read_cluster_settings(const char* config_file) { m_cluster_settings = cluster::read_cluster_settings(config_file); }
+
+		void set_cluster_settings(cluster::cluster_settings_t const& settings) { m_cluster_settings = settings; }
+
 		// saves properties based on all of the data read
 		void save_model(const char* save_dir);
+
+		// saves the best model found within time_limit seconds, 0 for no limit
+		void save_model(const char* save_dir, r64 time_limit);
 	};
 }
@@ -1,6 +1,6 @@
 #pragma once
 
-#include "../../utils/cluster.hpp"
+#include "../../utils/cluster_config.hpp"
 
 /*
 
@@ -19,13 +19,13 @@ namespace model_generator
 	inline cluster::dist_func_t build_cluster_distance(index_list_t const& relevant_indeces)
 	{
 		// average absolute difference
-		return [&](auto const& data, auto const& centroid)
+		return [relevant_indeces](auto const& data, auto const& centroid)
 		{
 			r64 total = 0;
 
 			for (auto i : relevant_indeces)
 			{
-				total += std::abs(data[i] - centroid[i]);
+				total += std::abs(cluster::data_to_value(data[i]) - centroid[i]);
 			}
 
 			return total / relevant_indeces.size();
@@ -35,13 +35,13 @@ namespace model_generator
 		/*
 
 		// Root mean square difference
-		return [&](auto const& data, auto const& centroid)
+		return [relevant_indeces](auto const& data, auto const& centroid)
 		{
 			r64 total = 0;
 
 			for (auto i : relevant_indeces)
 			{
-				auto const diff = data[i] - centroid[i];
+				auto const diff = cluster::data_to_value(data[i]) - centroid[i];
 				total += diff * diff;
 			}
 
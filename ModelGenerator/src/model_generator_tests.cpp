@@ -1,5 +1,6 @@
 #include "../src/ModelGenerator.hpp"
 #include "../src/pixel_conversion.hpp"
+#include "../../DataAdaptor/src/data_adaptor.hpp"
 #include "../../utils/dirhelper.hpp"
 #include "../../utils/test_dir.hpp"
 
@@ -9,9 +10,13 @@
 #include <numeric>
 #include <cmath>
 #include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
 
 namespace dir = dirhelper;
 namespace gen = model_generator;
+namespace data = data_adaptor;
 
 std::string src_fail_root;
 std::string src_pass_root;
@@ -51,6 +56,19 @@ bool save_model_one_class_test();
 bool save_model_one_file_test();
 bool pixel_conversion_test();
 bool save_model_active_test();
+bool packed_data_test();
+bool weighted_data_test();
+bool coreset_test();
+bool empty_cluster_test();
+bool read_cluster_settings_test();
+bool cluster_count_test();
+bool centroid_tree_test();
+bool quantizer_test();
+bool projection_test();
+bool position_budget_test();
+bool merge_stats_test();
+bool merge_centroids_test();
+bool class_config_test();
 
 int main()
 {
@@ -75,6 +93,19 @@ int main()
 	run_test("save_model_no_data_test()          ", save_model_no_data_test);
 	run_test("save_model_one_class_test()        ", save_model_one_class_test);
 	run_test("save_model_one_file_test()         ", save_model_one_file_test);
+	run_test("packed_data_test()                 ", packed_data_test);
+	run_test("weighted_data_test()               ", weighted_data_test);
+	run_test("coreset_test()                     ", coreset_test);
+	run_test("empty_cluster_test()               ", empty_cluster_test);
+	run_test("read_cluster_settings_test()       ", read_cluster_settings_test);
+	run_test("cluster_count_test()               ", cluster_count_test);
+	run_test("centroid_tree_test()               ", centroid_tree_test);
+	run_test("quantizer_test()                   ", quantizer_test);
+	run_test("projection_test()                  ", projection_test);
+	run_test("position_budget_test()             ", position_budget_test);
+	run_test("merge_stats_test()                 ", merge_stats_test);
+	run_test("merge_centroids_test()             ", merge_centroids_test);
+	run_test("class_config_test()                ", class_config_test);
 	run_test("save_model_active_test()           ", save_model_active_test);
 	run_test("pixel_conversion_test()            ", pixel_conversion_test);
 	
@@ -105,6 +136,198 @@ void delete_files(std::string const& dir)
 }
 
 
+// average absolute difference over every position, as build_cluster_distance() does over the relevant ones
+r64 test_distance(cluster::data_row_t const& data, cluster::value_row_t const& centroid)
+{
+	r64 total = 0;
+
+	for (size_t i = 0; i < data.size(); ++i)
+	{
+		total += std::abs(cluster::data_to_value(data[i]) - centroid[i]);
+	}
+
+	return total / data.size();
+}
+
+
+cluster::Cluster make_test_cluster()
+{
+	cluster::Cluster cluster;
+	cluster.set_distance(test_distance);
+
+	return cluster;
+}
+
+
+// rows spread a little around n_blobs values that are far apart
+cluster::data_row_list_t make_blobs(size_t n_blobs, size_t rows_per_blob, size_t row_size)
+{
+	std::mt19937 gen(1234);
+	std::uniform_real_distribution<r64> noise(-0.02, 0.02);
+
+	auto const range = cluster::MODEL_VALUE_MAX - cluster::MODEL_VALUE_MIN;
+
+	cluster::data_row_list_t x_list;
+
+	for (size_t b = 0; b < n_blobs; ++b)
+	{
+		for (size_t r = 0; r < rows_per_blob; ++r)
+		{
+			cluster::data_row_t row(row_size);
+			for (auto& val : row)
+			{
+				val = cluster::value_to_data(cluster::MODEL_VALUE_MIN + range * ((b + 1.0) / (n_blobs + 1) + noise(gen)));
+			}
+
+			x_list.push_back(std::move(row));
+		}
+	}
+
+	return x_list;
+}
+
+
+// every centroid is within tolerance of a centroid in the other list, as a fraction of the value range
+bool same_centroids(cluster::centroid_list_t const& lhs, cluster::centroid_list_t const& rhs, r64 tolerance)
+{
+	if (lhs.size() != rhs.size())
+		return false;
+
+	auto const max_diff = tolerance * (cluster::MODEL_VALUE_MAX - cluster::MODEL_VALUE_MIN);
+
+	auto const is_close = [&](auto const& a, auto const& b)
+	{
+		for (size_t d = 0; d < a.size(); ++d)
+		{
+			if (std::abs(a[d] - b[d]) > max_diff)
+				return false;
+		}
+
+		return true;
+	};
+
+	return std::all_of(lhs.begin(), lhs.end(), [&](auto const& a)
+	{
+		return std::any_of(rhs.begin(), rhs.end(), [&](auto const& b) { return is_close(a, b); });
+	});
+}
+
+
+// the info file saved with the only model in model_root
+cr::config_t read_model_info()
+{
+	auto const files = dir::get_files_of_type(model_root, img_ext);
+	if (files.size() != 1)
+		return {};
+
+	auto info_path = fs::path(files[0]);
+	info_path.replace_extension(gen::MODEL_INFO_EXTENSION);
+
+	return cr::read_config(info_path.string().c_str());
+}
+
+
+// saves a model of the test data and reads the info file saved with it
+cr::config_t save_model_info(cluster::cluster_settings_t const& settings)
+{
+	delete_files(model_root);
+
+	gen::ModelGenerator gen;
+
+	gen.add_class_data(data_pass_root.c_str(), MLClass::Pass);
+	gen.add_class_data(data_fail_root.c_str(), MLClass::Fail);
+	gen.set_cluster_settings(settings);
+
+	gen.save_model(model_root.c_str());
+
+	return read_model_info();
+}
+
+
+// the packed rows of every data image in a directory
+cluster::data_row_list_t read_data_rows(std::string const& dir)
+{
+	cluster::data_row_list_t x_list;
+
+	for (auto const& file : dir::get_files_of_type(dir, img_ext))
+	{
+		img::image_t image;
+		img::read_image_from_file(file, image);
+
+		for (u32 y = 0; y < image.height; ++y)
+		{
+			auto ptr = image.row_begin(y);
+
+			cluster::data_row_t row(image.width);
+			std::transform(ptr, ptr + image.width, row.begin(), [](auto const& p) { return p.value; });
+
+			x_list.push_back(std::move(row));
+		}
+	}
+
+	return x_list;
+}
+
+
+template <typename T>
+std::vector<T> read_list(std::string const& str)
+{
+	std::vector<T> list;
+	std::istringstream iss(str);
+
+	for (T val; iss >> val;)
+	{
+		list.push_back(val);
+	}
+
+	return list;
+}
+
+
+// saves rows as a data image in a new directory
+void write_data_image(fs::path const& dir, cluster::data_row_list_t const& x_list)
+{
+	fs::create_directories(dir);
+
+	img::image_t image;
+	img::make_image(image, (u32)x_list[0].size(), (u32)x_list.size());
+
+	for (u32 y = 0; y < image.height; ++y)
+	{
+		auto ptr = image.row_begin(y);
+		for (u32 x = 0; x < image.width; ++x)
+		{
+			ptr[x].value = x_list[y][x];
+		}
+	}
+
+	img::write_image(image, dir / (std::string("data") + data::FEATURE_IMAGE_EXTENSION));
+}
+
+
+// the positions flagged as counted in the first row of the only model in model_root
+cluster::index_list_t read_model_positions()
+{
+	cluster::index_list_t positions;
+
+	auto const files = dir::get_files_of_type(model_root, img_ext);
+	if (files.size() != 1)
+		return positions;
+
+	img::image_t model;
+	img::read_image_from_file(files[0], model);
+
+	auto ptr = model.row_begin(0);
+	for (u32 x = 0; x < model.width; ++x)
+	{
+		if (gen::is_relevant(gen::model_pixel_to_model_value(ptr[x])))
+			positions.push_back(x);
+	}
+
+	return positions;
+}
+
+
 //======= TESTS ==============
 
 
@@ -281,4 +504,680 @@ bool pixel_conversion_test()
 	}
 
 	return true;
-}
\ No newline at end of file
+}
+
+
+// data is kept as the feature pixels read from the data images and converted to model values when clustering
+bool packed_data_test()
+{
+	static_assert(sizeof(cluster::data_t) == sizeof(gen::data_pixel_t));
+
+	auto const files = dir::get_files_of_type(data_pass_root, img_ext);
+	if (files.empty())
+		return false;
+
+	img::image_t image;
+	img::read_image_from_file(files[0], image);
+
+	cluster::data_row_list_t x_list;
+	cluster::value_row_t mean(image.width, 0.0);
+
+	for (u32 y = 0; y < image.height; ++y)
+	{
+		auto ptr = image.row_begin(y);
+
+		cluster::data_row_t row(image.width);
+		for (u32 x = 0; x < image.width; ++x)
+		{
+			row[x] = ptr[x].value;
+
+			auto const value = gen::feature_pixel_to_model_value(ptr[x]);
+			if (cluster::data_to_value(row[x]) != value)
+				return false;
+
+			mean[x] += value / image.height;
+		}
+
+		x_list.push_back(std::move(row));
+	}
+
+	// one cluster is the mean of the model values
+	auto cluster = make_test_cluster();
+	auto const centroids = cluster.cluster_data(x_list, 1);
+
+	return same_centroids(centroids, { mean }, 1e-9);
+}
+
+
+// clustering rows with weights is the same as clustering each row repeated weight times
+bool weighted_data_test()
+{
+	auto const x_list = make_blobs(2, 20, 8);
+
+	cluster::weight_list_t x_weights;
+	cluster::data_row_list_t expanded;
+
+	for (size_t i = 0; i < x_list.size(); ++i)
+	{
+		auto const weight = i % 3 + 1;
+		x_weights.push_back((r64)weight);
+		expanded.insert(expanded.end(), weight, x_list[i]);
+	}
+
+	auto cluster = make_test_cluster();
+
+	auto const weighted = cluster.cluster_data(x_list, x_weights, 2);
+	auto const weighted_distance = cluster.stats().average_distance;
+
+	auto const repeated = cluster.cluster_data(expanded, 2);
+	auto const repeated_distance = cluster.stats().average_distance;
+
+	return same_centroids(weighted, repeated, 1e-9) && std::abs(weighted_distance - repeated_distance) <= 1e-9 * repeated_distance;
+}
+
+
+// the data is only reduced when a coreset size is set, and the coreset clusters about the same as all of the data
+bool coreset_test()
+{
+	auto const x_list = make_blobs(2, 1000, 4);
+	cluster::weight_list_t const x_weights(x_list.size(), 1.0);
+
+	auto cluster = make_test_cluster();
+
+	auto sample = x_list;
+	auto sample_weights = x_weights;
+
+	cluster.reduce_to_coreset(sample, sample_weights, 2);
+	if (sample != x_list || sample_weights != x_weights)
+		return false;
+
+	cluster::cluster_settings_t settings;
+	settings.coreset_size = 200;
+	cluster.set_settings(settings);
+
+	cluster.reduce_to_coreset(sample, sample_weights, 2);
+	if (sample.size() > settings.coreset_size || sample_weights.size() != sample.size())
+		return false;
+
+	// the weights stand for every row
+	auto const total_weight = std::accumulate(sample_weights.begin(), sample_weights.end(), 0.0);
+	if (std::abs(total_weight - x_list.size()) > 0.1 * x_list.size())
+		return false;
+
+	auto const all_centroids = cluster.cluster_data(x_list, x_weights, 2);
+	auto const sample_centroids = cluster.cluster_data(sample, sample_weights, 2);
+
+	return same_centroids(all_centroids, sample_centroids, 0.01);
+}
+
+
+// a cluster left without data restarts at the farthest data point
+bool empty_cluster_test()
+{
+	// most rows are the same, so both starting centroids are usually that row and one of them gets no data
+	auto const rows = make_blobs(2, 1, 4);
+
+	cluster::data_row_list_t x_list(20, rows[0]);
+	x_list.push_back(rows[1]);
+
+	cluster::centroid_list_t expected(rows.size());
+	for (size_t i = 0; i < rows.size(); ++i)
+	{
+		std::transform(rows[i].begin(), rows[i].end(), std::back_inserter(expected[i]), cluster::data_to_value);
+	}
+
+	cluster::cluster_settings_t settings;
+	settings.attempts = 0;
+
+	auto cluster = make_test_cluster();
+	cluster.set_settings(settings);
+
+	for (int i = 0; i < 20; ++i)
+	{
+		if (!same_centroids(cluster.cluster_data(x_list, 2), expected, 1e-9))
+			return false;
+	}
+
+	// stops after the first iteration when every data point is allowed to change clusters
+	settings.max_changes = x_list.size();
+	cluster.set_settings(settings);
+	cluster.cluster_data(x_list, 2);
+
+	return cluster.stats().best_iterations == 1;
+}
+
+
+// settings are read from a config file, missing and invalid values keep their defaults
+bool read_cluster_settings_test()
+{
+	auto const config_path = (fs::temp_directory_path() / "cluster_settings_test.txt").string();
+
+	auto const write_config = [&](const char* text)
+	{
+		std::ofstream file(config_path);
+		file << text;
+	};
+
+	write_config(
+		"# every key\n"
+		"CLUSTER_ATTEMPTS = 5\n"
+		"CLUSTER_ITERATIONS = 7\n"
+		"CLUSTER_COUNT = 12\n"
+		"CLUSTER_MIN_COUNT = 3\n"
+		"CLUSTER_QUALITY = 0.75\n"
+		"CLUSTER_TIME_LIMIT = 2.5\n"
+		"CLUSTER_TREE_BEAM = 2\n"
+		"CLUSTER_PQ_SUBSPACES = 4\n"
+		"CLUSTER_PQ_RERANK = 6\n"
+		"CLUSTER_PQ_CODEWORDS = 32\n"
+		"CLUSTER_PROJECTION_DIMS = 9\n"
+		"CLUSTER_POSITION_BUDGET = 11\n"
+		"CLUSTER_MERGE_DISTANCE = 0.125\n"
+		"CLUSTER_CORESET_SIZE = 500\n"
+		"CLUSTER_CORESET_ERROR = 0.25\n"
+		"CLUSTER_MAX_CHANGES = 8\n"
+		"CLUSTER_SHIFT_TOLERANCE = 0.001\n");
+
+	auto settings = cluster::read_cluster_settings(config_path.c_str());
+
+	auto const all_read =
+		settings.attempts == 5 && settings.iterations == 7 && settings.count == 12 && settings.min_count == 3 &&
+		settings.quality == 0.75 && settings.time_limit == 2.5 && settings.tree_beam == 2 && settings.pq_subspaces == 4 &&
+		settings.pq_rerank == 6 && settings.pq_codewords == 32 && settings.projection_dims == 9 && settings.position_budget == 11 && settings.merge_distance == 0.125 &&
+		settings.coreset_size == 500 && settings.coreset_error == 0.25 && settings.max_changes == 8 && settings.shift_tolerance == 0.001;
+
+	write_config(
+		"# invalid and missing values\n"
+		"CLUSTER_ATTEMPTS = many\n"
+		"CLUSTER_ITERATIONS = 0\n"
+		"CLUSTER_COUNT = 4\n"
+		"CLUSTER_QUALITY = -1\n");
+
+	settings = cluster::read_cluster_settings(config_path.c_str());
+
+	fs::remove(config_path);
+
+	cluster::cluster_settings_t const defaults{};
+
+	// the count is fixed when no minimum is given
+	auto const defaults_kept =
+		settings.attempts == defaults.attempts && settings.iterations == defaults.iterations && settings.count == 4 && settings.min_count == 4 &&
+		settings.quality == defaults.quality && settings.coreset_size == defaults.coreset_size && settings.max_changes == defaults.max_changes;
+
+	return all_read && defaults_kept;
+}
+
+
+// the fewest clusters that remove settings.quality of the distance from a single centroid are used for each class
+bool cluster_count_test()
+{
+	cluster::cluster_settings_t settings;
+	settings.attempts = 2;
+	settings.min_count = 1;
+	settings.count = 6;
+
+	auto const has_count = [](cr::config_t& info, size_t count)
+	{
+		return info[gen::class_clusters_key(0)] == std::to_string(count) && info[gen::class_clusters_key(1)] == std::to_string(count);
+	};
+
+	// a single centroid always removes none of the distance
+	settings.quality = 0.0;
+	auto info = save_model_info(settings);
+	if (!has_count(info, 1))
+		return false;
+
+	// no count removes more than all of it
+	settings.quality = 2.0;
+	info = save_model_info(settings);
+
+	return has_count(info, settings.count);
+}
+
+
+// a tree search finds the same leaf as comparing every leaf when the clusters are far apart
+bool centroid_tree_test()
+{
+	size_t const n_clusters = 4;
+	size_t const blob_size = 10;
+
+	auto const x_list = make_blobs(n_clusters, blob_size, 4);
+	cluster::weight_list_t const x_weights(x_list.size(), 1.0);
+
+	auto cluster = make_test_cluster();
+	auto const tree = cluster.cluster_tree(x_list, x_weights, n_clusters);
+
+	// each split makes two leaves from one
+	if (tree.leaf_count != n_clusters || tree.nodes.size() != 2 * n_clusters - 1 || tree.roots.size() != 1)
+		return false;
+
+	cluster::centroid_list_t leaves;
+	for (size_t i = 0; i < tree.leaf_count; ++i)
+	{
+		if (!tree.nodes[i].children.empty())
+			return false;
+
+		leaves.push_back(tree.nodes[i].centroid);
+	}
+
+	// one leaf for each blob
+	cluster::centroid_list_t blob_means(n_clusters, cluster::value_row_t(x_list[0].size(), 0.0));
+	for (size_t i = 0; i < x_list.size(); ++i)
+	{
+		for (size_t d = 0; d < x_list[i].size(); ++d)
+		{
+			blob_means[i / blob_size][d] += cluster::data_to_value(x_list[i][d]) / blob_size;
+		}
+	}
+
+	if (!same_centroids(leaves, blob_means, 1e-9))
+		return false;
+
+	for (auto const& row : x_list)
+	{
+		auto const exact = cluster.find_centroid(row, leaves);
+
+		if (cluster.find_centroid(row, tree, 1) != exact || cluster.find_centroid(row, tree, n_clusters) != exact)
+			return false;
+	}
+
+	return true;
+}
+
+
+// the index finds the same centroid as comparing every centroid for most of the data
+bool quantizer_test()
+{
+	size_t const n_centroids = 64;
+	size_t const row_size = 16;
+
+	std::mt19937 gen(4321);
+	std::uniform_real_distribution<r64> position(cluster::MODEL_VALUE_MIN, cluster::MODEL_VALUE_MAX);
+	std::uniform_real_distribution<r64> noise(-0.01, 0.01);
+
+	auto const range = cluster::MODEL_VALUE_MAX - cluster::MODEL_VALUE_MIN;
+
+	cluster::centroid_list_t centroids(n_centroids, cluster::value_row_t(row_size));
+	cluster::data_row_list_t x_list;
+
+	for (auto& centroid : centroids)
+	{
+		for (auto& val : centroid)
+		{
+			val = position(gen);
+		}
+
+		for (int r = 0; r < 5; ++r)
+		{
+			cluster::data_row_t row(row_size);
+			std::transform(centroid.begin(), centroid.end(), row.begin(), [&](r64 val) { return cluster::value_to_data(val + range * noise(gen)); });
+
+			x_list.push_back(std::move(row));
+		}
+	}
+
+	cluster::index_list_t dims(row_size);
+	std::iota(dims.begin(), dims.end(), 0);
+
+	auto cluster = make_test_cluster();
+	auto const pq = cluster.make_quantizer(centroids, dims, 4);
+
+	auto const n_codewords = cluster.settings().pq_codewords;
+	auto const in_codebook = [&](auto code) { return code < n_codewords; };
+
+	if (pq.codebook.size() != n_codewords || pq.subspaces.size() != 4 || pq.codes.size() != n_centroids)
+		return false;
+
+	if (!std::all_of(pq.codes.begin(), pq.codes.end(), [&](auto const& codes) { return std::all_of(codes.begin(), codes.end(), in_codebook); }))
+		return false;
+
+	// comparing every candidate exactly is the same as an exact search
+	if (cluster.quantizer_recall(x_list, centroids, pq, n_centroids) != 1.0)
+		return false;
+
+	if (cluster.quantizer_recall(x_list, centroids, pq, cluster.settings().pq_rerank) < 0.9)
+		return false;
+
+	// a model only has an index when there are enough centroids for each codeword
+	cluster::cluster_settings_t settings;
+	settings.attempts = 2;
+	settings.pq_subspaces = 2;
+
+	auto info = save_model_info(settings);
+	if (info.count(gen::PQ_SEARCH_KEY))
+		return false;
+
+	settings.pq_codewords = 2 * settings.count / cluster::PQ_MIN_CENTROIDS_PER_CODEWORD;
+	info = save_model_info(settings);
+
+	return info[gen::PQ_SEARCH_KEY] == "1" && info[gen::PQ_CODEWORDS_KEY] == std::to_string(settings.pq_codewords);
+}
+
+
+// the projection saved with a model is the principal components of the weighted data
+bool projection_test()
+{
+	auto const is_close = [](r64 lhs, r64 rhs, r64 scale) { return std::abs(lhs - rhs) <= 1e-9 * scale; };
+
+	// weighted rows are counted the same as repeated rows, also when the rows are split and merged
+	std::mt19937 gen(99);
+	std::uniform_int_distribution<cluster::data_t> pixel;
+
+	cluster::data_row_list_t x_list(40, cluster::data_row_t(6));
+	for (auto& row : x_list)
+	{
+		std::generate(row.begin(), row.end(), [&]() { return pixel(gen); });
+	}
+
+	cluster::covariance_t weighted;
+	cluster::covariance_t repeated;
+	cluster::covariance_t first_half;
+	cluster::covariance_t second_half;
+
+	weighted.inputs = repeated.inputs = first_half.inputs = second_half.inputs = { 0, 2, 3, 5 };
+
+	for (size_t i = 0; i < x_list.size(); ++i)
+	{
+		auto const weight = i % 3 + 1;
+
+		cluster::update_covariance(weighted, x_list[i], (r64)weight);
+		cluster::update_covariance(i < x_list.size() / 2 ? first_half : second_half, x_list[i], (r64)weight);
+
+		for (size_t w = 0; w < weight; ++w)
+		{
+			cluster::update_covariance(repeated, x_list[i], 1.0);
+		}
+	}
+
+	cluster::merge_covariance(first_half, second_half);
+
+	auto const range = cluster::MODEL_VALUE_MAX - cluster::MODEL_VALUE_MIN;
+
+	for (auto const* cov : { &repeated, &first_half })
+	{
+		if (cov->weight != weighted.weight)
+			return false;
+
+		for (size_t i = 0; i < weighted.mean.size(); ++i)
+		{
+			if (!is_close(cov->mean[i], weighted.mean[i], range))
+				return false;
+		}
+
+		for (size_t i = 0; i < weighted.comoments.size(); ++i)
+		{
+			if (!is_close(cov->comoments[i], weighted.comoments[i], weighted.weight * range * range))
+				return false;
+		}
+	}
+
+	// saved with every digit and read back
+	cluster::cluster_settings_t settings;
+	settings.attempts = 2;
+	settings.projection_dims = 2;
+
+	auto info = save_model_info(settings);
+
+	cluster::covariance_t data_cov;
+	data_cov.inputs = read_list<size_t>(info[gen::PROJECTION_INPUTS_KEY]);
+
+	for (auto const& dir : { data_pass_root, data_fail_root })
+	{
+		for (auto const& row : read_data_rows(dir))
+		{
+			cluster::update_covariance(data_cov, row, 1.0);
+		}
+	}
+
+	// fewer when there are fewer inputs
+	auto const expected = cluster::make_projection(data_cov, settings.projection_dims);
+	if (info[gen::PROJECTION_DIMS_KEY] != std::to_string(expected.components.size()))
+		return false;
+
+	auto const mean = read_list<r64>(info[gen::PROJECTION_MEAN_KEY]);
+	auto const scale = read_list<r64>(info[gen::PROJECTION_SCALE_KEY]);
+
+	if (data_cov.inputs.empty() || mean.size() != expected.mean.size() || scale.size() != 1 || !is_close(scale[0], expected.scale, expected.scale))
+		return false;
+
+	for (size_t i = 0; i < mean.size(); ++i)
+	{
+		if (!is_close(mean[i], expected.mean[i], range))
+			return false;
+	}
+
+	// components are unit vectors, their sign does not matter
+	for (size_t d = 0; d < expected.components.size(); ++d)
+	{
+		auto const component = read_list<r64>(info[gen::projection_component_key(d)]);
+		if (component.size() != expected.components[d].size())
+			return false;
+
+		auto const dot = std::inner_product(component.begin(), component.end(), expected.components[d].begin(), 0.0);
+		if (!is_close(std::abs(dot), 1.0, 1.0))
+			return false;
+	}
+
+	return true;
+}
+
+
+// a position budget keeps the positions whose class means are furthest apart compared to the spread within the classes
+bool position_budget_test()
+{
+	auto const width = data::feature_image_width();
+	size_t const n_rows = 20;
+	size_t const budget = 10;
+
+	// every position has the same spread and a different distance between the class means
+	cluster::data_t const spread = 1 << 20;
+	cluster::data_t const center = 1u << 31;
+
+	auto const separation = [&](size_t x) { return (cluster::data_t)(3 + (x * 37) % width) * spread; };
+
+	std::vector<cluster::data_row_list_t> class_rows(2, cluster::data_row_list_t(n_rows, cluster::data_row_t(width)));
+
+	for (size_t r = 0; r < n_rows; ++r)
+	{
+		for (size_t x = 0; x < width; ++x)
+		{
+			auto const noise = r % 2 ? spread : -spread;
+
+			class_rows[0][r][x] = center - separation(x) / 2 + noise;
+			class_rows[1][r][x] = center + separation(x) / 2 + noise;
+		}
+	}
+
+	auto const data_dir = fs::temp_directory_path() / "position_budget_test";
+	fs::remove_all(data_dir);
+
+	write_data_image(data_dir / "pass", class_rows[0]);
+	write_data_image(data_dir / "fail", class_rows[1]);
+
+	cluster::cluster_settings_t settings;
+	settings.attempts = 2;
+	settings.position_budget = budget;
+
+	delete_files(model_root);
+
+	gen::ModelGenerator gen;
+	gen.add_class_data((data_dir / "pass").string().c_str(), MLClass::Pass);
+	gen.add_class_data((data_dir / "fail").string().c_str(), MLClass::Fail);
+	gen.set_cluster_settings(settings);
+
+	gen.save_model(model_root.c_str());
+
+	fs::remove_all(data_dir);
+
+	// the positions with the largest separations
+	cluster::index_list_t expected;
+	for (size_t x = 0; x < width; ++x)
+	{
+		if ((x * 37) % width >= width - budget)
+			expected.push_back(x);
+	}
+
+	return read_model_positions() == expected;
+}
+
+
+// statistics of blocks of rows that are merged are the same as adding every row to one
+bool merge_stats_test()
+{
+	size_t const width = 5;
+
+	std::mt19937 gen(7);
+	std::uniform_int_distribution<cluster::data_t> pixel;
+
+	cluster::data_row_list_t x_list(100, cluster::data_row_t(width));
+	for (auto& row : x_list)
+	{
+		std::generate(row.begin(), row.end(), [&]() { return pixel(gen); });
+	}
+
+	cluster::column_stats_t single(width);
+	for (auto const& row : x_list)
+	{
+		cluster::update_stats(single, row);
+	}
+
+	// blocks of different sizes, one of them empty
+	cluster::index_list_t const block_ends = { 1, 1, 40, 100 };
+
+	cluster::column_stats_t merged(width);
+	size_t begin = 0;
+
+	for (auto const end : block_ends)
+	{
+		cluster::column_stats_t block(width);
+		for (auto i = begin; i < end; ++i)
+		{
+			cluster::update_stats(block, x_list[i]);
+		}
+
+		cluster::merge_stats(merged, block);
+		begin = end;
+	}
+
+	auto const range = cluster::MODEL_VALUE_MAX - cluster::MODEL_VALUE_MIN;
+
+	for (size_t x = 0; x < width; ++x)
+	{
+		auto const& lhs = single[x];
+		auto const& rhs = merged[x];
+
+		if (lhs.count != x_list.size() || rhs.count != lhs.count)
+			return false;
+
+		if (std::abs(lhs.mean - rhs.mean) > 1e-9 * range || std::abs(lhs.m2 - rhs.m2) > 1e-9 * lhs.m2)
+			return false;
+	}
+
+	return true;
+}
+
+
+// centroids closer than the merge distance are replaced by one centroid at the mean of their data
+bool merge_centroids_test()
+{
+	size_t const blob_size = 10;
+
+	auto const x_list = make_blobs(2, blob_size, 4);
+	cluster::weight_list_t const x_weights(x_list.size(), 1.0);
+
+	cluster::centroid_list_t blob_means(2, cluster::value_row_t(x_list[0].size(), 0.0));
+	for (size_t i = 0; i < x_list.size(); ++i)
+	{
+		for (size_t d = 0; d < x_list[i].size(); ++d)
+		{
+			blob_means[i / blob_size][d] += cluster::data_to_value(x_list[i][d]) / blob_size;
+		}
+	}
+
+	auto const range = cluster::MODEL_VALUE_MAX - cluster::MODEL_VALUE_MIN;
+
+	// two centroids on either side of the first blob
+	auto centroids = blob_means;
+	centroids.push_back(blob_means[0]);
+
+	for (auto& val : centroids[0])
+		val -= 0.01 * range;
+
+	for (auto& val : centroids[2])
+		val += 0.01 * range;
+
+	auto const cluster = make_test_cluster();
+
+	if (cluster.merge_centroids(x_list, x_weights, centroids, 0.0) != centroids)
+		return false;
+
+	if (!same_centroids(cluster.merge_centroids(x_list, x_weights, centroids, 0.05 * range), blob_means, 1e-9))
+		return false;
+
+	// a model lists how many centroids were merged
+	cluster::cluster_settings_t settings;
+	settings.attempts = 2;
+	settings.merge_distance = 1.0;
+
+	auto info = save_model_info(settings);
+
+	return info[gen::class_clusters_key(0)] == "1" && info[gen::class_clusters_key(1)] == "1" && info[gen::MERGED_CENTROIDS_KEY] == std::to_string(2 * settings.count - 2);
+}
+
+
+// more classes than MLClass has can be listed in a config file, each with its own number of clusters
+bool class_config_test()
+{
+	auto const width = data::feature_image_width();
+	cluster::index_list_t const class_counts = { 1, 2, 3 };
+
+	auto const data_dir = fs::temp_directory_path() / "class_config_test";
+	fs::remove_all(data_dir);
+	fs::create_directories(data_dir);
+
+	// each class is spread a little around its own value
+	size_t const class_size = 10;
+	auto const rows = make_blobs(class_counts.size(), class_size, width);
+
+	std::ofstream config(data_dir / "classes.txt");
+
+	for (size_t c = 0; c < class_counts.size(); ++c)
+	{
+		cluster::data_row_list_t const x_list(rows.begin() + c * class_size, rows.begin() + (c + 1) * class_size);
+
+		auto const class_dir = data_dir / std::to_string(c);
+		write_data_image(class_dir, x_list);
+
+		config << "CLASS_" << c << "_DATA = " << class_dir.string() << '\n';
+		config << gen::class_clusters_key(c) << " = " << class_counts[c] << '\n';
+	}
+
+	config.close();
+
+	cluster::cluster_settings_t settings;
+	settings.attempts = 2;
+
+	delete_files(model_root);
+
+	gen::ModelGenerator gen;
+	gen.read_class_config((data_dir / "classes.txt").string().c_str());
+	gen.set_cluster_settings(settings);
+
+	gen.save_model(model_root.c_str());
+
+	fs::remove_all(data_dir);
+
+	auto info = read_model_info();
+
+	for (size_t c = 0; c < class_counts.size(); ++c)
+	{
+		if (info[gen::class_clusters_key(c)] != std::to_string(class_counts[c]))
+			return false;
+	}
+
+	// a row for each centroid
+	img::image_t model;
+	img::read_image_from_file(dir::get_files_of_type(model_root, img_ext)[0], model);
+
+	return model.height == std::accumulate(class_counts.begin(), class_counts.end(), (size_t)0);
+}
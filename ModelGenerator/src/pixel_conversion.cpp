@@ -1,14 +1,13 @@
 #include "pixel_conversion.hpp"
+#include "../../utils/cluster_config.hpp"
 
 #include <cassert>
 
 
-constexpr auto BITS32_MAX = UINT32_MAX;
-
 constexpr u32 CHANNEL_3_MAX = 255 * 255 * 255;
 
-constexpr auto MODEL_VALUE_MIN = 0.0;
-constexpr auto MODEL_VALUE_MAX = (r64)CHANNEL_3_MAX;
+constexpr auto MODEL_VALUE_MIN = cluster::MODEL_VALUE_MIN;
+constexpr auto MODEL_VALUE_MAX = cluster::MODEL_VALUE_MAX;
 
 constexpr u8 PIXEL_ACTIVE = 255;
 constexpr u8 PIXEL_INACTIVE = 254;
@@ -23,9 +22,8 @@ namespace model_generator
 
 	r64 feature_pixel_to_model_value(data_pixel_t const& data_pix)
 	{
-		auto ratio = (r64)(data_pix.value) / BITS32_MAX;
-
-		return MODEL_VALUE_MIN + ratio * (MODEL_VALUE_MAX - MODEL_VALUE_MIN);
+		// same conversion that is used on the training data
+		return cluster::data_to_value(data_pix.value);
 	}
 
 
@@ -2,6 +2,8 @@
 
 #include "../../utils/libimage/libimage.hpp"
 
+#include <string>
+
 namespace img = libimage;
 
 /*
@@ -20,6 +22,77 @@ namespace model_generator
 
 	constexpr auto MODEL_FILE_EXTENSION = ".png";
 
+	// saved next to the model image with the same name
+	// lists the number of centroids of each class, e.g. CLASS_0_CLUSTERS = 4
+	// the rows of each class come first, in class order
+	constexpr auto MODEL_INFO_EXTENSION = ".txt";
+
+	inline std::string class_clusters_key(size_t class_index)
+	{
+		return "CLASS_" + std::to_string(class_index) + "_CLUSTERS";
+	}
+
+	// when centroids of the same class were merged after clustering, for information only
+	// MERGED_CENTROIDS = centroids removed
+	// ACCURACY_BEFORE_MERGE, ACCURACY_AFTER_MERGE = fraction of the training data closest to a centroid of its own class
+	constexpr auto MERGED_CENTROIDS_KEY = "MERGED_CENTROIDS";
+	constexpr auto ACCURACY_BEFORE_MERGE_KEY = "ACCURACY_BEFORE_MERGE";
+	constexpr auto ACCURACY_AFTER_MERGE_KEY = "ACCURACY_AFTER_MERGE";
+
+	// when the data is projected before clustering, the projected values are the first PROJECTION_DIMS positions of each row
+	// PROJECTION_DIMS = number of projected positions
+	// PROJECTION_VARIANCE = fraction of the variance of the training data that is kept
+	// PROJECTION_SCALE = multiplies the projected values before they are centered in the value range
+	// PROJECTION_INPUTS = data positions that are projected
+	// PROJECTION_MEAN = mean model value of each input
+	// PROJECTION_<d> = weight of each input for projected position d
+	constexpr auto PROJECTION_DIMS_KEY = "PROJECTION_DIMS";
+	constexpr auto PROJECTION_VARIANCE_KEY = "PROJECTION_VARIANCE";
+	constexpr auto PROJECTION_SCALE_KEY = "PROJECTION_SCALE";
+	constexpr auto PROJECTION_INPUTS_KEY = "PROJECTION_INPUTS";
+	constexpr auto PROJECTION_MEAN_KEY = "PROJECTION_MEAN";
+
+	inline std::string projection_component_key(size_t dim)
+	{
+		return "PROJECTION_" + std::to_string(dim);
+	}
+
+	// when the model is a centroid tree, the rows after the class centroids are the other nodes of the tree
+	// TREE_BEAM = nodes followed at each level when searching
+	// TREE_ROOTS = rows where a search starts
+	// NODE_<row> = rows of the children of a node
+	constexpr auto TREE_BEAM_KEY = "TREE_BEAM";
+	constexpr auto TREE_ROOTS_KEY = "TREE_ROOTS";
+
+	inline std::string tree_node_key(size_t row)
+	{
+		return "NODE_" + std::to_string(row);
+	}
+
+	// when the model has a product quantization index of the class centroids, its codebook is in the last rows
+	// PQ_SEARCH = 1 to use the index, 0 to compare every centroid
+	// PQ_RERANK = candidates from the index that are compared exactly
+	// PQ_RECALL = how often the index found the same centroid as an exact search of the training data
+	// PQ_FIRST_ROW = row of the first codeword
+	// PQ_CODEWORDS = number of codebook rows
+	// PQ_SUBSPACE_<m> = data positions of each subspace
+	// PQ_CODES_<row> = codeword of each subspace for a class centroid
+	constexpr auto PQ_SEARCH_KEY = "PQ_SEARCH";
+	constexpr auto PQ_RERANK_KEY = "PQ_RERANK";
+	constexpr auto PQ_RECALL_KEY = "PQ_RECALL";
+	constexpr auto PQ_FIRST_ROW_KEY = "PQ_FIRST_ROW";
+	constexpr auto PQ_CODEWORDS_KEY = "PQ_CODEWORDS";
+
+	inline std::string pq_subspace_key(size_t subspace)
+	{
+		return "PQ_SUBSPACE_" + std::to_string(subspace);
+	}
+
+	inline std::string pq_codes_key(size_t row)
+	{
+		return "PQ_CODES_" + std::to_string(row);
+	}
+
 
 	// is this a value that contributes to the clusters
 	bool is_relevant(r64 val);
@@ -1,4 +1,5 @@
 #include "cluster_config.hpp"
+#include "config_reader.hpp"
 
 #include <cstdlib>
 #include <algorithm>
@@ -7,11 +8,17 @@
 #include <iostream>
 #include <functional>
 #include <cassert>
+#include <cmath>
+#include <array>
+#include <numeric>
+#include <limits>
 
 namespace cluster
 {
 	//======= TYPES ===================
 
+	using steady_clock_t = std::chrono::steady_clock;
+
 	typedef struct ClusterCount // used for tracking the number of times a given result is found
 	{
 		cluster_result_t result;
@@ -21,19 +28,19 @@ namespace cluster
 
 	using closest_t = std::function<distance_result_t(data_row_t const& data, centroid_list_t const& value_list)>;
 
-	using cluster_once_t = std::function<cluster_result_t(data_row_list_t const& x_list, size_t num_clusters)>;
+	using cluster_once_t = std::function<cluster_result_t(data_row_list_t const& x_list, weight_list_t const& x_weights, size_t num_clusters)>;
 
 	
 	//======= HELPERS ====================
 
-	static size_t max_value(index_list_t const& list)
+	static std::mt19937& random_engine()
 	{
-		assert(list.size());
+		thread_local std::mt19937 gen{ std::random_device{}() };
 
-		return *std::max_element(list.begin(), list.end());
+		return gen;
 	}
 
-	
+
 	static value_row_list_t to_value_row_list(data_row_list_t const& data_row_list)
 	{
 		// convert a list of data_row_t to value_row_t
@@ -41,7 +48,7 @@ namespace cluster
 		auto list = make_value_row_list(data_row_list.size(), data_row_list[0].size());
 		for (size_t i = 0; i < data_row_list.size(); ++i)
 		{
-			auto data_row = data_row_list[i];
+			auto const& data_row = data_row_list[i];
 			for (size_t j = 0; j < data_row.size(); ++j)
 				list[i][j] = data_to_value(data_row[j]);
 		}
@@ -50,74 +57,158 @@ namespace cluster
 	}
 
 	
-	static centroid_list_t random_values(data_row_list_t const& x_list, size_t num_clusters)
+	static centroid_list_t random_values(data_row_list_t const& x_list, weight_list_t const& x_weights, size_t num_clusters)
 	{
 		// selects random data to be used as centroids
-		// C++ 17 std::sample
+		// weighted sampling without replacement, each row is picked in proportion to its weight
+		// key = u^(1/w), the rows with the largest keys are selected
+
+		assert(!x_list.empty());
+
+		auto& gen = random_engine();
+		std::uniform_real_distribution<r64> dist(0.0, 1.0);
+
+		std::vector<std::pair<r64, size_t>> keys;
+		keys.reserve(x_list.size());
+
+		for (size_t i = 0; i < x_list.size(); ++i)
+		{
+			keys.push_back({ std::pow(dist(gen), 1.0 / x_weights[i]), i });
+		}
+
+		auto const n_unique = std::min(num_clusters, keys.size());
+		auto const greater = [](auto const& lhs, auto const& rhs) { return lhs.first > rhs.first; };
+		std::partial_sort(keys.begin(), keys.begin() + n_unique, keys.end(), greater);
 
 		data_row_list_t samples;
 		samples.reserve(num_clusters);
 
-		std::sample(x_list.begin(), x_list.end(), std::back_inserter(samples),
-			num_clusters, std::mt19937{ std::random_device{}() });
+		// rows are repeated if there are not enough of them, as would happen with duplicate rows
+		for (size_t i = 0; i < num_clusters; ++i)
+		{
+			samples.push_back(x_list[keys[i % n_unique].second]);
+		}
 
 		return to_value_row_list(samples);
 	}		
 
 	
-	static cluster_result_t assign_clusters(data_row_list_t const& x_list, centroid_list_t& centroids, closest_t const& closest)
+	static size_t assign_clusters(data_row_list_t const& x_list, weight_list_t const& x_weights, centroid_list_t& centroids, closest_t const& closest, cluster_result_t& result, value_row_t& x_distances)
 	{
 		// assigns a cluster index to each data point
+		// returns the number of data points that changed clusters
 
-		index_list_t x_clusters;
-		x_clusters.reserve(x_list.size());
+		auto& x_clusters = result.x_clusters;
+		assert(x_clusters.size() == x_list.size());
 
+		size_t changes = 0;
 		r64 total_distance = 0;
+		r64 total_weight = 0;
 
-		for (auto const& x_data : x_list)
+		for (size_t i = 0; i < x_list.size(); ++i)
 		{
-			auto c = closest(x_data, centroids);
+			auto c = closest(x_list[i], centroids);
 
-			x_clusters.push_back(c.index);
-			total_distance += c.distance;
+			changes += c.index != x_clusters[i];
+
+			x_clusters[i] = c.index;
+			x_distances[i] = c.distance;
+			total_distance += x_weights[i] * c.distance;
+			total_weight += x_weights[i];
 		}
 
-		cluster_result_t res = { std::move(x_clusters), std::move(centroids), total_distance / x_list.size() };
-		return res;
+		result.centroids = std::move(centroids);
+		result.average_distance = total_distance / total_weight;
+
+		return changes;
 	}
 
 	
-	static centroid_list_t calc_centroids(data_row_list_t const& x_list, index_list_t const& x_clusters, size_t num_clusters)
+	static centroid_list_t calc_centroids(data_row_list_t const& x_list, weight_list_t const& x_weights, index_list_t const& x_clusters, value_row_t& x_distances, size_t num_clusters)
 	{
-		// finds new centroids based on the averages of data clustered together
+		// finds new centroids based on the weighted averages of data clustered together
+		// a cluster with no data restarts at the data point farthest from its centroid
 
 		const auto data_size = x_list[0].size();
 		auto values = make_value_row_list(num_clusters, data_size);		
 		
-		std::vector<unsigned> counts(num_clusters, 0);
+		std::vector<r64> counts(num_clusters, 0);
 
 		for (size_t i = 0; i < x_list.size(); ++i)
 		{
 			const auto cluster_index = x_clusters[i];
-			++counts[cluster_index];
+			const auto weight = x_weights[i];
+			counts[cluster_index] += weight;
+
+			auto& totals = values[cluster_index];
 
 			for (size_t d = 0; d < data_size; ++d)
-				values[cluster_index][d] += data_to_value(x_list[i][d]); // totals for each cluster
+				totals[d] += weight * data_to_value(x_list[i][d]); // totals for each cluster
 		}
 
 		for (size_t k = 0; k < num_clusters; ++k)
 		{
+			if (counts[k] > 0)
+			{
+				for (size_t d = 0; d < data_size; ++d)
+					values[k][d] = values[k][d] / counts[k]; // convert to average
+
+				continue;
+			}
+
+			const auto far = std::max_element(x_distances.begin(), x_distances.end()) - x_distances.begin();
+			x_distances[far] = 0; // only used for one cluster
+
 			for (size_t d = 0; d < data_size; ++d)
-				values[k][d] = values[k][d] / counts[k]; // convert to average
+				values[k][d] = data_to_value(x_list[far][d]);
 		}
 
 		return values;
 	}
 
+
+	static r64 max_shift(centroid_list_t const& lhs, centroid_list_t const& rhs)
+	{
+		// largest root mean square change of a centroid as a fraction of the value range
+
+		r64 max = 0;
+
+		for (size_t k = 0; k < lhs.size(); ++k)
+		{
+			max = std::max(max, list_distance(lhs[k], rhs[k]));
+		}
+
+		return std::sqrt(max) / (MODEL_VALUE_MAX - MODEL_VALUE_MIN);
+	}
+
+	
+	static value_row_t weighted_mean(data_row_list_t const& x_list, weight_list_t const& x_weights)
+	{
+		const auto data_size = x_list[0].size();
+		auto mean = make_value_row(data_size);
+
+		r64 total_weight = 0;
+
+		for (size_t i = 0; i < x_list.size(); ++i)
+		{
+			const auto weight = x_weights[i];
+			total_weight += weight;
+
+			for (size_t d = 0; d < data_size; ++d)
+				mean[d] += weight * data_to_value(x_list[i][d]);
+		}
+
+		for (size_t d = 0; d < data_size; ++d)
+			mean[d] /= total_weight;
+
+		return mean;
+	}
+
 	
 	static void relabel_clusters(cluster_result_t& result, size_t num_clusters)
 	{
-		// re-label cluster assignments so that they are consistent accross iterations
+		// re-label cluster assignments so that they are consistent accross results
+		// centroids are reordered to match
 
 		std::vector<uint8_t> flags(num_clusters, 0); // tracks if cluster index has been mapped
 		std::vector<size_t> map(num_clusters, 0);    // maps old cluster index to new cluster index
@@ -147,32 +238,144 @@ namespace cluster
 			++label;
 		}
 
+		// clusters without data go last
+		for (size_t c = 0; c < num_clusters; ++c)
+		{
+			if (!flags[c])
+				map[c] = label++;
+		}
+
 		// re-label cluster assignments
 		for (i = 0; i < result.x_clusters.size(); ++i)
 		{
 			size_t c = result.x_clusters[i];
 			result.x_clusters[i] = map[c];
 		}
+
+		centroid_list_t centroids(result.centroids.size());
+		for (size_t c = 0; c < result.centroids.size(); ++c)
+		{
+			centroids[map[c]] = std::move(result.centroids[c]);
+		}
+
+		result.centroids = std::move(centroids);
+	}
+
+
+	//======= PRODUCT QUANTIZATION ==========================
+
+
+	static r64 subspace_distance(value_row_t const& lhs, value_row_t const& rhs, index_list_t const& dims)
+	{
+		r64 total = 0;
+
+		for (auto const d : dims)
+			total += std::abs(lhs[d] - rhs[d]);
+
+		return total;
+	}
+
+
+	static centroid_list_t quantize_subspace(centroid_list_t const& values, index_list_t const& dims, size_t n_codewords, size_t max_iterations, std::vector<uint8_t>& codes)
+	{
+		// k-means of the values in one subspace, for up to max_iterations
+		// codes gets the index of the codeword closest to each value
+
+		const auto n_values = values.size();
+		const auto row_size = values[0].size();
+
+		// spread starting codewords evenly over the values
+		centroid_list_t codewords;
+		codewords.reserve(n_codewords);
+
+		for (size_t k = 0; k < n_codewords; ++k)
+			codewords.push_back(values[k * n_values / n_codewords]);
+
+		codes.assign(n_values, 0);
+
+		for (size_t iter = 0; iter < max_iterations; ++iter)
+		{
+			size_t changes = 0;
+
+			for (size_t i = 0; i < n_values; ++i)
+			{
+				uint8_t best = 0;
+				auto best_dist = subspace_distance(values[i], codewords[0], dims);
+
+				for (size_t k = 1; k < n_codewords; ++k)
+				{
+					auto const dist = subspace_distance(values[i], codewords[k], dims);
+					if (dist < best_dist)
+					{
+						best_dist = dist;
+						best = (uint8_t)k;
+					}
+				}
+
+				changes += best != codes[i];
+				codes[i] = best;
+			}
+
+			if (iter > 0 && !changes)
+				break;
+
+			auto sums = make_value_row_list(n_codewords, row_size);
+			std::vector<size_t> counts(n_codewords, 0);
+
+			for (size_t i = 0; i < n_values; ++i)
+			{
+				++counts[codes[i]];
+
+				for (auto const d : dims)
+					sums[codes[i]][d] += values[i][d];
+			}
+
+			// a codeword without values keeps its position
+			for (size_t k = 0; k < n_codewords; ++k)
+			{
+				if (!counts[k])
+					continue;
+
+				for (auto const d : dims)
+					codewords[k][d] = sums[k][d] / counts[k];
+			}
+		}
+
+		return codewords;
 	}
 
 
 	//======= CLUSTERING ALGORITHMS ==========================
 	
 	
-	static cluster_result_t cluster_min_distance(data_row_list_t const& x_list, size_t num_clusters, cluster_once_t const& cluster_once)
+	static cluster_result_t cluster_min_distance(data_row_list_t const& x_list, weight_list_t const& x_weights, size_t num_clusters, cluster_once_t const& cluster_once, size_t attempts, std::function<bool()> const& out_of_time, cluster_stats_t& stats)
 	{
 		// returns the result with the smallest distance
+		// the best result so far is returned when time runs out
 
-		auto result = cluster_once(x_list, num_clusters);
-		auto min = result;
+		auto min = cluster_once(x_list, x_weights, num_clusters);
+		stats.iterations = min.iterations;
+		stats.attempts = 1;
 
-		for (size_t i = 0; i < CLUSTER_ATTEMPTS; ++i)
+		for (size_t i = 0; i < attempts; ++i)
 		{
-			result = cluster_once(x_list, num_clusters);
+			if (out_of_time())
+			{
+				stats.out_of_time = true;
+				break;
+			}
+
+			auto result = cluster_once(x_list, x_weights, num_clusters);
+			stats.iterations += result.iterations;
+			++stats.attempts;
+
 			if (result.average_distance < min.average_distance)
 				min = std::move(result);
 		}
 
+		stats.best_iterations = min.iterations;
+		stats.average_distance = min.average_distance;
+
 		return min;
 	}
 	
@@ -180,17 +383,17 @@ namespace cluster
 
 	// returns the most popular result
 	// stops when the same result has been found for more than half of the attempts
-	static cluster_result_t cluster_max_count(data_row_list_t const& x_list, size_t num_clusters, cluster_once_t const& cluster_once)
+	static cluster_result_t cluster_max_count(data_row_list_t const& x_list, weight_list_t const& x_weights, size_t num_clusters, cluster_once_t const& cluster_once)
 	{
 		std::vector<cluster_count_t> counts;
 		counts.reserve(CLUSTER_ATTEMPTS);
 
-		auto result = cluster_once(x_list, num_clusters);
+		auto result = cluster_once(x_list, x_weights, num_clusters);
 		counts.push_back({ std::move(result), 1 });
 
 		for (size_t i = 0; i < CLUSTER_ATTEMPTS; ++i)
 		{
-			result = cluster_once(x_list, num_clusters);
+			result = cluster_once(x_list, x_weights, num_clusters);
 
 			bool add_clusters = true;
 			for (auto& c : counts)
@@ -221,75 +424,1120 @@ namespace cluster
 	*/
 
 
-	//======= CLASS METHODS ==============================
+	//======= SETTINGS ==============================
 
-	distance_result_t Cluster::closest(data_row_t const& data, centroid_list_t const& value_list) const
+	cluster_settings_t read_cluster_settings(const char* config_file)
 	{
-		distance_result_t res = { 0, m_dist_func(data, value_list[0]) };
+		cluster_settings_t settings;
 
-		for (size_t i = 1; i < value_list.size(); ++i)
+		auto config = config_reader::read_config(config_file);
+
+		const auto read_size = [&](const char* key, size_t& value, size_t min_value)
 		{
-			auto dist = m_dist_func(data, value_list[i]);
-			if (dist < res.distance)
+			auto const& str = config[key];
+			char* end = nullptr;
+			auto const val = std::strtoull(str.c_str(), &end, 10);
+			if (end != str.c_str() && val >= min_value)
+				value = (size_t)val;
+		};
+
+		const auto read_r64 = [&](const char* key, r64& value)
+		{
+			auto const& str = config[key];
+			char* end = nullptr;
+			auto const val = std::strtod(str.c_str(), &end);
+			if (end != str.c_str() && val >= 0)
+				value = val;
+		};
+
+		read_size("CLUSTER_ATTEMPTS", settings.attempts, 1);
+		read_size("CLUSTER_ITERATIONS", settings.iterations, 1);
+		read_size("CLUSTER_COUNT", settings.count, 1);
+
+		// the count is fixed unless a minimum is given
+		settings.min_count = settings.count;
+		read_size("CLUSTER_MIN_COUNT", settings.min_count, 1);
+		read_r64("CLUSTER_QUALITY", settings.quality);
+		read_r64("CLUSTER_TIME_LIMIT", settings.time_limit);
+		read_size("CLUSTER_TREE_BEAM", settings.tree_beam, 0);
+		read_size("CLUSTER_PQ_SUBSPACES", settings.pq_subspaces, 0);
+		read_size("CLUSTER_PQ_RERANK", settings.pq_rerank, 1);
+		read_size("CLUSTER_PQ_CODEWORDS", settings.pq_codewords, 1);
+		read_size("CLUSTER_PROJECTION_DIMS", settings.projection_dims, 0);
+		read_size("CLUSTER_POSITION_BUDGET", settings.position_budget, 0);
+		read_r64("CLUSTER_MERGE_DISTANCE", settings.merge_distance);
+		read_size("CLUSTER_CORESET_SIZE", settings.coreset_size, 0);
+		read_r64("CLUSTER_CORESET_ERROR", settings.coreset_error);
+		read_size("CLUSTER_MAX_CHANGES", settings.max_changes, 0);
+		read_r64("CLUSTER_SHIFT_TOLERANCE", settings.shift_tolerance);
+
+		return settings;
+	}
+
+
+	//======= STATISTICS ==============================
+
+	void update_stats(column_stats_t& stats, data_row_t const& data)
+	{
+		assert(stats.size() == data.size());
+
+		for (size_t column = 0; column < data.size(); ++column)
+		{
+			auto& col = stats[column];
+			auto const value = data_to_value(data[column]);
+
+			++col.count;
+			auto const delta = value - col.mean;
+			col.mean += delta / col.count;
+			col.m2 += delta * (value - col.mean);
+		}
+	}
+
+
+	void merge_stats(column_stats_t& dst, column_stats_t const& src)
+	{
+		assert(dst.size() == src.size());
+
+		for (size_t column = 0; column < dst.size(); ++column)
+		{
+			auto& lhs = dst[column];
+			auto const& rhs = src[column];
+
+			if (rhs.count == 0)
 			{
-				res.distance = dist;
-				res.index = i;
+				continue;
 			}
-		}
 
-		return res;
+			auto const count = lhs.count + rhs.count;
+			auto const delta = rhs.mean - lhs.mean;
+
+			lhs.mean += delta * rhs.count / count;
+			lhs.m2 += rhs.m2 + delta * delta * lhs.count * rhs.count / count;
+			lhs.count = count;
+		}
 	}
 
 
+	//======= PROJECTION ==============================
 
-	size_t Cluster::find_centroid(data_row_t const& data, centroid_list_t const& centroids) const
+	static void symmetric_eigen(value_row_t& matrix, size_t n, value_row_t& values)
 	{
-		auto result = closest(data, centroids);
+		// eigenvalues and eigenvectors of a symmetric n x n matrix, row major
+		// the matrix is replaced by the eigenvectors as its columns
+		// Householder reduction to tridiagonal form, then the QL method, as in EISPACK tred2 and tql2
 
-		return result.index;
+		auto const at = [&](size_t row, size_t col) -> r64& { return matrix[row * n + col]; };
+
+		auto& d = values;
+		value_row_t e(n, 0.0);
+		d.assign(n, 0.0);
+
+		if (n == 0)
+		{
+			return;
+		}
+
+		for (size_t j = 0; j < n; ++j)
+		{
+			d[j] = at(n - 1, j);
+		}
+
+		// reduce to tridiagonal form
+		for (size_t i = n - 1; i > 0; --i)
+		{
+			r64 scale = 0.0;
+			r64 h = 0.0;
+			for (size_t k = 0; k < i; ++k)
+			{
+				scale += std::abs(d[k]);
+			}
+
+			if (scale == 0.0)
+			{
+				e[i] = d[i - 1];
+				for (size_t j = 0; j < i; ++j)
+				{
+					d[j] = at(i - 1, j);
+					at(i, j) = 0.0;
+					at(j, i) = 0.0;
+				}
+
+				d[i] = h;
+				continue;
+			}
+
+			for (size_t k = 0; k < i; ++k)
+			{
+				d[k] /= scale;
+				h += d[k] * d[k];
+			}
+
+			auto f = d[i - 1];
+			auto g = f > 0 ? -std::sqrt(h) : std::sqrt(h);
+			e[i] = scale * g;
+			h -= f * g;
+			d[i - 1] = f - g;
+
+			for (size_t j = 0; j < i; ++j)
+			{
+				e[j] = 0.0;
+			}
+
+			for (size_t j = 0; j < i; ++j)
+			{
+				f = d[j];
+				at(j, i) = f;
+				g = e[j] + at(j, j) * f;
+				for (size_t k = j + 1; k < i; ++k)
+				{
+					g += at(k, j) * d[k];
+					e[k] += at(k, j) * f;
+				}
+				e[j] = g;
+			}
+
+			f = 0.0;
+			for (size_t j = 0; j < i; ++j)
+			{
+				e[j] /= h;
+				f += e[j] * d[j];
+			}
+
+			auto const hh = f / (h + h);
+			for (size_t j = 0; j < i; ++j)
+			{
+				e[j] -= hh * d[j];
+			}
+
+			for (size_t j = 0; j < i; ++j)
+			{
+				f = d[j];
+				g = e[j];
+				for (size_t k = j; k < i; ++k)
+				{
+					at(k, j) -= f * e[k] + g * d[k];
+				}
+				d[j] = at(i - 1, j);
+				at(i, j) = 0.0;
+			}
+
+			d[i] = h;
+		}
+
+		// accumulate the transformations
+		for (size_t i = 0; i + 1 < n; ++i)
+		{
+			at(n - 1, i) = at(i, i);
+			at(i, i) = 1.0;
+
+			auto const h = d[i + 1];
+			if (h != 0.0)
+			{
+				for (size_t k = 0; k <= i; ++k)
+				{
+					d[k] = at(k, i + 1) / h;
+				}
+
+				for (size_t j = 0; j <= i; ++j)
+				{
+					r64 g = 0.0;
+					for (size_t k = 0; k <= i; ++k)
+					{
+						g += at(k, i + 1) * at(k, j);
+					}
+					for (size_t k = 0; k <= i; ++k)
+					{
+						at(k, j) -= g * d[k];
+					}
+				}
+			}
+
+			for (size_t k = 0; k <= i; ++k)
+			{
+				at(k, i + 1) = 0.0;
+			}
+		}
+
+		for (size_t j = 0; j < n; ++j)
+		{
+			d[j] = at(n - 1, j);
+			at(n - 1, j) = 0.0;
+		}
+
+		at(n - 1, n - 1) = 1.0;
+
+		// diagonalize the tridiagonal matrix
+		for (size_t i = 1; i < n; ++i)
+		{
+			e[i - 1] = e[i];
+		}
+		e[n - 1] = 0.0;
+
+		constexpr auto eps = std::numeric_limits<r64>::epsilon();
+		constexpr size_t max_iterations = 100;
+
+		r64 f = 0.0;
+		r64 tst1 = 0.0;
+
+		for (size_t l = 0; l < n; ++l)
+		{
+			tst1 = std::max(tst1, std::abs(d[l]) + std::abs(e[l]));
+
+			auto m = l;
+			while (m < n - 1 && std::abs(e[m]) > eps * tst1)
+			{
+				++m;
+			}
+
+			for (size_t iter = 0; m > l && iter < max_iterations && std::abs(e[l]) > eps * tst1; ++iter)
+			{
+				auto g = d[l];
+				auto p = (d[l + 1] - g) / (2.0 * e[l]);
+				auto r = std::hypot(p, 1.0);
+				if (p < 0)
+				{
+					r = -r;
+				}
+
+				d[l] = e[l] / (p + r);
+				d[l + 1] = e[l] * (p + r);
+
+				auto const dl1 = d[l + 1];
+				auto h = g - d[l];
+				for (auto i = l + 2; i < n; ++i)
+				{
+					d[i] -= h;
+				}
+				f += h;
+
+				p = d[m];
+				r64 c = 1.0;
+				r64 c2 = c;
+				r64 c3 = c;
+				auto const el1 = e[l + 1];
+				r64 s = 0.0;
+				r64 s2 = 0.0;
+
+				for (auto i = m; i-- > l;)
+				{
+					c3 = c2;
+					c2 = c;
+					s2 = s;
+					g = c * e[i];
+					h = c * p;
+					r = std::hypot(p, e[i]);
+					e[i + 1] = s * r;
+					s = e[i] / r;
+					c = p / r;
+					p = c * d[i] - s * g;
+					d[i + 1] = h + s * (c * g + s * d[i]);
+
+					for (size_t k = 0; k < n; ++k)
+					{
+						h = at(k, i + 1);
+						at(k, i + 1) = s * at(k, i) + c * h;
+						at(k, i) = c * at(k, i) - s * h;
+					}
+				}
+
+				p = -s * s2 * c3 * el1 * e[l] / dl1;
+				e[l] = s * p;
+				d[l] = c * p;
+			}
+
+			d[l] += f;
+			e[l] = 0.0;
+		}
 	}
 
 
-	cluster_result_t Cluster::cluster_once(data_row_list_t const& x_list, size_t num_clusters) const
+	void update_covariance(covariance_t& cov, data_row_t const& data, r64 weight)
 	{
-		const auto closest_f = [&](data_row_t const& data, centroid_list_t const& value_list) // TODO: why?
+		// Welford's update with weights, stable for any number of rows
+
+		auto const& inputs = cov.inputs;
+		auto const n = inputs.size();
+
+		if (cov.weight == 0)
 		{
-			return closest(data, value_list);
-		};
+			cov.mean.assign(n, 0.0);
+			cov.comoments.assign(n * n, 0.0);
+		}
 
-		auto centroids = random_values(x_list, num_clusters); // start with random centroids
-		auto result = assign_clusters(x_list, centroids, closest_f);
-		relabel_clusters(result, num_clusters);
+		assert(cov.mean.size() == n);
 
-		for (size_t i = 0; i < CLUSTER_ITERATIONS; ++i)
+		if (weight <= 0)
 		{
-			centroids = calc_centroids(x_list, result.x_clusters, num_clusters);
-			auto res_try = assign_clusters(x_list, centroids, closest_f);
+			return;
+		}
 
-			if (max_value(res_try.x_clusters) < num_clusters - 1)
-				continue;
+		cov.weight += weight;
 
-			auto res_old = std::move(result);
-			result = std::move(res_try);
-			relabel_clusters(result, num_clusters);
+		thread_local value_row_t before;
+		thread_local value_row_t after;
+		before.resize(n);
+		after.resize(n);
 
-			if (list_distance(res_old.x_clusters, result.x_clusters) == 0)
-				return result;
+		for (size_t i = 0; i < n; ++i)
+		{
+			auto const value = data_to_value(data[inputs[i]]);
+			before[i] = value - cov.mean[i];
+			cov.mean[i] += before[i] * weight / cov.weight;
+			after[i] = value - cov.mean[i];
 		}
 
-		return result;
+		// only the upper triangle is kept up to date
+		for (size_t i = 0; i < n; ++i)
+		{
+			auto row = cov.comoments.data() + i * n;
+			auto const w_before = weight * before[i];
+			for (size_t j = i; j < n; ++j)
+			{
+				row[j] += w_before * after[j];
+			}
+		}
 	}
 
 
-	centroid_list_t Cluster::cluster_data(data_row_list_t const& x_list, size_t num_clusters) const
+	void merge_covariance(covariance_t& dst, covariance_t const& src)
 	{
-		// wrap member function in a lambda to pass it to algorithm
-		const auto cluster_once_f = [&](data_row_list_t const& x_list, size_t num_clusters) // TODO: why?
+		if (src.weight == 0)
 		{
-			return cluster_once(x_list, num_clusters);
-		};
+			return;
+		}
+
+		if (dst.weight == 0)
+		{
+			dst = src;
+			return;
+		}
+
+		assert(src.inputs == dst.inputs);
+
+		auto const n = dst.inputs.size();
+
+		auto const total = dst.weight + src.weight;
+		auto const weight = dst.weight * src.weight / total;
+
+		value_row_t delta(n);
+		for (size_t i = 0; i < n; ++i)
+		{
+			delta[i] = src.mean[i] - dst.mean[i];
+		}
+
+		for (size_t i = 0; i < n; ++i)
+		{
+			auto row = dst.comoments.data() + i * n;
+			auto src_row = src.comoments.data() + i * n;
+			for (size_t j = i; j < n; ++j)
+			{
+				row[j] += src_row[j] + delta[i] * delta[j] * weight;
+			}
+		}
+
+		for (size_t i = 0; i < n; ++i)
+		{
+			dst.mean[i] += delta[i] * src.weight / total;
+		}
+
+		dst.weight = total;
+	}
+
+
+	projection_t make_projection(covariance_t const& cov, size_t n_dims)
+	{
+		auto const n = cov.inputs.size();
+		n_dims = std::min(n_dims, n);
+
+		projection_t projection;
+		projection.inputs = cov.inputs;
+
+		if (!n_dims || cov.weight == 0)
+		{
+			return projection;
+		}
+
+		projection.mean = cov.mean;
+
+		value_row_t matrix(n * n);
+		r64 total_variance = 0.0;
+
+		for (size_t i = 0; i < n; ++i)
+		{
+			for (size_t j = 0; j < n; ++j)
+			{
+				auto const lo = std::min(i, j);
+				auto const hi = std::max(i, j);
+				matrix[i * n + j] = cov.comoments[lo * n + hi] / cov.weight;
+			}
+
+			total_variance += matrix[i * n + i];
+		}
+
+		// the columns of matrix become the eigenvectors
+		value_row_t variances;
+		symmetric_eigen(matrix, n, variances);
+
+		index_list_t order(n);
+		std::iota(order.begin(), order.end(), 0);
+		std::sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) { return variances[lhs] > variances[rhs]; });
+
+		r64 kept_variance = 0.0;
+		r64 max_weight = 0.0;
+
+		for (size_t d = 0; d < n_dims; ++d)
+		{
+			auto const col = order[d];
+			kept_variance += variances[col];
+
+			value_row_t component(n);
+			r64 weight = 0.0;
+			for (size_t i = 0; i < n; ++i)
+			{
+				component[i] = matrix[i * n + col];
+				weight += std::abs(component[i]);
+			}
+
+			max_weight = std::max(max_weight, weight);
+			projection.components.push_back(std::move(component));
+		}
+
+		// no input is further than the value range from its mean
+		// so no projected value is further than max_weight times the range from 0
+		projection.scale = 0.5 / max_weight;
+		projection.variance = total_variance > 0 ? kept_variance / total_variance : 1.0;
+
+		return projection;
+	}
+
+
+	data_row_t project_row(data_row_t const& data, projection_t const& projection)
+	{
+		auto const& inputs = projection.inputs;
+		auto const n = inputs.size();
+
+		thread_local value_row_t centered;
+		centered.resize(n);
+
+		for (size_t i = 0; i < n; ++i)
+		{
+			centered[i] = data_to_value(data[inputs[i]]) - projection.mean[i];
+		}
+
+		constexpr auto value_mid = (MODEL_VALUE_MIN + MODEL_VALUE_MAX) / 2;
+
+		data_row_t projected;
+		projected.reserve(projection.components.size());
+
+		for (auto const& component : projection.components)
+		{
+			auto const value = std::inner_product(centered.begin(), centered.end(), component.begin(), 0.0);
+
+			projected.push_back(value_to_data(value_mid + projection.scale * value));
+		}
+
+		return projected;
+	}
+
+
+	//======= CLASS METHODS ==============================
+
+	Cluster::Cluster() 
+		: m_dist_func([](data_row_t const&, value_row_t const&) { return 0.0; })
+	{}
+
+
+	void Cluster::start_timer()
+	{
+		if (m_settings.time_limit > 0)
+		{
+			const auto limit = std::chrono::duration<r64>(m_settings.time_limit);
+			m_deadline = steady_clock_t::now() + std::chrono::duration_cast<steady_clock_t::duration>(limit);
+		}
+	}
+
+
+	bool Cluster::out_of_time() const
+	{
+		return m_settings.time_limit > 0 && steady_clock_t::now() >= m_deadline;
+	}
+
+
+	distance_result_t Cluster::closest(data_row_t const& data, centroid_list_t const& value_list) const
+	{
+		distance_result_t res = { 0, m_dist_func(data, value_list[0]) };
+
+		for (size_t i = 1; i < value_list.size(); ++i)
+		{
+			auto dist = m_dist_func(data, value_list[i]);
+			if (dist < res.distance)
+			{
+				res.distance = dist;
+				res.index = i;
+			}
+		}
+
+		return res;
+	}
+
+
+
+	size_t Cluster::find_centroid(data_row_t const& data, centroid_list_t const& centroids) const
+	{
+		auto result = closest(data, centroids);
+
+		return result.index;
+	}
+
+
+	size_t Cluster::find_centroid(data_row_t const& data, centroid_list_t const& centroids, product_quantizer_t const& pq, size_t n_rerank) const
+	{
+		assert(pq.codes.size() == centroids.size());
+
+		const auto n_subspaces = pq.subspaces.size();
+		const auto n_codewords = pq.codebook.size();
+
+		// distance from the data to every codeword in each subspace
+		std::vector<r64> table(n_subspaces * n_codewords, 0.0);
+
+		for (size_t m = 0; m < n_subspaces; ++m)
+		{
+			auto row = table.data() + m * n_codewords;
+
+			for (auto const d : pq.subspaces[m])
+			{
+				const auto value = data_to_value(data[d]);
+
+				for (size_t k = 0; k < n_codewords; ++k)
+					row[k] += std::abs(value - pq.codebook[k][d]);
+			}
+		}
+
+		// approximate distance to each centroid
+		std::vector<distance_result_t> candidates(centroids.size());
+
+		for (size_t i = 0; i < centroids.size(); ++i)
+		{
+			r64 total = 0;
+			auto const& code = pq.codes[i];
+
+			for (size_t m = 0; m < n_subspaces; ++m)
+				total += table[m * n_codewords + code[m]];
+
+			candidates[i] = { i, total };
+		}
+
+		// the best candidates are compared exactly
+		const auto by_distance = [](distance_result_t const& lhs, distance_result_t const& rhs) { return lhs.distance < rhs.distance; };
+
+		n_rerank = std::max(std::min(n_rerank, candidates.size()), (size_t)1);
+		std::partial_sort(candidates.begin(), candidates.begin() + n_rerank, candidates.end(), by_distance);
+
+		distance_result_t best = { candidates[0].index, m_dist_func(data, centroids[candidates[0].index]) };
+
+		for (size_t r = 1; r < n_rerank; ++r)
+		{
+			const auto index = candidates[r].index;
+			const auto dist = m_dist_func(data, centroids[index]);
+			if (dist < best.distance)
+			{
+				best = { index, dist };
+			}
+		}
+
+		return best.index;
+	}
+
+
+	product_quantizer_t Cluster::make_quantizer(centroid_list_t const& centroids, index_list_t const& dims, size_t n_subspaces) const
+	{
+		assert(!centroids.empty());
+		assert(!dims.empty());
+
+		n_subspaces = std::max(std::min(n_subspaces, dims.size()), (size_t)1);
+		const auto n_codewords = std::min({ m_settings.pq_codewords, PQ_MAX_CODEWORDS, centroids.size() });
+
+		product_quantizer_t pq;
+		pq.codebook = make_value_row_list(n_codewords, centroids[0].size());
+		pq.codes.assign(centroids.size(), std::vector<uint8_t>(n_subspaces, 0));
+
+		std::vector<uint8_t> codes;
+
+		for (size_t m = 0; m < n_subspaces; ++m)
+		{
+			// consecutive positions, as evenly as possible
+			const auto begin = dims.begin() + m * dims.size() / n_subspaces;
+			const auto end = dims.begin() + (m + 1) * dims.size() / n_subspaces;
+			pq.subspaces.emplace_back(begin, end);
+
+			auto const& subspace = pq.subspaces.back();
+			auto const codewords = quantize_subspace(centroids, subspace, n_codewords, m_settings.iterations, codes);
+
+			for (size_t k = 0; k < n_codewords; ++k)
+			{
+				for (auto const d : subspace)
+					pq.codebook[k][d] = codewords[k][d];
+			}
+
+			for (size_t i = 0; i < centroids.size(); ++i)
+				pq.codes[i][m] = codes[i];
+		}
+
+		return pq;
+	}
+
+
+	r64 Cluster::quantizer_recall(data_row_list_t const& x_list, centroid_list_t const& centroids, product_quantizer_t const& pq, size_t n_rerank) const
+	{
+		if (x_list.empty())
+			return 1.0;
+
+		size_t found = 0;
+
+		for (auto const& data : x_list)
+		{
+			found += find_centroid(data, centroids, pq, n_rerank) == find_centroid(data, centroids);
+		}
+
+		return (r64)found / x_list.size();
+	}
+
+
+	size_t Cluster::find_centroid(data_row_t const& data, centroid_tree_t const& tree, size_t beam_width) const
+	{
+		assert(!tree.roots.empty());
+		assert(beam_width > 0);
+
+		const auto by_distance = [](distance_result_t const& lhs, distance_result_t const& rhs) { return lhs.distance < rhs.distance; };
+
+		std::vector<distance_result_t> beam;
+		std::vector<distance_result_t> next;
+
+		for (auto const root : tree.roots)
+		{
+			next.push_back({ root, m_dist_func(data, tree.nodes[root].centroid) });
+		}
+
+		distance_result_t best = { tree.roots[0], std::numeric_limits<r64>::max() };
+
+		while (!next.empty())
+		{
+			// keep the closest nodes at this level
+			if (next.size() > beam_width)
+			{
+				std::partial_sort(next.begin(), next.begin() + beam_width, next.end(), by_distance);
+				next.resize(beam_width);
+			}
+
+			std::swap(beam, next);
+			next.clear();
+
+			for (auto const& node : beam)
+			{
+				auto const& children = tree.nodes[node.index].children;
+
+				if (children.empty() && node.distance < best.distance)
+				{
+					best = node;
+				}
+
+				for (auto const child : children)
+				{
+					next.push_back({ child, m_dist_func(data, tree.nodes[child].centroid) });
+				}
+			}
+		}
+
+		return best.index;
+	}
+
+
+	centroid_list_t Cluster::merge_centroids(data_row_list_t const& x_list, weight_list_t const& x_weights, centroid_list_t const& centroids, r64 max_distance) const
+	{
+		auto const n = centroids.size();
+
+		if (n < 2 || x_list.empty())
+		{
+			return centroids;
+		}
+
+		// centroids with more data are kept first
+		value_row_t cluster_weights(n, 0.0);
+		for (size_t i = 0; i < x_list.size(); ++i)
+		{
+			cluster_weights[closest(x_list[i], centroids).index] += x_weights[i];
+		}
+
+		index_list_t order(n);
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) { return cluster_weights[lhs] > cluster_weights[rhs]; });
+
+		// centroids are packed like data so that the distance function can compare them
+		data_row_list_t packed(n);
+		for (size_t k = 0; k < n; ++k)
+		{
+			std::transform(centroids[k].begin(), centroids[k].end(), std::back_inserter(packed[k]), value_to_data);
+		}
+
+		std::vector<uint8_t> is_merged(n, 0);
+		index_list_t kept;
+
+		for (size_t a = 0; a < n; ++a)
+		{
+			auto const keep = order[a];
+			if (is_merged[keep])
+			{
+				continue;
+			}
+
+			kept.push_back(keep);
+
+			for (size_t b = a + 1; b < n; ++b)
+			{
+				auto const other = order[b];
+				if (!is_merged[other] && m_dist_func(packed[other], centroids[keep]) < max_distance)
+				{
+					is_merged[other] = 1;
+				}
+			}
+		}
+
+		if (kept.size() == n)
+		{
+			return centroids;
+		}
+
+		// the centroids that are left keep their order
+		std::sort(kept.begin(), kept.end());
+
+		centroid_list_t merged;
+		merged.reserve(kept.size());
+		std::transform(kept.begin(), kept.end(), std::back_inserter(merged), [&](size_t k) { return centroids[k]; });
+
+		const auto closest_f = [this](data_row_t const& data, centroid_list_t const& value_list)
+		{
+			return closest(data, value_list);
+		};
+
+		cluster_result_t result;
+		result.x_clusters.assign(x_list.size(), kept.size());
+
+		value_row_t x_distances(x_list.size(), 0.0);
+
+		assign_clusters(x_list, x_weights, merged, closest_f, result, x_distances);
+
+		return calc_centroids(x_list, x_weights, result.x_clusters, x_distances, kept.size());
+	}
+
+
+	cluster_result_t Cluster::cluster_once(data_row_list_t const& x_list, weight_list_t const& x_weights, size_t num_clusters) const
+	{
+		// closest() is a member function, so it is wrapped to be passed to assign_clusters()
+		const auto closest_f = [this](data_row_t const& data, centroid_list_t const& value_list)
+		{
+			return closest(data, value_list);
+		};
+
+		cluster_result_t result;
+		result.x_clusters.assign(x_list.size(), num_clusters); // not in a cluster yet
+
+		// distance of each data point from its centroid
+		value_row_t x_distances(x_list.size(), 0.0);
+
+		auto centroids = random_values(x_list, x_weights, num_clusters); // start with random centroids
+		assign_clusters(x_list, x_weights, centroids, closest_f, result, x_distances);
+
+		while (result.iterations < m_settings.iterations && !out_of_time())
+		{
+			centroids = calc_centroids(x_list, x_weights, result.x_clusters, x_distances, num_clusters);
+			const auto shift = max_shift(result.centroids, centroids);
+
+			const auto changes = assign_clusters(x_list, x_weights, centroids, closest_f, result, x_distances);
+			++result.iterations;
+
+			if (changes <= m_settings.max_changes || shift <= m_settings.shift_tolerance)
+				break;
+		}
+
+		relabel_clusters(result, num_clusters);
+
+		return result;
+	}
+
+
+	void Cluster::reduce_to_coreset(data_row_list_t& x_list, weight_list_t& x_weights, size_t num_clusters) const
+	{
+		// lightweight coreset
+		// each row is sampled with probability q = 1/2 * w/W + 1/2 * w*d^2/sum(w*d^2)
+		// where d is the distance of the row from the mean of the data
+		// a sampled row gets weight w/(m*q) so that costs are unbiased
+
+		assert(x_weights.size() == x_list.size());
+
+		const auto max_size = m_settings.coreset_size;
+		const auto error = m_settings.coreset_error;
+
+		if (!max_size)
+		{
+			return;
+		}
+
+		const auto error_size = error > 0 ? (size_t)std::ceil(num_clusters / (error * error)) : max_size;
+		const auto size = std::min(max_size, std::max(error_size, num_clusters));
+
+		if (x_list.size() <= size)
+		{
+			return;
+		}
+
+		const auto mean = weighted_mean(x_list, x_weights);
+
+		std::vector<r64> dist_sq;
+		dist_sq.reserve(x_list.size());
+
+		r64 total_weight = 0;
+		r64 total_dist_sq = 0;
+
+		for (size_t i = 0; i < x_list.size(); ++i)
+		{
+			const auto dist = m_dist_func(x_list[i], mean);
+			dist_sq.push_back(x_weights[i] * dist * dist);
+
+			total_weight += x_weights[i];
+			total_dist_sq += dist_sq.back();
+		}
+
+		std::vector<r64> q(x_list.size());
+		for (size_t i = 0; i < x_list.size(); ++i)
+		{
+			q[i] = 0.5 * x_weights[i] / total_weight;
+			if (total_dist_sq > 0)
+			{
+				q[i] += 0.5 * dist_sq[i] / total_dist_sq;
+			}
+		}
+
+		// rows sampled more than once are kept once with the combined weight
+		std::vector<r64> sample_weights(x_list.size(), 0.0);
+
+		std::discrete_distribution<size_t> dist(q.begin(), q.end());
+		auto& gen = random_engine();
+
+		for (size_t s = 0; s < size; ++s)
+		{
+			const auto i = dist(gen);
+			sample_weights[i] += x_weights[i] / (size * q[i]);
+		}
+
+		// move the sampled rows to the front of the list
+		size_t n_sampled = 0;
+		for (size_t i = 0; i < x_list.size(); ++i)
+		{
+			if (sample_weights[i] == 0.0)
+			{
+				continue;
+			}
+
+			if (i != n_sampled)
+			{
+				x_list[n_sampled] = std::move(x_list[i]);
+			}
+
+			x_weights[n_sampled] = sample_weights[i];
+			++n_sampled;
+		}
+
+		x_list.resize(n_sampled);
+		x_list.shrink_to_fit();
+		x_weights.resize(n_sampled);
+		x_weights.shrink_to_fit();
+	}
+
+
+	centroid_tree_t Cluster::cluster_tree(data_row_list_t const& x_list, weight_list_t const& x_weights, size_t num_clusters)
+	{
+		assert(x_weights.size() == x_list.size());
+		assert(!x_list.empty());
+
+		start_timer();
+		m_stats = {};
+
+		const auto cluster_once_f = [this](data_row_list_t const& list, weight_list_t const& weights, size_t n_clusters)
+		{
+			return cluster_once(list, weights, n_clusters);
+		};
+
+		const auto out_of_time_f = [&]() { return out_of_time(); };
+
+		typedef struct
+		{
+			value_row_t centroid;
+			index_list_t children;
+			index_list_t x_rows;   // data in a leaf
+			r64 cost = 0.0;        // total weighted distance of the data from the centroid
+			bool can_split = true;
+
+		} build_node_t;
+
+		std::vector<build_node_t> nodes(1);
+
+		// all of the data starts in the root
+		nodes[0].x_rows.resize(x_list.size());
+		std::iota(nodes[0].x_rows.begin(), nodes[0].x_rows.end(), 0);
+		nodes[0].centroid = weighted_mean(x_list, x_weights);
+
+		for (size_t i = 0; i < x_list.size(); ++i)
+			nodes[0].cost += x_weights[i] * m_dist_func(x_list[i], nodes[0].centroid);
+
+		const auto root_cost = nodes[0].cost;
+		const auto total_weight = std::accumulate(x_weights.begin(), x_weights.end(), 0.0);
+		const auto min_count = std::max(std::min(m_settings.min_count, num_clusters), (size_t)1);
+
+		index_list_t leaves = { 0 };
+		r64 total_cost = root_cost;
+
+		const auto is_good_enough = [&]()
+		{
+			return min_count < num_clusters && leaves.size() >= min_count 
+				&& (root_cost <= 0 || 1.0 - total_cost / root_cost >= m_settings.quality);
+		};
+
+		const auto compare_split = [&](size_t lhs, size_t rhs) 
+		{ 
+			return !nodes[lhs].can_split || (nodes[rhs].can_split && nodes[lhs].cost < nodes[rhs].cost); 
+		};
+
+		while (leaves.size() < num_clusters && !is_good_enough())
+		{
+			// split the leaf with the largest cost
+			auto const leaf = std::max_element(leaves.begin(), leaves.end(), compare_split);
+			auto const parent = *leaf;
+
+			if (!nodes[parent].can_split || nodes[parent].cost <= 0)
+				break;
+
+			data_row_list_t sub_list;
+			weight_list_t sub_weights;
+			sub_list.reserve(nodes[parent].x_rows.size());
+			sub_weights.reserve(nodes[parent].x_rows.size());
+
+			for (auto const i : nodes[parent].x_rows)
+			{
+				sub_list.push_back(x_list[i]);
+				sub_weights.push_back(x_weights[i]);
+			}
+
+			cluster_stats_t split_stats;
+			auto result = cluster_min_distance(sub_list, sub_weights, 2, cluster_once_f, m_settings.attempts, out_of_time_f, split_stats);
+
+			m_stats.attempts += split_stats.attempts;
+			m_stats.iterations += split_stats.iterations;
+			m_stats.out_of_time |= split_stats.out_of_time;
+
+			std::array<build_node_t, 2> children;
+
+			for (size_t j = 0; j < sub_list.size(); ++j)
+			{
+				auto const c = result.x_clusters[j];
+				children[c].x_rows.push_back(nodes[parent].x_rows[j]);
+				children[c].cost += sub_weights[j] * m_dist_func(sub_list[j], result.centroids[c]);
+			}
+
+			if (children[0].x_rows.empty() || children[1].x_rows.empty())
+			{
+				nodes[parent].can_split = false;
+				continue;
+			}
+
+			total_cost += children[0].cost + children[1].cost - nodes[parent].cost;
+
+			auto const first_child = nodes.size();
+			nodes[parent].children = { first_child, first_child + 1 };
+			nodes[parent].x_rows = index_list_t();
+
+			leaves.erase(leaf);
+
+			for (size_t c = 0; c < children.size(); ++c)
+			{
+				children[c].centroid = std::move(result.centroids[c]);
+				nodes.push_back(std::move(children[c]));
+				leaves.push_back(first_child + c);
+			}
+		}
+
+		m_stats.average_distance = total_cost / total_weight;
+
+		// number the nodes with the leaves first, in the order they are found from the root
+		index_list_t leaf_order;
+		index_list_t branch_order;
+
+		index_list_t stack = { 0 };
+		while (!stack.empty())
+		{
+			auto const n = stack.back();
+			stack.pop_back();
+
+			auto const& children = nodes[n].children;
+			if (children.empty())
+			{
+				leaf_order.push_back(n);
+				continue;
+			}
+
+			branch_order.push_back(n);
+			stack.insert(stack.end(), children.rbegin(), children.rend());
+		}
+
+		index_list_t new_index(nodes.size());
+		for (size_t i = 0; i < leaf_order.size(); ++i)
+			new_index[leaf_order[i]] = i;
+
+		for (size_t i = 0; i < branch_order.size(); ++i)
+			new_index[branch_order[i]] = leaf_order.size() + i;
+
+		centroid_tree_t tree;
+		tree.nodes.resize(nodes.size());
+		tree.leaf_count = leaf_order.size();
+		tree.roots = { new_index[0] };
+
+		for (size_t n = 0; n < nodes.size(); ++n)
+		{
+			auto& node = tree.nodes[new_index[n]];
+			node.centroid = std::move(nodes[n].centroid);
+
+			for (auto const child : nodes[n].children)
+				node.children.push_back(new_index[child]);
+		}
+
+		return tree;
+	}
+
+
+	centroid_list_t Cluster::cluster_data(data_row_list_t const& x_list, size_t num_clusters)
+	{
+		// every row counts once
+		weight_list_t x_weights(x_list.size(), 1.0);
+
+		return cluster_data(x_list, x_weights, num_clusters);
+	}
+
+
+	centroid_list_t Cluster::cluster_data(data_row_list_t const& x_list, weight_list_t const& x_weights, size_t num_clusters)
+	{
+		assert(x_weights.size() == x_list.size());
+
+		start_timer();
+
+		// wrap member function in a lambda to pass it to algorithm
+		const auto cluster_once_f = [this](data_row_list_t const& list, weight_list_t const& weights, size_t n_clusters)
+		{
+			return cluster_once(list, weights, n_clusters);
+		};
+
+		const auto out_of_time_f = [&]() { return out_of_time(); };
 
-		auto result = cluster_min_distance(x_list, num_clusters, cluster_once_f);
+		m_stats = {};
+		auto result = cluster_min_distance(x_list, x_weights, num_clusters, cluster_once_f, m_settings.attempts, out_of_time_f, m_stats);
 
 		return result.centroids;
 	}
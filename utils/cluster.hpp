@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <functional>
+#include <chrono>
 #include <cstdint>
 
 using r64 = double;
@@ -10,7 +11,10 @@ namespace cluster
 {
 	//======= TYPE DEFINITIONS ====================
 
-	using data_row_t = std::vector<r64>;
+	// data is stored packed and converted with data_to_value() when it is used
+	using data_t = uint32_t;
+
+	using data_row_t = std::vector<data_t>;
 	using data_row_list_t = std::vector<data_row_t>;
 
 	using value_row_t = std::vector<r64>;
@@ -20,6 +24,9 @@ namespace cluster
 
 	using index_list_t = std::vector<size_t>;
 
+	// how many data points each row represents
+	using weight_list_t = std::vector<r64>;
+
 	using dist_func_t = std::function<r64(data_row_t const& data, value_row_t const& centroid)>;
 
 
@@ -28,9 +35,129 @@ namespace cluster
 		index_list_t x_clusters;      // the cluster index of each data point
 		centroid_list_t centroids;   // centroids found
 		r64 average_distance = 0.0; // 
+		size_t iterations = 0;       // iterations used before stopping
 
 	} cluster_result_t;
 
+
+	typedef struct CentroidNode
+	{
+		value_row_t centroid;
+		index_list_t children; // indices of the child nodes, empty for a leaf
+
+	} centroid_node_t;
+
+
+	typedef struct CentroidTree
+	{
+		std::vector<centroid_node_t> nodes; // the leaves are first
+		size_t leaf_count = 0;
+		index_list_t roots;                 // a search starts by comparing these nodes
+
+	} centroid_tree_t;
+
+
+	typedef struct ProductQuantizer
+	{
+		std::vector<index_list_t> subspaces;         // the data positions in each subspace
+		centroid_list_t codebook;                    // row k holds codeword k of every subspace
+		std::vector<std::vector<uint8_t>> codes;     // the codeword of each subspace for each centroid
+
+	} product_quantizer_t;
+
+
+	typedef struct RunningStats // Welford's method
+	{
+		size_t count = 0;
+		r64 mean = 0.0;
+		r64 m2 = 0.0; // sum of the squared differences from the mean
+
+	} running_stats_t;
+
+	// running mean and variance of each data position
+	using column_stats_t = std::vector<running_stats_t>;
+
+
+	typedef struct Covariance
+	{
+		index_list_t inputs;   // the data positions that are counted, set before adding rows
+		r64 weight = 0.0;      // total weight of the rows added
+		value_row_t mean;      // of each input
+		value_row_t comoments; // weighted sums of the products of the differences from the mean, row major by input
+
+	} covariance_t;
+
+
+	typedef struct Projection
+	{
+		index_list_t inputs;         // the data positions that are projected
+		value_row_t mean;            // of each input, subtracted before projecting
+		value_row_list_t components; // weights of the inputs for each projected position, most variance first
+		r64 scale = 0.0;             // fits the projected values in the value range
+		r64 variance = 0.0;          // fraction of the variance of the inputs that is kept
+
+	} projection_t;
+
+
+	typedef struct ClusterStats
+	{
+		size_t attempts = 0;        // number of times the data was clustered
+		size_t iterations = 0;      // iterations used by all attempts
+		size_t best_iterations = 0; // iterations used by the result returned
+		bool out_of_time = false;   // stopped early because of the time limit
+		r64 average_distance = 0.0; // of the data from the centroids returned
+
+	} cluster_stats_t;
+
+
+	// defaults for cluster_settings_t
+	// they can be changed at runtime with a config file, see read_cluster_settings() in cluster_config.hpp
+	constexpr size_t CLUSTER_ATTEMPTS = 30;
+	constexpr size_t CLUSTER_ITERATIONS = 30;
+	constexpr size_t CLUSTER_COUNT = 10;
+	constexpr size_t CLUSTER_MIN_COUNT = CLUSTER_COUNT;
+	constexpr r64 CLUSTER_QUALITY = 0.9;
+	constexpr r64 CLUSTER_TIME_LIMIT = 0.0;
+	constexpr size_t CLUSTER_TREE_BEAM = 0;
+	constexpr size_t CLUSTER_PQ_SUBSPACES = 0;
+	constexpr size_t CLUSTER_PQ_RERANK = 8;
+	constexpr size_t CLUSTER_PQ_CODEWORDS = 16;
+	constexpr size_t CLUSTER_PROJECTION_DIMS = 0;
+	constexpr size_t CLUSTER_POSITION_BUDGET = 0;
+	constexpr r64 CLUSTER_MERGE_DISTANCE = 0.0;
+
+	// the coreset has num_clusters / CLUSTER_CORESET_ERROR^2 rows, up to CLUSTER_CORESET_SIZE
+	constexpr size_t CLUSTER_CORESET_SIZE = 0;
+	constexpr r64 CLUSTER_CORESET_ERROR = 0.05;
+
+	// clustering stops when no more than CLUSTER_MAX_CHANGES data points change clusters
+	// or when no centroid moves more than CLUSTER_SHIFT_TOLERANCE of the value range
+	constexpr size_t CLUSTER_MAX_CHANGES = 0;
+	constexpr r64 CLUSTER_SHIFT_TOLERANCE = 0.0;
+
+
+	typedef struct ClusterSettings
+	{
+		size_t attempts = CLUSTER_ATTEMPTS;               // number of times to retry clustering, the best result is kept
+		size_t iterations = CLUSTER_ITERATIONS;           // maximum iterations for each attempt
+		size_t count = CLUSTER_COUNT;                     // number of clusters for each class, the most allowed if min_count is less
+		size_t min_count = CLUSTER_MIN_COUNT;             // fewest clusters to try for each class
+		r64 quality = CLUSTER_QUALITY;                    // fraction of the distance from a single centroid that the clusters must remove
+		r64 time_limit = CLUSTER_TIME_LIMIT;              // seconds allowed for clustering, 0 for no limit
+		size_t tree_beam = CLUSTER_TREE_BEAM;             // 0 for flat clustering, otherwise the nodes kept at each level when searching a centroid tree
+		size_t pq_subspaces = CLUSTER_PQ_SUBSPACES;       // 0 for no product quantization index, otherwise the number of parts the data is split into
+		size_t pq_rerank = CLUSTER_PQ_RERANK;             // candidates from the index that are compared exactly
+		size_t pq_codewords = CLUSTER_PQ_CODEWORDS;       // codewords for each subspace, up to PQ_MAX_CODEWORDS
+		size_t projection_dims = CLUSTER_PROJECTION_DIMS; // 0 to cluster the data as it is, otherwise the number of principal components it is projected to
+		size_t position_budget = CLUSTER_POSITION_BUDGET; // 0 to use every relevant data position, otherwise the most that are kept, the best at separating the classes
+		r64 merge_distance = CLUSTER_MERGE_DISTANCE;      // 0 to keep every centroid, otherwise centroids closer than this fraction of the value range are merged
+		size_t coreset_size = CLUSTER_CORESET_SIZE;       // 0 to cluster all of the data, otherwise the most rows of a class that are clustered
+		r64 coreset_error = CLUSTER_CORESET_ERROR;        // target relative error of the clustering cost when the data is reduced to a coreset
+		size_t max_changes = CLUSTER_MAX_CHANGES;         // an attempt stops when no more than this many data points change clusters
+		r64 shift_tolerance = CLUSTER_SHIFT_TOLERANCE;    // an attempt stops when no centroid moves more than this fraction of the value range
+
+	} cluster_settings_t;
+
 	
 	typedef struct DistanceResult 
 	{
@@ -48,23 +175,97 @@ namespace cluster
 
 		dist_func_t m_dist_func;
 
+		cluster_settings_t m_settings;
+
+		cluster_stats_t m_stats;
+
+		std::chrono::steady_clock::time_point m_deadline;
+
+		void start_timer();
+
+		bool out_of_time() const;
+
 		distance_result_t closest(data_row_t const& data, centroid_list_t const& value_list) const;
 
-		cluster_result_t cluster_once(data_row_list_t const& x_list, size_t num_clusters) const;
+		cluster_result_t cluster_once(data_row_list_t const& x_list, weight_list_t const& x_weights, size_t num_clusters) const;
 
 	public:
 
-		Cluster() : m_dist_func([](data_row_t const& data, value_row_t const& centroid) { return 0.0; }) {}
+		Cluster();
 
 		void set_distance(dist_func_t const& f) { m_dist_func = f; }
 
+		void set_settings(cluster_settings_t const& settings) { m_settings = settings; }
+
+		cluster_settings_t const& settings() const { return m_settings; }
+
 		// determines clusters given the data and the number of clusters
-		centroid_list_t cluster_data(data_row_list_t const& x_list, size_t num_clusters) const;
+		centroid_list_t cluster_data(data_row_list_t const& x_list, size_t num_clusters);
+
+		// same as cluster_data() with each row counted as weight copies of itself
+		centroid_list_t cluster_data(data_row_list_t const& x_list, weight_list_t const& x_weights, size_t num_clusters);
+
+		// bisecting clustering, the cluster with the largest total distance is split in two until there are num_clusters
+		// the leaves of the tree are the clusters, each node's children split its data
+		// splitting stops early if settings.min_count is less than num_clusters and settings.quality is reached
+		centroid_tree_t cluster_tree(data_row_list_t const& x_list, weight_list_t const& x_weights, size_t num_clusters);
+
+		// removes centroids closer than max_distance to a centroid with more data
+		// the data is then assigned to the centroids that are left and they are moved to the mean of their data
+		centroid_list_t merge_centroids(data_row_list_t const& x_list, weight_list_t const& x_weights, centroid_list_t const& centroids, r64 max_distance) const;
+
+		// work done by the last call to cluster_data() or cluster_tree()
+		cluster_stats_t const& stats() const { return m_stats; }
+
+		// product quantization of the centroids over the positions in dims
+		// each centroid is stored as the nearest of settings.pq_codewords codewords in each subspace
+		// the index only saves time when there are several centroids for each codeword, see PQ_MIN_CENTROIDS_PER_CODEWORD
+		product_quantizer_t make_quantizer(centroid_list_t const& centroids, index_list_t const& dims, size_t n_subspaces) const;
+
+		// fraction of the data for which the quantizer finds the same centroid as find_centroid(data, centroids)
+		r64 quantizer_recall(data_row_list_t const& x_list, centroid_list_t const& centroids, product_quantizer_t const& pq, size_t n_rerank) const;
+
+		// replaces the data with a smaller weighted sample that clusters about the same
+		// data that is already small enough is not changed, nor is any data when settings.coreset_size is 0
+		void reduce_to_coreset(data_row_list_t& x_list, weight_list_t& x_weights, size_t num_clusters) const;
 
 		// The index of the closest centroid in the list
 		size_t find_centroid(data_row_t const& data, centroid_list_t const& centroids) const;
+
+		// The index of the closest centroid among the n_rerank best found with the quantizer
+		// the quantizer approximates the distance as the sum of absolute differences over its subspaces
+		size_t find_centroid(data_row_t const& data, centroid_list_t const& centroids, product_quantizer_t const& pq, size_t n_rerank) const;
+
+		// The index of the closest leaf found by descending the tree
+		// the closest beam_width nodes are followed at each level, more finds better matches but takes longer
+		size_t find_centroid(data_row_t const& data, centroid_tree_t const& tree, size_t beam_width) const;
 	};
 
+
+	//======= STATISTICS =======================
+
+	// adds a row to the statistics of each position, stats has a value for each position
+	void update_stats(column_stats_t& stats, data_row_t const& data);
+
+	// adds the rows of src, as if each was added with update_stats()
+	void merge_stats(column_stats_t& dst, column_stats_t const& src);
+
+
+	//======= PROJECTION =======================
+
+	// adds a row counted weight times to the running covariance of the inputs
+	void update_covariance(covariance_t& cov, data_row_t const& data, r64 weight);
+
+	// adds the rows of src, as if each was added with update_covariance()
+	// both have the same inputs
+	void merge_covariance(covariance_t& dst, covariance_t const& src);
+
+	// principal component analysis of the inputs, keeps the n_dims components with the most variance
+	projection_t make_projection(covariance_t const& cov, size_t n_dims);
+
+	// the data projected to one position for each component, packed the same as the data
+	data_row_t project_row(data_row_t const& data, projection_t const& projection);
+
 }
 
 
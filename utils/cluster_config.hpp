@@ -2,6 +2,7 @@
 
 #include "cluster.hpp"
 
+#include <algorithm>
 #include <cmath>
 #include <cstddef>
 
@@ -9,10 +10,26 @@ namespace cluster
 {
 	//======= CONSTANTS ========================
 
-	constexpr size_t CLUSTER_ATTEMPTS = 30;
-	constexpr size_t CLUSTER_ITERATIONS = 30;
+	// codewords for each subspace of a product quantizer, codes are stored as uint8_t
+	constexpr size_t PQ_MAX_CODEWORDS = 256;
 
-	constexpr size_t CLUSTER_COUNT = 10;
+	// a product quantizer is only used when there are at least this many centroids for each codeword
+	// with fewer, comparing every centroid exactly is as fast as using the index
+	constexpr size_t PQ_MIN_CENTROIDS_PER_CODEWORD = 4;
+
+	// range of the values that data is converted to
+	constexpr r64 MODEL_VALUE_MIN = 0.0;
+	constexpr r64 MODEL_VALUE_MAX = 255.0 * 255.0 * 255.0;
+
+
+	//======= SETTINGS =======================
+
+	// reads settings from a config file
+	// keys: CLUSTER_ATTEMPTS, CLUSTER_ITERATIONS, CLUSTER_COUNT, CLUSTER_MIN_COUNT, CLUSTER_QUALITY, CLUSTER_TIME_LIMIT, 
+	//       CLUSTER_TREE_BEAM, CLUSTER_PQ_SUBSPACES, CLUSTER_PQ_RERANK, CLUSTER_PQ_CODEWORDS, CLUSTER_PROJECTION_DIMS, CLUSTER_POSITION_BUDGET,
+	//       CLUSTER_MERGE_DISTANCE, CLUSTER_CORESET_SIZE, CLUSTER_CORESET_ERROR, CLUSTER_MAX_CHANGES, CLUSTER_SHIFT_TOLERANCE
+	// missing or invalid values keep their defaults
+	cluster_settings_t read_cluster_settings(const char* config_file);
 
 
 	//======= DATA FUNCTIONS =======================
@@ -20,9 +37,21 @@ namespace cluster
 
 	// define how data type returns a value
 	// for creating clusters from data
-	constexpr r64 data_to_value(r64 const& data)
+	// data is a feature pixel value read from a data image
+	constexpr r64 data_to_value(data_t const& data)
+	{
+		auto const ratio = (r64)data / UINT32_MAX;
+
+		return MODEL_VALUE_MIN + ratio * (MODEL_VALUE_MAX - MODEL_VALUE_MIN);
+	}
+
+
+	// the data that converts to a value, for storing computed values with the data
+	constexpr data_t value_to_data(r64 value)
 	{
-		return data;
+		auto const ratio = (value - MODEL_VALUE_MIN) / (MODEL_VALUE_MAX - MODEL_VALUE_MIN);
+
+		return (data_t)(std::clamp(ratio, 0.0, 1.0) * UINT32_MAX + 0.5);
 	}
 
 
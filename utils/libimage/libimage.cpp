@@ -1,24 +1,1871 @@
 #include "libimage.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+#include <cstdio>
+
+#ifndef LIBIMAGE_NO_MATH
+#include <numeric>
+#include <cmath>
+#endif // !LIBIMAGE_NO_MATH
+
+#include <mutex>
+
+#ifndef LIBIMAGE_NO_SIMD
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LIBIMAGE_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define LIBIMAGE_NEON
+#include <arm_neon.h>
+#endif
+
+#endif // !LIBIMAGE_NO_SIMD
+
+
+//======= STB ALLOCATION =================
+
+// stb allocations are made from the pool of the calling thread when one is in use
+static thread_local libimage::image_pool_t* stb_pool = nullptr;
+
+
+static void* stb_malloc(size_t n_bytes)
+{
+	return stb_pool ? stb_pool->acquire(n_bytes) : malloc(n_bytes);
+}
+
+
+static void* stb_realloc(void* buffer, size_t n_bytes)
+{
+	return stb_pool ? stb_pool->resize(buffer, n_bytes) : realloc(buffer, n_bytes);
+}
+
+
+static void stb_free(void* buffer)
+{
+	if (stb_pool)
+	{
+		stb_pool->release(buffer);
+	}
+	else
+	{
+		free(buffer);
+	}
+}
+
+
+#define STBI_MALLOC(sz) stb_malloc(sz)
+#define STBI_REALLOC(p, newsz) stb_realloc(p, newsz)
+#define STBI_FREE(p) stb_free(p)
+
+#define STBIR_MALLOC(size, c) ((void)(c), stb_malloc(size))
+#define STBIR_FREE(ptr, c) ((void)(c), stb_free(ptr))
+
 #include "stb_all.hpp"
 
-#ifndef LIBIMAGE_NO_MATH
-#include <numeric>
-#endif // !LIBIMAGE_NO_MATH
+
+// routes stb allocations to a pool for the current scope
+class stb_pool_scope_t
+{
+private:
+
+	libimage::image_pool_t* m_prev = nullptr;
+
+public:
+
+	stb_pool_scope_t(libimage::image_pool_t& pool) { m_prev = stb_pool; stb_pool = &pool; }
+
+	~stb_pool_scope_t() { stb_pool = m_prev; }
+};
+
+
+namespace libimage
+{
+	//======= BANDS =================
+
+	static u32 count_bands(u32 width, u32 height)
+	{
+		// large views are split into horizontal bands, one for each thread
+
+#ifndef LIBIMAGE_NO_PARALLEL
+
+		if (static_cast<size_t>(width) * height < PARALLEL_MIN_PIXELS)
+		{
+			return 1;
+		}
+
+		return std::min(thread_pool::parallel_thread_count(), height);
+
+#else
+
+		return 1;
+
+#endif // !LIBIMAGE_NO_PARALLEL
+	}
+
+
+	// runs func(band, y_begin, y_end) for each band of rows
+	template <class FUNC>
+	static void process_bands(u32 height, u32 n_bands, FUNC const& func)
+	{
+		auto const y_begin = [&](u32 band) { return static_cast<u32>(static_cast<u64>(height) * band / n_bands); };
+
+		auto const process_band = [&](u32 band) { func(band, y_begin(band), y_begin(band + 1)); };
+
+		if (n_bands == 1)
+		{
+			process_band(0);
+			return;
+		}
+
+		thread_pool::execute_in_parallel(n_bands, process_band);
+	}
+
+
+	// source pixels that are averaged down to one pixel
+	typedef struct
+	{
+		u32 begin;
+		u32 end; // one past last
+
+	} block_t;
+
+
+	// blocks start at size_src * i / n_blocks, so any grid size can be used
+	// every block has at least one pixel, a source smaller than the grid is upscaled by repeating pixels
+	static std::vector<block_t> make_blocks(u32 size_src, u32 n_blocks)
+	{
+		assert(size_src);
+		assert(n_blocks);
+
+		auto const edge = [&](u32 i) { return static_cast<u32>(static_cast<u64>(size_src) * i / n_blocks); };
+
+		std::vector<block_t> blocks(n_blocks);
+		for (u32 i = 0; i < n_blocks; ++i)
+		{
+			blocks[i].begin = edge(i);
+			blocks[i].end = std::max(edge(i + 1), blocks[i].begin + 1);
+		}
+
+		return blocks;
+	}
+
+
+	// same conversion that stb_image uses when decoding to one channel
+	static inline u8 rgb_to_gray(u8 red, u8 green, u8 blue)
+	{
+		return static_cast<u8>((red * 77 + green * 150 + blue * 29) >> 8);
+	}
+
+
+	static pixel_range_t clip_range(pixel_range_t range, u32 width, u32 height)
+	{
+		range.x_end = std::min(range.x_end, width);
+		range.y_end = std::min(range.y_end, height);
+
+		assert(range.x_begin < range.x_end);
+		assert(range.y_begin < range.y_end);
+
+		return range;
+	}
+
+
+#ifndef LIBIMAGE_NO_RESIZE
+
+	// large images are resized in bands of destination rows
+	// each band uses the scale of the whole image and is shifted to its first row so the result is the same
+	static void resize_channels(u8 const* src, u32 width_src, u32 height_src, u8* dst, u32 width_dst, u32 height_dst, u32 n_channels)
+	{
+		int channels = static_cast<int>(n_channels);
+
+		int stride_bytes_src = static_cast<int>(width_src) * channels;
+		int stride_bytes_dst = static_cast<int>(width_dst) * channels;
+
+		auto const n_bands = std::min(std::max(count_bands(width_src, height_src), count_bands(width_dst, height_dst)), height_dst);
+
+		if (n_bands == 1)
+		{
+			int result = stbir_resize_uint8(
+				src, static_cast<int>(width_src), static_cast<int>(height_src), stride_bytes_src,
+				dst, static_cast<int>(width_dst), static_cast<int>(height_dst), stride_bytes_dst,
+				channels);
+
+			assert(result);
+			return;
+		}
+
+		auto const x_scale = static_cast<float>(width_dst) / width_src;
+		auto const y_scale = static_cast<float>(height_dst) / height_src;
+
+		auto const resize_band = [&](u32, u32 y_begin, u32 y_end)
+		{
+			int result = stbir_resize_subpixel(
+				src, static_cast<int>(width_src), static_cast<int>(height_src), stride_bytes_src,
+				dst + static_cast<size_t>(y_begin) * stride_bytes_dst, static_cast<int>(width_dst), static_cast<int>(y_end - y_begin), stride_bytes_dst,
+				STBIR_TYPE_UINT8, channels, STBIR_ALPHA_CHANNEL_NONE, 0,
+				STBIR_EDGE_CLAMP, STBIR_EDGE_CLAMP, STBIR_FILTER_DEFAULT, STBIR_FILTER_DEFAULT,
+				STBIR_COLORSPACE_LINEAR, nullptr,
+				x_scale, y_scale, 0.0f, static_cast<float>(y_begin));
+
+			assert(result);
+		};
+
+		process_bands(height_dst, n_bands, resize_band);
+	}
+
+#endif // !LIBIMAGE_NO_RESIZE
+
+
+	//======= IMAGE POOL =================
+
+	// each buffer is preceded by its capacity
+	// header size keeps the buffer aligned for any pixel type
+	typedef union
+	{
+		size_t capacity;
+		std::max_align_t align;
+
+	} pool_header_t;
+
+
+	static pool_header_t* to_header(void* buffer)
+	{
+		return (pool_header_t*)buffer - 1;
+	}
+
+
+	void* image_pool_t::acquire(size_t n_bytes)
+	{
+		// use the smallest free buffer that is large enough
+
+		auto best = m_free.end();
+
+		for (auto it = m_free.begin(); it != m_free.end(); ++it)
+		{
+			auto capacity = to_header(*it)->capacity;
+			if (capacity >= n_bytes && (best == m_free.end() || capacity < to_header(*best)->capacity))
+			{
+				best = it;
+			}
+		}
+
+		if (best != m_free.end())
+		{
+			auto buffer = *best;
+			*best = m_free.back();
+			m_free.pop_back();
+
+			return buffer;
+		}
+
+		auto header = (pool_header_t*)malloc(sizeof(pool_header_t) + n_bytes);
+		if (!header)
+		{
+			return nullptr;
+		}
+
+		header->capacity = n_bytes;
+
+		return header + 1;
+	}
+
+
+	void* image_pool_t::resize(void* buffer, size_t n_bytes)
+	{
+		if (!buffer)
+		{
+			return acquire(n_bytes);
+		}
+
+		auto capacity = to_header(buffer)->capacity;
+		if (capacity >= n_bytes)
+		{
+			return buffer;
+		}
+
+		auto resized = acquire(n_bytes);
+		if (resized)
+		{
+			memcpy(resized, buffer, capacity);
+			release(buffer);
+		}
+
+		return resized;
+	}
+
+
+	void image_pool_t::release(void* buffer)
+	{
+		if (buffer)
+		{
+			m_free.push_back(buffer);
+		}
+	}
+
+
+	void image_pool_t::purge()
+	{
+		for (auto buffer : m_free)
+		{
+			free(to_header(buffer));
+		}
+
+		m_free.clear();
+	}
+
+
+	//======= ROW DECODER =================
+
+	// png files with 8 bit channels are inflated as they are read and handed out one row at a time
+	// only a few rows and the 32KB inflate window are in memory, rows below the last one needed are never inflated
+	// interlaced, 16 bit and other formats are decoded whole by stb and then handed out
+
+	// called with each decoded row from the top, false when no more rows are needed
+	using decode_row_func_t = std::function<bool(u32 y, u8 const* row)>;
+
+
+	constexpr u32 PNG_CHUNK_IHDR = 0x49484452;
+	constexpr u32 PNG_CHUNK_PLTE = 0x504C5445;
+	constexpr u32 PNG_CHUNK_TRNS = 0x74524E53;
+	constexpr u32 PNG_CHUNK_IDAT = 0x49444154;
+	constexpr u32 PNG_CHUNK_IEND = 0x49454E44;
+
+	constexpr u32 PNG_MAX_WIDTH = 1u << 24;
+
+	constexpr u32 INFLATE_WINDOW_SIZE = 1u << 15;
+	constexpr u32 INFLATE_OUT_SIZE = 2 * INFLATE_WINDOW_SIZE; // bytes are handed out as rows when this fills, then the window is moved to the front
+	constexpr u32 INFLATE_MAX_MATCH = 258;
+	constexpr u32 INFLATE_FAST_BITS = 9;
+	constexpr u32 INFLATE_MAX_BITS = 15;
+	constexpr u32 INFLATE_MAX_PADDING = 16; // bytes past the end of the data that are read as zeros before it is an error
+
+	constexpr u16 INFLATE_LENGTH_BASE[] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	constexpr u8 INFLATE_LENGTH_EXTRA[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	constexpr u16 INFLATE_DISTANCE_BASE[] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	constexpr u8 INFLATE_DISTANCE_EXTRA[] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+	constexpr u8 INFLATE_LENGTH_ORDER[] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+
+	// canonical huffman code
+	typedef struct
+	{
+		u16 fast[1u << INFLATE_FAST_BITS];  // length << 9 | symbol for codes of up to INFLATE_FAST_BITS, 0 for longer codes
+		u16 count[INFLATE_MAX_BITS + 1];    // number of codes of each length
+		u16 symbols[288];                   // symbols in code order
+
+	} huffman_t;
+
+
+	static bool make_huffman(u8 const* lengths, u32 n_symbols, huffman_t& code)
+	{
+		std::fill(std::begin(code.count), std::end(code.count), (u16)0);
+
+		for (u32 s = 0; s < n_symbols; ++s)
+		{
+			++code.count[lengths[s]];
+		}
+
+		code.count[0] = 0;
+
+		// over-subscribed codes are invalid, incomplete codes are allowed
+		int left = 1;
+		for (u32 len = 1; len <= INFLATE_MAX_BITS; ++len)
+		{
+			left = (left << 1) - code.count[len];
+			if (left < 0)
+			{
+				return false;
+			}
+		}
+
+		u16 offsets[INFLATE_MAX_BITS + 1] = { 0 };
+		for (u32 len = 1; len < INFLATE_MAX_BITS; ++len)
+		{
+			offsets[len + 1] = offsets[len] + code.count[len];
+		}
+
+		for (u32 s = 0; s < n_symbols; ++s)
+		{
+			if (lengths[s])
+			{
+				code.symbols[offsets[lengths[s]]++] = (u16)s;
+			}
+		}
+
+		// deflate codes are read from the low bit, so the table is indexed by the reversed code
+		std::fill(std::begin(code.fast), std::end(code.fast), (u16)0);
+
+		u32 first = 0;
+		u32 index = 0;
+		for (u32 len = 1; len <= INFLATE_FAST_BITS; ++len)
+		{
+			for (u32 i = 0; i < code.count[len]; ++i, ++index)
+			{
+				u32 reversed = 0;
+				for (u32 b = 0; b < len; ++b)
+				{
+					reversed |= ((first + i) >> b & 1) << (len - 1 - b);
+				}
+
+				for (u32 j = reversed; j < (1u << INFLATE_FAST_BITS); j += 1u << len)
+				{
+					code.fast[j] = (u16)(len << 9 | code.symbols[index]);
+				}
+			}
+
+			first = (first + code.count[len]) << 1;
+		}
+
+		return true;
+	}
+
+
+	static huffman_t const& fixed_literal_code()
+	{
+		static huffman_t const code = []()
+		{
+			u8 lengths[288];
+			std::fill(lengths, lengths + 144, (u8)8);
+			std::fill(lengths + 144, lengths + 256, (u8)9);
+			std::fill(lengths + 256, lengths + 280, (u8)7);
+			std::fill(lengths + 280, lengths + 288, (u8)8);
+
+			huffman_t c;
+			make_huffman(lengths, 288, c);
+
+			return c;
+		}();
+
+		return code;
+	}
+
+
+	static huffman_t const& fixed_distance_code()
+	{
+		static huffman_t const code = []()
+		{
+			u8 lengths[30];
+			std::fill(lengths, lengths + 30, (u8)5);
+
+			huffman_t c;
+			make_huffman(lengths, 30, c);
+
+			return c;
+		}();
+
+		return code;
+	}
+
+
+	static inline u8 paeth(u8 a, u8 b, u8 c)
+	{
+		int const p = a + b - c;
+		int const pa = abs(p - a);
+		int const pb = abs(p - b);
+		int const pc = abs(p - c);
+
+		return pa <= pb && pa <= pc ? a : (pb <= pc ? b : c);
+	}
+
+
+	// undoes the png filter of a row using the row above it, the row above the first row is zeros
+	static bool unfilter_row(u8 filter, u8* row, u8 const* prev, u32 length, u32 bpp)
+	{
+		switch (filter)
+		{
+		case 0:
+			return true;
+
+		case 1:
+			for (u32 i = bpp; i < length; ++i)
+			{
+				row[i] = (u8)(row[i] + row[i - bpp]);
+			}
+			return true;
+
+		case 2:
+			for (u32 i = 0; i < length; ++i)
+			{
+				row[i] = (u8)(row[i] + prev[i]);
+			}
+			return true;
+
+		case 3:
+			for (u32 i = 0; i < bpp; ++i)
+			{
+				row[i] = (u8)(row[i] + (prev[i] >> 1));
+			}
+			for (u32 i = bpp; i < length; ++i)
+			{
+				row[i] = (u8)(row[i] + ((row[i - bpp] + prev[i]) >> 1));
+			}
+			return true;
+
+		case 4:
+			for (u32 i = 0; i < bpp; ++i)
+			{
+				row[i] = (u8)(row[i] + prev[i]);
+			}
+			for (u32 i = bpp; i < length; ++i)
+			{
+				row[i] = (u8)(row[i] + paeth(row[i - bpp], prev[i], prev[i - bpp]));
+			}
+			return true;
+
+		default:
+			return false;
+		}
+	}
+
+
+	// same conversions that stb_image makes for the number of channels requested
+	static void convert_row(u8 const* src, u32 width, u32 color_type, u8 const* palette, u8* dst, u32 n_channels)
+	{
+		if (n_channels == 1)
+		{
+			switch (color_type)
+			{
+			case 0:
+				memcpy(dst, src, width);
+				break;
+
+			case 2:
+				for (u32 x = 0; x < width; ++x, src += 3) { dst[x] = rgb_to_gray(src[0], src[1], src[2]); }
+				break;
+
+			case 3:
+				for (u32 x = 0; x < width; ++x) { auto p = palette + 4 * src[x]; dst[x] = rgb_to_gray(p[0], p[1], p[2]); }
+				break;
+
+			case 4:
+				for (u32 x = 0; x < width; ++x) { dst[x] = src[2 * x]; }
+				break;
+
+			default:
+				for (u32 x = 0; x < width; ++x, src += 4) { dst[x] = rgb_to_gray(src[0], src[1], src[2]); }
+			}
+
+			return;
+		}
+
+		assert(n_channels == RGBA_CHANNELS);
+
+		switch (color_type)
+		{
+		case 0:
+			for (u32 x = 0; x < width; ++x, dst += 4) { dst[0] = dst[1] = dst[2] = src[x]; dst[3] = 255; }
+			break;
+
+		case 2:
+			for (u32 x = 0; x < width; ++x, src += 3, dst += 4) { dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2]; dst[3] = 255; }
+			break;
+
+		case 3:
+			for (u32 x = 0; x < width; ++x, dst += 4) { memcpy(dst, palette + 4 * src[x], 4); }
+			break;
+
+		case 4:
+			for (u32 x = 0; x < width; ++x, src += 2, dst += 4) { dst[0] = dst[1] = dst[2] = src[0]; dst[3] = src[1]; }
+			break;
+
+		default:
+			memcpy(dst, src, static_cast<size_t>(width) * 4);
+		}
+	}
+
+
+	class png_row_decoder_t
+	{
+	private:
+
+		FILE* m_file = nullptr;
+		u8 m_buffer[8192];
+		u32 m_buffer_pos = 0;
+		u32 m_buffer_size = 0;
+
+		u32 m_chunk_left = 0;   // bytes of the current IDAT chunk that have not been read
+		bool m_data_end = false;
+
+		u64 m_bits = 0;
+		u32 m_n_bits = 0;
+		u32 m_padding = 0;
+		bool m_error = false;
+
+		huffman_t m_literal_code;
+		huffman_t m_distance_code;
+
+		u8* m_out = nullptr;    // the window of bytes that matches copy from and bytes that have not been handed out
+		u32 m_out_pos = 0;
+		u32 m_out_begin = 0;    // first byte that has not been handed out
+
+		u32 m_width = 0;
+		u32 m_height = 0;
+		u32 m_color_type = 0;
+		u32 m_bpp = 0;          // bytes per pixel in the file
+		u8 m_palette[256 * 4];  // rgba
+		bool m_has_palette = false;
+
+		u8* m_row = nullptr;    // filter byte and the row being inflated
+		u8* m_prev = nullptr;   // the row above, after unfiltering
+		u8* m_row_dst = nullptr;
+		u32 m_row_size = 0;
+		u32 m_row_pos = 0;
+		u32 m_y = 0;
+		bool m_done = false;
+
+		u32 m_n_channels = 0;
+		decode_row_func_t const* m_on_row = nullptr;
+
+		int read_byte()
+		{
+			if (m_buffer_pos == m_buffer_size)
+			{
+				m_buffer_pos = 0;
+				m_buffer_size = (u32)fread(m_buffer, 1, sizeof(m_buffer), m_file);
+
+				if (!m_buffer_size)
+				{
+					return -1;
+				}
+			}
+
+			return m_buffer[m_buffer_pos++];
+		}
+
+
+		bool read_u32(u32& value)
+		{
+			value = 0;
+			for (u32 i = 0; i < 4; ++i)
+			{
+				auto const b = read_byte();
+				if (b < 0)
+				{
+					return false;
+				}
+
+				value = value << 8 | (u32)b;
+			}
+
+			return true;
+		}
+
+
+		bool skip_bytes(u32 n_bytes)
+		{
+			for (u32 i = 0; i < n_bytes; ++i)
+			{
+				if (read_byte() < 0)
+				{
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+
+		// the compressed data continues over consecutive IDAT chunks
+		int read_data_byte()
+		{
+			while (!m_chunk_left)
+			{
+				u32 length = 0;
+				u32 type = 0;
+
+				if (m_data_end || !skip_bytes(4) || !read_u32(length) || !read_u32(type) || type != PNG_CHUNK_IDAT)
+				{
+					m_data_end = true;
+					return -1;
+				}
+
+				m_chunk_left = length;
+			}
+
+			--m_chunk_left;
+
+			return read_byte();
+		}
+
+
+		// reads as many bytes as fit from the buffer, waits for more data only when fewer than n_bits are left
+		void fill_bits(u32 n_bits)
+		{
+			while (m_n_bits <= 56)
+			{
+				int b = 0;
+
+				if (m_chunk_left && m_buffer_pos < m_buffer_size)
+				{
+					--m_chunk_left;
+					b = m_buffer[m_buffer_pos++];
+				}
+				else if (m_n_bits >= n_bits)
+				{
+					return;
+				}
+				else if ((b = read_data_byte()) < 0)
+				{
+					// codes at the end of the data can be shorter than the bits that are looked at
+					b = 0;
+					m_error |= ++m_padding > INFLATE_MAX_PADDING;
+				}
+
+				m_bits |= (u64)b << m_n_bits;
+				m_n_bits += 8;
+			}
+		}
+
+
+		u32 read_bits(u32 n_bits)
+		{
+			if (m_n_bits < n_bits)
+			{
+				fill_bits(n_bits);
+			}
+
+			auto const value = (u32)(m_bits & ((1ull << n_bits) - 1));
+			m_bits >>= n_bits;
+			m_n_bits -= n_bits;
+
+			return value;
+		}
+
+
+		int decode(huffman_t const& code)
+		{
+			if (m_n_bits < INFLATE_MAX_BITS)
+			{
+				fill_bits(INFLATE_MAX_BITS);
+			}
+
+			auto const entry = code.fast[m_bits & ((1u << INFLATE_FAST_BITS) - 1)];
+			if (entry)
+			{
+				read_bits(entry >> 9);
+				return entry & 0x1FF;
+			}
+
+			// longer codes are found one bit at a time
+			int value = 0;
+			int first = 0;
+			int index = 0;
+			for (u32 len = 1; len <= INFLATE_MAX_BITS; ++len)
+			{
+				value |= (int)(m_bits >> (len - 1) & 1);
+
+				int const count = code.count[len];
+				if (value - count < first)
+				{
+					read_bits(len);
+					return code.symbols[index + (value - first)];
+				}
+
+				index += count;
+				first = (first + count) << 1;
+				value <<= 1;
+			}
+
+			m_error = true;
+			return -1;
+		}
+
+
+		void finish_row()
+		{
+			auto const length = m_row_size - 1;
+
+			m_row_pos = 0;
+
+			if (!unfilter_row(m_row[0], m_row + 1, m_prev + 1, length, m_bpp))
+			{
+				m_error = true;
+				return;
+			}
+
+			convert_row(m_row + 1, m_width, m_color_type, m_palette, m_row_dst, m_n_channels);
+
+			std::swap(m_row, m_prev);
+
+			m_done = !(*m_on_row)(m_y, m_row_dst) || ++m_y == m_height;
+		}
+
+
+		// hands out the inflated bytes as rows and moves the window to the front
+		void flush_rows()
+		{
+			while (m_out_begin < m_out_pos && !m_done && !m_error)
+			{
+				auto const n_bytes = std::min(m_row_size - m_row_pos, m_out_pos - m_out_begin);
+
+				memcpy(m_row + m_row_pos, m_out + m_out_begin, n_bytes);
+				m_row_pos += n_bytes;
+				m_out_begin += n_bytes;
+
+				if (m_row_pos == m_row_size)
+				{
+					finish_row();
+				}
+			}
+
+			if (m_out_pos > INFLATE_WINDOW_SIZE)
+			{
+				memmove(m_out, m_out + m_out_pos - INFLATE_WINDOW_SIZE, INFLATE_WINDOW_SIZE);
+				m_out_pos = INFLATE_WINDOW_SIZE;
+			}
+
+			m_out_begin = m_out_pos;
+		}
+
+
+		void put_byte(u8 value)
+		{
+			m_out[m_out_pos++] = value;
+
+			if (m_out_pos == INFLATE_OUT_SIZE)
+			{
+				flush_rows();
+			}
+		}
+
+
+		void inflate_stored()
+		{
+			read_bits(m_n_bits % 8);
+
+			auto const length = read_bits(16);
+			auto const inverse = read_bits(16);
+
+			if ((length ^ 0xFFFF) != inverse)
+			{
+				m_error = true;
+				return;
+			}
+
+			for (u32 i = 0; i < length && !m_done && !m_error; ++i)
+			{
+				put_byte((u8)read_bits(8));
+			}
+		}
+
+
+		void inflate_codes(huffman_t const& literal_code, huffman_t const& distance_code)
+		{
+			while (!m_done && !m_error)
+			{
+				auto symbol = decode(literal_code);
+
+				if (symbol < 256)
+				{
+					if (symbol >= 0)
+					{
+						m_out[m_out_pos++] = (u8)symbol;
+					}
+
+					if (m_out_pos > INFLATE_OUT_SIZE - INFLATE_MAX_MATCH)
+					{
+						flush_rows();
+					}
+
+					continue;
+				}
+
+				if (symbol == 256)
+				{
+					return;
+				}
+
+				symbol -= 257;
+				if (symbol >= 29)
+				{
+					m_error = true;
+					return;
+				}
+
+				auto const length = INFLATE_LENGTH_BASE[symbol] + read_bits(INFLATE_LENGTH_EXTRA[symbol]);
+
+				symbol = decode(distance_code);
+				if (symbol < 0 || symbol >= 30)
+				{
+					m_error = true;
+					return;
+				}
+
+				auto const distance = INFLATE_DISTANCE_BASE[symbol] + read_bits(INFLATE_DISTANCE_EXTRA[symbol]);
+				if (distance > m_out_pos)
+				{
+					m_error = true;
+					return;
+				}
+
+				// bytes are copied one at a time because a match can overlap the bytes it makes
+				auto dst = m_out + m_out_pos;
+				auto src = dst - distance;
+				for (u32 i = 0; i < length; ++i)
+				{
+					dst[i] = src[i];
+				}
+
+				m_out_pos += length;
+
+				if (m_out_pos > INFLATE_OUT_SIZE - INFLATE_MAX_MATCH)
+				{
+					flush_rows();
+				}
+			}
+		}
+
+
+		void inflate_dynamic()
+		{
+			auto const n_literals = read_bits(5) + 257;
+			auto const n_distances = read_bits(5) + 1;
+			auto const n_lengths = read_bits(4) + 4;
+
+			u8 lengths[288 + 32] = { 0 };
+			for (u32 i = 0; i < n_lengths; ++i)
+			{
+				lengths[INFLATE_LENGTH_ORDER[i]] = (u8)read_bits(3);
+			}
+
+			huffman_t length_code;
+			if (n_literals > 286 || n_distances > 30 || !make_huffman(lengths, 19, length_code))
+			{
+				m_error = true;
+				return;
+			}
+
+			std::fill(std::begin(lengths), std::end(lengths), (u8)0);
+
+			u32 n = 0;
+			while (n < n_literals + n_distances && !m_error)
+			{
+				auto const symbol = decode(length_code);
+				if (symbol < 0)
+				{
+					return;
+				}
+
+				if (symbol < 16)
+				{
+					lengths[n++] = (u8)symbol;
+					continue;
+				}
+
+				u8 value = 0;
+				u32 repeat = 0;
+
+				switch (symbol)
+				{
+				case 16:
+					if (!n)
+					{
+						m_error = true;
+						return;
+					}
+					value = lengths[n - 1];
+					repeat = 3 + read_bits(2);
+					break;
+
+				case 17:
+					repeat = 3 + read_bits(3);
+					break;
+
+				default:
+					repeat = 11 + read_bits(7);
+				}
+
+				if (n + repeat > n_literals + n_distances)
+				{
+					m_error = true;
+					return;
+				}
+
+				std::fill(lengths + n, lengths + n + repeat, value);
+				n += repeat;
+			}
+
+			if (m_error || !make_huffman(lengths, n_literals, m_literal_code) || !make_huffman(lengths + n_literals, n_distances, m_distance_code))
+			{
+				m_error = true;
+				return;
+			}
+
+			inflate_codes(m_literal_code, m_distance_code);
+		}
+
+
+		void inflate()
+		{
+			auto const cmf = read_bits(8);
+			auto const flg = read_bits(8);
+
+			// deflate without a preset dictionary
+			if ((cmf & 15) != 8 || (cmf * 256 + flg) % 31 || (flg & 32))
+			{
+				m_error = true;
+				return;
+			}
+
+			auto last = false;
+			while (!last && !m_done && !m_error)
+			{
+				last = read_bits(1);
+
+				switch (read_bits(2))
+				{
+				case 0:
+					inflate_stored();
+					break;
+
+				case 1:
+					inflate_codes(fixed_literal_code(), fixed_distance_code());
+					break;
+
+				case 2:
+					inflate_dynamic();
+					break;
+
+				default:
+					m_error = true;
+				}
+
+				flush_rows();
+			}
+		}
+
+
+		// reads chunks up to the first IDAT, false if the file is not a png that can be streamed
+		bool read_header()
+		{
+			u8 const signature[] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+			for (auto s : signature)
+			{
+				if (read_byte() != s)
+				{
+					return false;
+				}
+			}
+
+			u32 length = 0;
+			u32 type = 0;
+
+			if (!read_u32(length) || !read_u32(type) || type != PNG_CHUNK_IHDR || length != 13 || !read_u32(m_width) || !read_u32(m_height))
+			{
+				return false;
+			}
+
+			auto const depth = read_byte();
+			m_color_type = (u32)read_byte();
+			auto const compression = read_byte();
+			auto const filter = read_byte();
+			auto const interlace = read_byte();
+
+			u32 const bytes_per_pixel[] = { 1, 0, 3, 1, 2, 0, 4 };
+
+			if (depth != 8 || m_color_type > 6 || !bytes_per_pixel[m_color_type] || compression || filter || interlace || !skip_bytes(4))
+			{
+				return false;
+			}
+
+			if (!m_width || !m_height || m_width > PNG_MAX_WIDTH)
+			{
+				return false;
+			}
+
+			m_bpp = bytes_per_pixel[m_color_type];
+
+			for (u32 i = 0; i < 256; ++i)
+			{
+				m_palette[4 * i] = m_palette[4 * i + 1] = m_palette[4 * i + 2] = 0;
+				m_palette[4 * i + 3] = 255;
+			}
+
+			while (read_u32(length) && read_u32(type))
+			{
+				switch (type)
+				{
+				case PNG_CHUNK_IDAT:
+					m_chunk_left = length;
+					return m_color_type != 3 || m_has_palette;
+
+				case PNG_CHUNK_PLTE:
+					if (length % 3 || length > 256 * 3)
+					{
+						return false;
+					}
+
+					for (u32 i = 0; i < length / 3; ++i)
+					{
+						for (u32 c = 0; c < 3; ++c)
+						{
+							m_palette[4 * i + c] = (u8)read_byte();
+						}
+					}
+
+					m_has_palette = true;
+					break;
+
+				case PNG_CHUNK_TRNS:
+					// stb adds an alpha channel for a transparent color in other formats
+					if (m_color_type != 3 || length > 256)
+					{
+						return false;
+					}
+
+					for (u32 i = 0; i < length; ++i)
+					{
+						m_palette[4 * i + 3] = (u8)read_byte();
+					}
+					break;
+
+				case PNG_CHUNK_IEND:
+					return false;
+
+				default:
+					if (!skip_bytes(length))
+					{
+						return false;
+					}
+				}
+
+				if (!skip_bytes(4))
+				{
+					return false;
+				}
+			}
+
+			return false;
+		}
+
+	public:
+
+		png_row_decoder_t(FILE* file) : m_file(file) {}
+
+		bool can_stream() { return read_header(); }
+
+		u32 width() const { return m_width; }
+
+		u32 height() const { return m_height; }
+
+		// false if the data ended or was invalid before the last row that was needed
+		bool read_rows(u32 n_channels, image_pool_t& pool, decode_row_func_t const& on_row)
+		{
+			m_n_channels = n_channels;
+			m_on_row = &on_row;
+
+			m_row_size = m_width * m_bpp + 1;
+
+			m_out = (u8*)pool.acquire(INFLATE_OUT_SIZE);
+			m_row = (u8*)pool.acquire(m_row_size);
+			m_prev = (u8*)pool.acquire(m_row_size);
+			m_row_dst = (u8*)pool.acquire(static_cast<size_t>(m_width) * n_channels);
+
+			memset(m_prev, 0, m_row_size);
+
+			inflate();
+
+			pool.release(m_row_dst);
+			pool.release(m_prev);
+			pool.release(m_row);
+			pool.release(m_out);
+
+			return m_done;
+		}
+	};
+
+
+	// decodes an image file to n_channels (1 or 4) and calls on_row(y, row) for each row from the top
+	// false if the file could not be read or ended before the last row that was needed
+	static bool read_rows(const char* file_path_src, u32 n_channels, image_pool_t& pool, read_size_func_t const& on_size, decode_row_func_t const& on_row)
+	{
+		auto file = fopen(file_path_src, "rb");
+		if (!file)
+		{
+			return false;
+		}
+
+		png_row_decoder_t decoder(file);
+
+		if (decoder.can_stream())
+		{
+			auto const result = !on_size(decoder.width(), decoder.height()) || decoder.read_rows(n_channels, pool, on_row);
+
+			fclose(file);
+
+			return result;
+		}
+
+		fclose(file);
+
+		stb_pool_scope_t scope(pool);
+
+		int width = 0;
+		int height = 0;
+		int image_channels = 0;
+
+		auto data = stbi_load(file_path_src, &width, &height, &image_channels, (int)n_channels);
+		if (!data)
+		{
+			return false;
+		}
+
+		auto const w = static_cast<u32>(width);
+		auto const h = static_cast<u32>(height);
+
+		if (on_size(w, h))
+		{
+			for (u32 y = 0; y < h; ++y)
+			{
+				if (!on_row(y, data + static_cast<size_t>(y) * w * n_channels))
+				{
+					break;
+				}
+			}
+		}
+
+		stbi_image_free(data);
+
+		return true;
+	}
+
+
+#ifndef LIBIMAGE_NO_COLOR
+
+	void read_image_from_file(const char* img_path_src, image_t& image_dst)
+	{
+		image_dst.clear();
+
+		int width = 0;
+		int height = 0;
+		int image_channels = 0;
+		int desired_channels = 4;
+
+		auto data = (rgba_pixel*)stbi_load(img_path_src, &width, &height, &image_channels, desired_channels);
+
+		assert(data);
+		assert(width);
+		assert(height);
+
+		image_dst.data = data;
+		image_dst.width = width;
+		image_dst.height = height;
+	}
+
+
+	void read_image_from_file(const char* img_path_src, image_t& image_dst, image_pool_t& pool)
+	{
+		image_dst.clear();
+
+		stb_pool_scope_t scope(pool);
+
+		read_image_from_file(img_path_src, image_dst);
+
+		image_dst.pool = &pool;
+	}
+
+
+	void read_image_from_file(const char* img_path_src, pixel_range_t const& range, image_t& image_dst, image_pool_t& pool)
+	{
+		image_dst.clear();
+
+		auto r = range;
+
+		auto const on_size = [&](u32 width, u32 height)
+		{
+			r = clip_range(range, width, height);
+			make_image(image_dst, r.x_end - r.x_begin, r.y_end - r.y_begin, pool);
+
+			return true;
+		};
+
+		// rows below the range are not decoded
+		auto const copy_row = [&](u32 y, u8 const* row)
+		{
+			if (y >= r.y_begin)
+			{
+				memcpy(image_dst.row_begin(y - r.y_begin), (pixel_t const*)row + r.x_begin, sizeof(pixel_t) * image_dst.width);
+			}
+
+			return y + 1 < r.y_end;
+		};
+
+		auto const result = read_rows(img_path_src, RGBA_CHANNELS, pool, on_size, copy_row);
+
+		assert(result);
+
+		if (!result)
+		{
+			image_dst.clear();
+		}
+	}
+
+
+	bool read_rows_from_file(const char* img_path_src, image_pool_t& pool, read_size_func_t const& on_size, read_row_func_t const& on_row)
+	{
+		u32 width = 0;
+
+		auto const read_size = [&](u32 w, u32 h)
+		{
+			width = w;
+
+			return on_size(w, h);
+		};
+
+		auto const read_row = [&](u32 y, u8 const* row)
+		{
+			return on_row(y, { (pixel_t*)row, width });
+		};
+
+		return read_rows(img_path_src, RGBA_CHANNELS, pool, read_size, read_row);
+	}
+
+
+	void make_image(image_t& image_dst, u32 width, u32 height)
+	{
+		assert(width);
+		assert(height);
+
+		image_dst.clear();
+
+		image_dst.width = width;
+		image_dst.height = height;
+		image_dst.data = (pixel_t*)malloc(sizeof(pixel_t) * width * height);
+
+		assert(image_dst.data);
+	}
+
+
+	void make_image(image_t& image_dst, u32 width, u32 height, image_pool_t& pool)
+	{
+		assert(width);
+		assert(height);
+
+		image_dst.clear();
+
+		image_dst.width = width;
+		image_dst.height = height;
+		image_dst.data = (pixel_t*)pool.acquire(sizeof(pixel_t) * width * height);
+		image_dst.pool = &pool;
+
+		assert(image_dst.data);
+	}
+
+
+	void copy_image(image_t const& image_src, image_t& image_dst)
+	{
+		assert(image_src.width);
+		assert(image_src.height);
+		assert(image_src.data);
+
+		image_dst.clear();
+		make_image(image_dst, image_src.width, image_src.height);
+
+		std::copy(image_src.begin(), image_src.end(), image_dst.begin());
+	}
+
+
+	view_t make_view(image_t const& img)
+	{
+		assert(img.width);
+		assert(img.height);
+		assert(img.data);
+
+		view_t view;
+
+		view.image_data = img.data;
+		view.image_width = img.width;
+		view.x_begin = 0;
+		view.y_begin = 0;
+		view.x_end = img.width;
+		view.y_end = img.height;
+		view.width = img.width;
+		view.height = img.height;
+
+		return view;
+	}
+
+
+	view_t sub_view(image_t const& image, pixel_range_t const& range)
+	{
+		assert(image.width);
+		assert(image.height);
+		assert(image.data);
+
+		view_t sub_view;
+
+		sub_view.image_data = image.data;
+		sub_view.image_width = image.width;
+		sub_view.x_begin = range.x_begin;
+		sub_view.y_begin = range.y_begin;
+		sub_view.x_end = range.x_end;
+		sub_view.y_end = range.y_end;
+		sub_view.width = range.x_end - range.x_begin;
+		sub_view.height = range.y_end - range.y_begin;
+
+		assert(sub_view.width);
+		assert(sub_view.height);
+
+		return sub_view;
+	}
+
+
+	view_t sub_view(view_t const& view, pixel_range_t const& range)
+	{
+		assert(view.width);
+		assert(view.height);
+		assert(view.image_data);
+
+		// range is relative to the view
+		assert(range.x_begin < range.x_end);
+		assert(range.x_end <= view.width);
+		assert(range.y_begin < range.y_end);
+		assert(range.y_end <= view.height);
+
+		view_t sub_view;
+
+		sub_view.image_data = view.image_data;
+		sub_view.image_width = view.image_width;
+		sub_view.x_begin = view.x_begin + range.x_begin;
+		sub_view.y_begin = view.y_begin + range.y_begin;
+		sub_view.x_end = view.x_begin + range.x_end;
+		sub_view.y_end = view.y_begin + range.y_end;
+		sub_view.width = range.x_end - range.x_begin;
+		sub_view.height = range.y_end - range.y_begin;
+
+		assert(sub_view.width);
+		assert(sub_view.height);
+
+		return sub_view;
+	}
+
+
+	view_t row_view(image_t const& image, u32 y)
+	{
+		pixel_range_t range;
+		range.x_begin = 0;
+		range.x_end = image.width;
+		range.y_begin = y;
+		range.y_end = y + 1;
+
+		return sub_view(image, range);
+	}
+
+
+	view_t row_view(view_t const& view, u32 y)
+	{
+		pixel_range_t range;
+		range.x_begin = 0;
+		range.x_end = view.width;
+		range.y_begin = y;
+		range.y_end = y + 1;
+
+		return sub_view(view, range);
+	}
+
+
+	view_t column_view(image_t const& image, u32 x)
+	{
+		pixel_range_t range;
+		range.x_begin = x;
+		range.x_end = x + 1;
+		range.y_begin = 0;
+		range.y_end = image.height;
+
+		return sub_view(image, range);
+	}
+
+
+	view_t column_view(view_t const& view, u32 x)
+	{
+		pixel_range_t range;
+		range.x_begin = x;
+		range.x_end = x + 1;
+		range.y_begin = 0;
+		range.y_end = view.height;
+
+		return sub_view(view, range);
+	}
+
+
+	view_t row_view(image_t const& image, u32 x_begin, u32 x_end, u32 y)
+	{
+		pixel_range_t range;
+		range.x_begin = x_begin;
+		range.x_end = x_end;
+		range.y_begin = y;
+		range.y_end = y + 1;
+
+		return sub_view(image, range);
+	}
+
+
+	view_t row_view(view_t const& view, u32 x_begin, u32 x_end, u32 y)
+	{
+		pixel_range_t range;
+		range.x_begin = x_begin;
+		range.x_end = x_end;
+		range.y_begin = y;
+		range.y_end = y + 1;
+
+		return sub_view(view, range);
+	}
+
+
+	view_t column_view(image_t const& image, u32 y_begin, u32 y_end, u32 x)
+	{
+		pixel_range_t range;
+		range.x_begin = x;
+		range.x_end = x + 1;
+		range.y_begin = y_begin;
+		range.y_end = y_end;
+
+		return sub_view(image, range);
+	}
+
+
+	view_t column_view(view_t const& view, u32 y_begin, u32 y_end, u32 x)
+	{
+		pixel_range_t range;
+		range.x_begin = x;
+		range.x_end = x + 1;
+		range.y_begin = y_begin;
+		range.y_end = y_end;
+
+		return sub_view(view, range);
+	}
+
+
+
+#ifndef LIBIMAGE_NO_WRITE
+
+	void write_image(image_t const& image_src, const char* file_path_dst)
+	{
+		assert(image_src.width);
+		assert(image_src.height);
+		assert(image_src.data);
+
+		int width = static_cast<int>(image_src.width);
+		int height = static_cast<int>(image_src.height);
+		int channels = static_cast<int>(RGBA_CHANNELS);
+		auto const data = image_src.data;
+
+		int result = 0;
+
+		auto ext = fs::path(file_path_dst).extension();
+
+		assert(ext == ".bmp" || ext == ".png");
+
+		if (ext == ".bmp" || ext == ".BMP")
+		{
+			result = stbi_write_bmp(file_path_dst, width, height, channels, data);
+		}
+		else if (ext == ".png" || ext == ".PNG")
+		{
+			int stride_in_bytes = width * channels;
+
+			result = stbi_write_png(file_path_dst, width, height, channels, data, stride_in_bytes);
+		}
+		else if (ext == ".jpg" || ext == ".jpeg" || ext == ".JPG" || ext == ".JPEG")
+		{
+			// TODO: quality?
+			// stbi_write_jpg(char const *filename, int w, int h, int comp, const void *data, int quality);
+		}
+
+		assert(result);
+	}
 
 
-namespace libimage
-{
+	static void make_image(view_t const& view, image_t& image_dst)
+	{
+		make_image(image_dst, view.width, view.height);
 
-#ifndef LIBIMAGE_NO_COLOR
+		for_each_row(view, make_view(image_dst), [](row_span_t const& src, row_span_t const& dst)
+		{
+			std::copy(src.begin(), src.end(), dst.begin());
+		});
+	}
 
-	void read_image_from_file(const char* img_path_src, image_t& image_dst)
+
+	void write_view(view_t const& view_src, const char* file_path_dst)
+	{
+		image_t image;
+		make_image(view_src, image);
+
+		write_image(image, file_path_dst);
+	}
+
+#endif // !LIBIMAGE_NO_WRITE
+
+
+#ifndef LIBIMAGE_NO_RESIZE
+
+	static void resize_data(image_t const& image_src, image_t const& image_dst)
+	{
+		assert(image_src.width);
+		assert(image_src.height);
+		assert(image_src.data);
+		assert(image_dst.width);
+		assert(image_dst.height);
+		assert(image_dst.data);
+
+		resize_channels(
+			(u8*)image_src.data, image_src.width, image_src.height,
+			(u8*)image_dst.data, image_dst.width, image_dst.height,
+			RGBA_CHANNELS);
+	}
+
+
+	void resize_image(image_t const& image_src, image_t& image_dst)
+	{
+		assert(image_dst.width);
+		assert(image_dst.height);
+
+		image_dst.clear();
+
+		image_dst.data = (pixel_t*)malloc(sizeof(pixel_t) * image_dst.width * image_dst.height);
+
+		resize_data(image_src, image_dst);
+	}
+
+
+	void resize_image(image_t const& image_src, image_t& image_dst, image_pool_t& pool)
+	{
+		make_image(image_dst, image_dst.width, image_dst.height, pool);
+
+		stb_pool_scope_t scope(pool);
+
+		resize_data(image_src, image_dst);
+	}
+
+
+	view_t make_resized_view(image_t const& img_src, image_t& img_dst)
+	{
+		resize_image(img_src, img_dst);
+
+		return make_view(img_dst);
+	}
+
+
+	view_t make_resized_view(image_t const& img_src, image_t& img_dst, image_pool_t& pool)
+	{
+		resize_image(img_src, img_dst, pool);
+
+		return make_view(img_dst);
+	}
+
+
+	void downscale_image(view_t const& view_src, view_t const& view_dst)
+	{
+		auto const x_blocks = make_blocks(view_src.width, view_dst.width);
+		auto const y_blocks = make_blocks(view_src.height, view_dst.height);
+
+		// two channels are summed in each 64 bit total, 32 bits per channel
+		assert(static_cast<u64>(view_src.width / view_dst.width + 1) * (view_src.height / view_dst.height + 1) * 255 <= UINT32_MAX);
+
+		auto const average = [](u64 total, u32 shift, u32 count) { return static_cast<u8>((((total >> shift) & 0xFFFF'FFFF) + count / 2) / count); };
+
+		auto const downscale_band = [&](u32, u32 y_begin, u32 y_end)
+		{
+			std::vector<u64> rg_totals(view_dst.width);
+			std::vector<u64> ba_totals(view_dst.width);
+
+			for (u32 y = y_begin; y < y_end; ++y)
+			{
+				std::fill(rg_totals.begin(), rg_totals.end(), 0);
+				std::fill(ba_totals.begin(), ba_totals.end(), 0);
+
+				for (u32 y_src = y_blocks[y].begin; y_src < y_blocks[y].end; ++y_src)
+				{
+					auto const row = view_src.row_span(y_src);
+
+					for (u32 x = 0; x < view_dst.width; ++x)
+					{
+						u64 rg = 0;
+						u64 ba = 0;
+
+						for (u32 x_src = x_blocks[x].begin; x_src < x_blocks[x].end; ++x_src)
+						{
+							auto const& p = row.data[x_src];
+							rg += p.red | static_cast<u64>(p.green) << 32;
+							ba += p.blue | static_cast<u64>(p.alpha) << 32;
+						}
+
+						rg_totals[x] += rg;
+						ba_totals[x] += ba;
+					}
+				}
+
+				auto const row_dst = view_dst.row_span(y);
+				auto const height = y_blocks[y].end - y_blocks[y].begin;
+
+				for (u32 x = 0; x < view_dst.width; ++x)
+				{
+					auto const count = (x_blocks[x].end - x_blocks[x].begin) * height;
+
+					row_dst[x] = to_pixel(
+						average(rg_totals[x], 0, count), average(rg_totals[x], 32, count),
+						average(ba_totals[x], 0, count), average(ba_totals[x], 32, count));
+				}
+			}
+		};
+
+		auto const n_bands = std::min(count_bands(view_src.width, view_src.height), view_dst.height);
+
+		process_bands(view_dst.height, n_bands, downscale_band);
+	}
+
+
+	void downscale_image(image_t const& image_src, image_t& image_dst)
+	{
+		make_image(image_dst, image_dst.width, image_dst.height);
+
+		downscale_image(make_view(image_src), make_view(image_dst));
+	}
+
+
+	void downscale_image(image_t const& image_src, image_t& image_dst, image_pool_t& pool)
+	{
+		make_image(image_dst, image_dst.width, image_dst.height, pool);
+
+		downscale_image(make_view(image_src), make_view(image_dst));
+	}
+
+
+	view_t make_downscaled_view(image_t const& image_src, image_t& image_dst, image_pool_t& pool)
+	{
+		downscale_image(image_src, image_dst, pool);
+
+		return make_view(image_dst);
+	}
+
+
+	void read_downscaled_image_from_file(const char* img_path_src, pixel_range_t const& range, image_t& image_dst, image_pool_t& pool)
+	{
+		// each source row is summed into the totals of the destination rows that it is in as it is decoded
+		// the totals are the same as downscale_image() makes so the result is the same
+
+		auto const width_dst = image_dst.width;
+		auto const height_dst = image_dst.height;
+
+		auto r = range;
+		std::vector<block_t> x_blocks;
+		std::vector<block_t> y_blocks;
+
+		// two channels are summed in each 64 bit total, 32 bits per channel
+		std::vector<u64> rg_totals(static_cast<size_t>(width_dst) * height_dst);
+		std::vector<u64> ba_totals(static_cast<size_t>(width_dst) * height_dst);
+
+		std::vector<u64> rg_row(width_dst);
+		std::vector<u64> ba_row(width_dst);
+
+		u32 y_first = 0; // first destination row whose block has not ended
+
+		auto const on_size = [&](u32 width, u32 height)
+		{
+			r = clip_range(range, width, height);
+
+			x_blocks = make_blocks(r.x_end - r.x_begin, width_dst);
+			y_blocks = make_blocks(r.y_end - r.y_begin, height_dst);
+
+			assert(static_cast<u64>((r.x_end - r.x_begin) / width_dst + 1) * ((r.y_end - r.y_begin) / height_dst + 1) * 255 <= UINT32_MAX);
+
+			return true;
+		};
+
+		auto const add_row = [&](u32 y, u8 const* data)
+		{
+			if (y < r.y_begin)
+			{
+				return true;
+			}
+
+			auto const row = (pixel_t const*)data + r.x_begin;
+			auto const y_src = y - r.y_begin;
+
+			for (u32 x = 0; x < width_dst; ++x)
+			{
+				u64 rg = 0;
+				u64 ba = 0;
+
+				for (u32 x_src = x_blocks[x].begin; x_src < x_blocks[x].end; ++x_src)
+				{
+					auto const& p = row[x_src];
+					rg += p.red | static_cast<u64>(p.green) << 32;
+					ba += p.blue | static_cast<u64>(p.alpha) << 32;
+				}
+
+				rg_row[x] = rg;
+				ba_row[x] = ba;
+			}
+
+			while (y_blocks[y_first].end <= y_src)
+			{
+				++y_first;
+			}
+
+			// a source smaller than the grid is in more than one block
+			for (u32 y_dst = y_first; y_dst < height_dst && y_blocks[y_dst].begin <= y_src; ++y_dst)
+			{
+				auto const offset = static_cast<size_t>(y_dst) * width_dst;
+
+				for (u32 x = 0; x < width_dst; ++x)
+				{
+					rg_totals[offset + x] += rg_row[x];
+					ba_totals[offset + x] += ba_row[x];
+				}
+			}
+
+			return y + 1 < r.y_end;
+		};
+
+		auto const result = read_rows(img_path_src, RGBA_CHANNELS, pool, on_size, add_row);
+
+		assert(result);
+
+		make_image(image_dst, width_dst, height_dst, pool);
+
+		if (!result)
+		{
+			return;
+		}
+
+		auto const average = [](u64 total, u32 shift, u32 count) { return static_cast<u8>((((total >> shift) & 0xFFFF'FFFF) + count / 2) / count); };
+
+		for (u32 y = 0; y < height_dst; ++y)
+		{
+			auto const row_dst = image_dst.row_begin(y);
+			auto const height = y_blocks[y].end - y_blocks[y].begin;
+
+			for (u32 x = 0; x < width_dst; ++x)
+			{
+				auto const i = static_cast<size_t>(y) * width_dst + x;
+				auto const count = (x_blocks[x].end - x_blocks[x].begin) * height;
+
+				row_dst[x] = to_pixel(
+					average(rg_totals[i], 0, count), average(rg_totals[i], 32, count),
+					average(ba_totals[i], 0, count), average(ba_totals[i], 32, count));
+			}
+		}
+	}
+
+#endif // !LIBIMAGE_NO_RESIZE
+
+#endif // !LIBIMAGE_NO_COLOR
+	
+#ifndef LIBIMAGE_NO_GRAYSCALE
+	void read_image_from_file(const char* file_path_src, gray::image_t& image_dst)
 	{
+		image_dst.clear();
+
 		int width = 0;
 		int height = 0;
 		int image_channels = 0;
-		int desired_channels = 4;
+		int desired_channels = 1;
 
-		auto data = (rgba_pixel*)stbi_load(img_path_src, &width, &height, &image_channels, desired_channels);
+		auto data = (gray::pixel_t*)stbi_load(file_path_src, &width, &height, &image_channels, desired_channels);
 
 		assert(data);
 		assert(width);
@@ -30,26 +1877,127 @@ namespace libimage
 	}
 
 
-	void make_image(image_t& image_dst, u32 width, u32 height)
+	void read_image_from_file(const char* file_path_src, gray::image_t& image_dst, image_pool_t& pool)
+	{
+		image_dst.clear();
+
+		stb_pool_scope_t scope(pool);
+
+		read_image_from_file(file_path_src, image_dst);
+
+		image_dst.pool = &pool;
+	}
+
+
+	void read_image_from_file(const char* file_path_src, pixel_range_t const& range, gray::image_t& image_dst, image_pool_t& pool)
+	{
+		image_dst.clear();
+
+		auto r = range;
+
+		auto const on_size = [&](u32 width, u32 height)
+		{
+			r = clip_range(range, width, height);
+			make_image(image_dst, r.x_end - r.x_begin, r.y_end - r.y_begin, pool);
+
+			return true;
+		};
+
+		// rows below the range are not decoded
+		auto const copy_row = [&](u32 y, u8 const* row)
+		{
+			if (y >= r.y_begin)
+			{
+				memcpy(image_dst.row_begin(y - r.y_begin), (gray::pixel_t const*)row + r.x_begin, sizeof(gray::pixel_t) * image_dst.width);
+			}
+
+			return y + 1 < r.y_end;
+		};
+
+		auto const result = read_rows(file_path_src, 1, pool, on_size, copy_row);
+
+		assert(result);
+
+		if (!result)
+		{
+			image_dst.clear();
+		}
+	}
+
+
+	void make_image(gray::image_t& image_dst, u32 width, u32 height)
+	{
+		assert(width);
+		assert(height);
+
+		image_dst.clear();
+
+		image_dst.width = width;
+		image_dst.height = height;
+		image_dst.data = (gray::pixel_t*)malloc(sizeof(gray::pixel_t) * width * height);
+
+		assert(image_dst.data);
+	}
+
+
+	void make_image(gray::image_t& image_dst, u32 width, u32 height, image_pool_t& pool)
 	{
 		assert(width);
 		assert(height);
 
+		image_dst.clear();
+
 		image_dst.width = width;
 		image_dst.height = height;
-		image_dst.data = (pixel_t*)malloc(sizeof(pixel_t) * width * height);
+		image_dst.data = (gray::pixel_t*)pool.acquire(sizeof(gray::pixel_t) * width * height);
+		image_dst.pool = &pool;
 
 		assert(image_dst.data);
 	}
 
 
-	view_t make_view(image_t const& img)
+	void copy_image(gray::image_t const& image_src, gray::image_t& image_dst)
+	{
+		assert(image_src.width);
+		assert(image_src.height);
+		assert(image_src.data);
+
+		image_dst.clear();
+		make_image(image_dst, image_src.width, image_src.height);
+
+		std::copy(image_src.begin(), image_src.end(), image_dst.begin());
+	}
+
+#ifndef LIBIMAGE_NO_COLOR
+
+	void convert_to_gray(view_t const& view_src, gray::view_t const& view_dst)
+	{
+		assert(view_src.width == view_dst.width);
+		assert(view_src.height == view_dst.height);
+
+		for (u32 y = 0; y < view_src.height; ++y)
+		{
+			auto const row_src = view_src.row_span(y);
+			auto const row_dst = view_dst.row_span(y);
+
+			for (u32 x = 0; x < row_src.length; ++x)
+			{
+				auto const& p = row_src[x];
+				row_dst[x] = rgb_to_gray(p.red, p.green, p.blue);
+			}
+		}
+	}
+
+#endif // !LIBIMAGE_NO_COLOR
+
+
+	gray::view_t make_view(gray::image_t const& img)
 	{
 		assert(img.width);
 		assert(img.height);
 		assert(img.data);
 
-		view_t view;
+		gray::view_t view;
 
 		view.image_data = img.data;
 		view.image_width = img.width;
@@ -64,13 +2012,13 @@ namespace libimage
 	}
 
 
-	view_t sub_view(image_t const& image, pixel_range_t const& range)
+	gray::view_t sub_view(gray::image_t const& image, pixel_range_t const& range)
 	{
 		assert(image.width);
 		assert(image.height);
 		assert(image.data);
 
-		view_t sub_view;
+		gray::view_t sub_view;
 
 		sub_view.image_data = image.data;
 		sub_view.image_width = image.width;
@@ -88,18 +2036,19 @@ namespace libimage
 	}
 
 
-	view_t sub_view(view_t const& view, pixel_range_t const& range)
+	gray::view_t sub_view(gray::view_t const& view, pixel_range_t const& range)
 	{
 		assert(view.width);
 		assert(view.height);
 		assert(view.image_data);
 
-		assert(range.x_begin >= view.x_begin);
-		assert(range.x_end <= view.x_end);
-		assert(range.y_begin >= view.y_begin);
-		assert(range.y_end <= view.y_end);
+		// range is relative to the view
+		assert(range.x_begin < range.x_end);
+		assert(range.x_end <= view.width);
+		assert(range.y_begin < range.y_end);
+		assert(range.y_end <= view.height);
 
-		view_t sub_view;
+		gray::view_t sub_view;
 
 		sub_view.image_data = view.image_data;
 		sub_view.image_width = view.image_width;
@@ -117,7 +2066,7 @@ namespace libimage
 	}
 
 
-	view_t row_view(image_t const& image, u32 y)
+	gray::view_t row_view(gray::image_t const& image, u32 y)
 	{
 		pixel_range_t range;
 		range.x_begin = 0;
@@ -129,7 +2078,7 @@ namespace libimage
 	}
 
 
-	view_t row_view(view_t const& view, u32 y)
+	gray::view_t row_view(gray::view_t const& view, u32 y)
 	{
 		pixel_range_t range;
 		range.x_begin = 0;
@@ -141,7 +2090,7 @@ namespace libimage
 	}
 
 
-	view_t column_view(image_t const& image, u32 x)
+	gray::view_t column_view(gray::image_t const& image, u32 x)
 	{
 		pixel_range_t range;
 		range.x_begin = x;
@@ -153,7 +2102,7 @@ namespace libimage
 	}
 
 
-	view_t column_view(view_t const& view, u32 x)
+	gray::view_t column_view(gray::view_t const& view, u32 x)
 	{
 		pixel_range_t range;
 		range.x_begin = x;
@@ -165,7 +2114,7 @@ namespace libimage
 	}
 
 
-	view_t row_view(image_t const& image, u32 x_begin, u32 x_end, u32 y)
+	gray::view_t row_view(gray::image_t const& image, u32 x_begin, u32 x_end, u32 y)
 	{
 		pixel_range_t range;
 		range.x_begin = x_begin;
@@ -177,7 +2126,7 @@ namespace libimage
 	}
 
 
-	view_t row_view(view_t const& view, u32 x_begin, u32 x_end, u32 y)
+	gray::view_t row_view(gray::view_t const& view, u32 x_begin, u32 x_end, u32 y)
 	{
 		pixel_range_t range;
 		range.x_begin = x_begin;
@@ -189,7 +2138,7 @@ namespace libimage
 	}
 
 
-	view_t column_view(image_t const& image, u32 y_begin, u32 y_end, u32 x)
+	gray::view_t column_view(gray::image_t const& image, u32 y_begin, u32 y_end, u32 x)
 	{
 		pixel_range_t range;
 		range.x_begin = x;
@@ -201,7 +2150,7 @@ namespace libimage
 	}
 
 
-	view_t column_view(view_t const& view, u32 y_begin, u32 y_end, u32 x)
+	gray::view_t column_view(gray::view_t const& view, u32 y_begin, u32 y_end, u32 x)
 	{
 		pixel_range_t range;
 		range.x_begin = x;
@@ -213,10 +2162,9 @@ namespace libimage
 	}
 
 
-
 #ifndef LIBIMAGE_NO_WRITE
 
-	void write_image(image_t const& image_src, const char* file_path_dst)
+	void write_image(gray::image_t const& image_src, const char* file_path_dst)
 	{
 		assert(image_src.width);
 		assert(image_src.height);
@@ -224,7 +2172,7 @@ namespace libimage
 
 		int width = static_cast<int>(image_src.width);
 		int height = static_cast<int>(image_src.height);
-		int channels = static_cast<int>(RGBA_CHANNELS);
+		int channels = 1;
 		auto const data = image_src.data;
 
 		int result = 0;
@@ -253,17 +2201,20 @@ namespace libimage
 	}
 
 
-	static void make_image(view_t const& view, image_t& image_dst)
+	static void make_image(gray::view_t const& view_src, gray::image_t& image_dst)
 	{
-		make_image(image_dst, view.width, view.height);
+		make_image(image_dst, view_src.width, view_src.height);
 
-		std::transform(view.begin(), view.end(), image_dst.begin(), [&](auto p) { return p; });
+		for_each_row(view_src, make_view(image_dst), [](gray::row_span_t const& src, gray::row_span_t const& dst)
+		{
+			std::copy(src.begin(), src.end(), dst.begin());
+		});
 	}
 
 
-	void write_view(view_t const& view_src, const char* file_path_dst)
+	void write_view(gray::view_t const& view_src, const char* file_path_dst)
 	{
-		image_t image;
+		gray::image_t image;
 		make_image(view_src, image);
 
 		write_image(image, file_path_dst);
@@ -274,412 +2225,455 @@ namespace libimage
 
 #ifndef LIBIMAGE_NO_RESIZE
 
-	void resize_image(image_t const& image_src, image_t& image_dst)
+	static void resize_data(gray::image_t const& image_src, gray::image_t const& image_dst)
 	{
 		assert(image_src.width);
 		assert(image_src.height);
 		assert(image_src.data);
 		assert(image_dst.width);
 		assert(image_dst.height);
+		assert(image_dst.data);
 
-		int channels = static_cast<int>(RGBA_CHANNELS);
-
-		int width_src = static_cast<int>(image_src.width);
-		int height_src = static_cast<int>(image_src.height);
-		int stride_bytes_src = width_src * channels;
+		resize_channels(
+			(u8*)image_src.data, image_src.width, image_src.height,
+			(u8*)image_dst.data, image_dst.width, image_dst.height,
+			1);
+	}
 
-		int width_dst = static_cast<int>(image_dst.width);
-		int height_dst = static_cast<int>(image_dst.height);
-		int stride_bytes_dst = width_dst * channels;
 
-		int result = 0;
+	void resize_image(gray::image_t const& image_src, gray::image_t& image_dst)
+	{
+		assert(image_dst.width);
+		assert(image_dst.height);
 
-		image_dst.data = (pixel_t*)malloc(sizeof(pixel_t) * image_dst.width * image_dst.height);
+		image_dst.clear();
 
-		result = stbir_resize_uint8(
-			(u8*)image_src.data, width_src, height_src, stride_bytes_src,
-			(u8*)image_dst.data, width_dst, height_dst, stride_bytes_dst,
-			channels);
+		image_dst.data = (gray::pixel_t*)malloc(sizeof(gray::pixel_t) * image_dst.width * image_dst.height);
 
-		assert(result);
+		resize_data(image_src, image_dst);
 	}
 
 
-	view_t make_resized_view(image_t const& img_src, image_t& img_dst)
+	void resize_image(gray::image_t const& image_src, gray::image_t& image_dst, image_pool_t& pool)
 	{
-		resize_image(img_src, img_dst);
+		make_image(image_dst, image_dst.width, image_dst.height, pool);
 
-		return make_view(img_dst);
+		stb_pool_scope_t scope(pool);
+
+		resize_data(image_src, image_dst);
 	}
 
-#endif // !LIBIMAGE_NO_RESIZE
 
-#endif // !LIBIMAGE_NO_COLOR
-	
-#ifndef LIBIMAGE_NO_GRAYSCALE
-	void read_image_from_file(const char* file_path_src, gray::image_t& image_dst)
+	gray::view_t make_resized_view(gray::image_t const& image_src, gray::image_t& image_dst)
 	{
-		int width = 0;
-		int height = 0;
-		int image_channels = 0;
-		int desired_channels = 1;
-
-		auto data = (gray::pixel_t*)stbi_load(file_path_src, &width, &height, &image_channels, desired_channels);
-
-		assert(data);
-		assert(width);
-		assert(height);
+		resize_image(image_src, image_dst);
 
-		image_dst.data = data;
-		image_dst.width = width;
-		image_dst.height = height;
+		return make_view(image_dst);
 	}
 
 
-	void make_image(gray::image_t& image_dst, u32 width, u32 height)
+	gray::view_t make_resized_view(gray::image_t const& image_src, gray::image_t& image_dst, image_pool_t& pool)
 	{
-		assert(width);
-		assert(height);
-
-		image_dst.width = width;
-		image_dst.height = height;
-		image_dst.data = (gray::pixel_t*)malloc(sizeof(gray::pixel_t) * width * height);
+		resize_image(image_src, image_dst, pool);
 
-		assert(image_dst.data);
+		return make_view(image_dst);
 	}
 
 
-	gray::view_t make_view(gray::image_t const& img)
+	void downscale_image(gray::view_t const& view_src, gray::view_t const& view_dst)
 	{
-		assert(img.width);
-		assert(img.height);
-		assert(img.data);
+		auto const x_blocks = make_blocks(view_src.width, view_dst.width);
+		auto const y_blocks = make_blocks(view_src.height, view_dst.height);
 
-		gray::view_t view;
+		auto const downscale_band = [&](u32, u32 y_begin, u32 y_end)
+		{
+			std::vector<u64> totals(view_dst.width);
 
-		view.image_data = img.data;
-		view.image_width = img.width;
-		view.x_begin = 0;
-		view.y_begin = 0;
-		view.x_end = img.width;
-		view.y_end = img.height;
-		view.width = img.width;
-		view.height = img.height;
+			for (u32 y = y_begin; y < y_end; ++y)
+			{
+				std::fill(totals.begin(), totals.end(), 0);
 
-		return view;
-	}
+				for (u32 y_src = y_blocks[y].begin; y_src < y_blocks[y].end; ++y_src)
+				{
+					auto const row = view_src.row_span(y_src);
 
+					for (u32 x = 0; x < view_dst.width; ++x)
+					{
+						u32 total = 0;
 
-	gray::view_t sub_view(gray::image_t const& image, pixel_range_t const& range)
-	{
-		assert(image.width);
-		assert(image.height);
-		assert(image.data);
+						for (u32 x_src = x_blocks[x].begin; x_src < x_blocks[x].end; ++x_src)
+						{
+							total += row.data[x_src];
+						}
 
-		gray::view_t sub_view;
+						totals[x] += total;
+					}
+				}
 
-		sub_view.image_data = image.data;
-		sub_view.image_width = image.width;
-		sub_view.x_begin = range.x_begin;
-		sub_view.y_begin = range.y_begin;
-		sub_view.x_end = range.x_end;
-		sub_view.y_end = range.y_end;
-		sub_view.width = range.x_end - range.x_begin;
-		sub_view.height = range.y_end - range.y_begin;
+				auto const row_dst = view_dst.row_span(y);
+				auto const height = y_blocks[y].end - y_blocks[y].begin;
 
-		assert(sub_view.width);
-		assert(sub_view.height);
+				for (u32 x = 0; x < view_dst.width; ++x)
+				{
+					auto const count = static_cast<u64>(x_blocks[x].end - x_blocks[x].begin) * height;
 
-		return sub_view;
+					row_dst[x] = static_cast<gray::pixel_t>((totals[x] + count / 2) / count);
+				}
+			}
+		};
+
+		auto const n_bands = std::min(count_bands(view_src.width, view_src.height), view_dst.height);
+
+		process_bands(view_dst.height, n_bands, downscale_band);
 	}
 
 
-	gray::view_t sub_view(gray::view_t const& view, pixel_range_t const& range)
+	void downscale_image(gray::image_t const& image_src, gray::image_t& image_dst)
 	{
-		assert(view.width);
-		assert(view.height);
-		assert(view.image_data);
-
-		assert(range.x_begin >= view.x_begin);
-		assert(range.x_end <= view.x_end);
-		assert(range.y_begin >= view.y_begin);
-		assert(range.y_end <= view.y_end);
+		make_image(image_dst, image_dst.width, image_dst.height);
 
-		gray::view_t sub_view;
+		downscale_image(make_view(image_src), make_view(image_dst));
+	}
 
-		sub_view.image_data = view.image_data;
-		sub_view.image_width = view.image_width;
-		sub_view.x_begin = view.x_begin + range.x_begin;
-		sub_view.y_begin = view.y_begin + range.y_begin;
-		sub_view.x_end = view.x_begin + range.x_end;
-		sub_view.y_end = view.y_begin + range.y_end;
-		sub_view.width = range.x_end - range.x_begin;
-		sub_view.height = range.y_end - range.y_begin;
 
-		assert(sub_view.width);
-		assert(sub_view.height);
+	void downscale_image(gray::image_t const& image_src, gray::image_t& image_dst, image_pool_t& pool)
+	{
+		make_image(image_dst, image_dst.width, image_dst.height, pool);
 
-		return sub_view;
+		downscale_image(make_view(image_src), make_view(image_dst));
 	}
 
 
-	gray::view_t row_view(gray::image_t const& image, u32 y)
+	gray::view_t make_downscaled_view(gray::image_t const& image_src, gray::image_t& image_dst, image_pool_t& pool)
 	{
-		pixel_range_t range;
-		range.x_begin = 0;
-		range.x_end = image.width;
-		range.y_begin = y;
-		range.y_end = y + 1;
+		downscale_image(image_src, image_dst, pool);
 
-		return sub_view(image, range);
+		return make_view(image_dst);
 	}
 
 
-	gray::view_t row_view(gray::view_t const& view, u32 y)
+	void read_downscaled_image_from_file(const char* file_path_src, pixel_range_t const& range, gray::image_t& image_dst, image_pool_t& pool)
 	{
-		pixel_range_t range;
-		range.x_begin = 0;
-		range.x_end = view.width;
-		range.y_begin = y;
-		range.y_end = y + 1;
+		// each source row is summed into the totals of the destination rows that it is in as it is decoded
 
-		return sub_view(view, range);
-	}
+		auto const width_dst = image_dst.width;
+		auto const height_dst = image_dst.height;
 
+		auto r = range;
+		std::vector<block_t> x_blocks;
+		std::vector<block_t> y_blocks;
 
-	gray::view_t column_view(gray::image_t const& image, u32 x)
-	{
-		pixel_range_t range;
-		range.x_begin = x;
-		range.x_end = x + 1;
-		range.y_begin = 0;
-		range.y_end = image.height;
+		std::vector<u64> totals(static_cast<size_t>(width_dst) * height_dst);
+		std::vector<u32> row_totals(width_dst);
 
-		return sub_view(image, range);
-	}
+		u32 y_first = 0; // first destination row whose block has not ended
 
+		auto const on_size = [&](u32 width, u32 height)
+		{
+			r = clip_range(range, width, height);
 
-	gray::view_t column_view(gray::view_t const& view, u32 x)
-	{
-		pixel_range_t range;
-		range.x_begin = x;
-		range.x_end = x + 1;
-		range.y_begin = 0;
-		range.y_end = view.height;
+			x_blocks = make_blocks(r.x_end - r.x_begin, width_dst);
+			y_blocks = make_blocks(r.y_end - r.y_begin, height_dst);
 
-		return sub_view(view, range);
-	}
+			return true;
+		};
 
+		auto const add_row = [&](u32 y, u8 const* data)
+		{
+			if (y < r.y_begin)
+			{
+				return true;
+			}
 
-	gray::view_t row_view(gray::image_t const& image, u32 x_begin, u32 x_end, u32 y)
-	{
-		pixel_range_t range;
-		range.x_begin = x_begin;
-		range.x_end = x_end;
-		range.y_begin = y;
-		range.y_end = y + 1;
+			auto const row = data + r.x_begin;
+			auto const y_src = y - r.y_begin;
 
-		return sub_view(image, range);
-	}
+			for (u32 x = 0; x < width_dst; ++x)
+			{
+				u32 total = 0;
 
+				for (u32 x_src = x_blocks[x].begin; x_src < x_blocks[x].end; ++x_src)
+				{
+					total += row[x_src];
+				}
 
-	gray::view_t row_view(gray::view_t const& view, u32 x_begin, u32 x_end, u32 y)
-	{
-		pixel_range_t range;
-		range.x_begin = x_begin;
-		range.x_end = x_end;
-		range.y_begin = y;
-		range.y_end = y + 1;
+				row_totals[x] = total;
+			}
 
-		return sub_view(view, range);
-	}
+			while (y_blocks[y_first].end <= y_src)
+			{
+				++y_first;
+			}
 
+			// a source smaller than the grid is in more than one block
+			for (u32 y_dst = y_first; y_dst < height_dst && y_blocks[y_dst].begin <= y_src; ++y_dst)
+			{
+				auto const offset = static_cast<size_t>(y_dst) * width_dst;
 
-	gray::view_t column_view(gray::image_t const& image, u32 y_begin, u32 y_end, u32 x)
-	{
-		pixel_range_t range;
-		range.x_begin = x;
-		range.x_end = x + 1;
-		range.y_begin = y_begin;
-		range.y_end = y_end;
+				for (u32 x = 0; x < width_dst; ++x)
+				{
+					totals[offset + x] += row_totals[x];
+				}
+			}
 
-		return sub_view(image, range);
-	}
+			return y + 1 < r.y_end;
+		};
 
+		auto const result = read_rows(file_path_src, 1, pool, on_size, add_row);
 
-	gray::view_t column_view(gray::view_t const& view, u32 y_begin, u32 y_end, u32 x)
-	{
-		pixel_range_t range;
-		range.x_begin = x;
-		range.x_end = x + 1;
-		range.y_begin = y_begin;
-		range.y_end = y_end;
+		assert(result);
 
-		return sub_view(view, range);
+		make_image(image_dst, width_dst, height_dst, pool);
+
+		if (!result)
+		{
+			return;
+		}
+
+		for (u32 y = 0; y < height_dst; ++y)
+		{
+			auto const row_dst = image_dst.row_begin(y);
+			auto const height = y_blocks[y].end - y_blocks[y].begin;
+
+			for (u32 x = 0; x < width_dst; ++x)
+			{
+				auto const count = static_cast<u64>(x_blocks[x].end - x_blocks[x].begin) * height;
+
+				row_dst[x] = static_cast<gray::pixel_t>((totals[static_cast<size_t>(y) * width_dst + x] + count / 2) / count);
+			}
+		}
 	}
 
+#endif // !LIBIMAGE_NO_RESIZE
 
-#ifndef LIBIMAGE_NO_WRITE
+#endif // !#ifndef LIBIMAGE_NO_GRAYSCALE
 
-	void write_image(gray::image_t const& image_src, const char* file_path_dst)
+#ifndef LIBIMAGE_NO_MATH
+
+	//======= HISTOGRAM KERNEL =================
+
+	// consecutive pixels are counted in separate tables
+	// so that runs of the same shade do not wait on the same counter
+	constexpr u32 N_SUB_HISTS = 4;
+
+	using shade_hist_t = std::array<u64, CHANNEL_SIZE>;
+
+	using sub_hists_t = std::array<std::array<u32, CHANNEL_SIZE>, N_SUB_HISTS>;
+
+
+	static void count_shades(u8 const* src, u32 length, sub_hists_t& sub)
 	{
-		assert(image_src.width);
-		assert(image_src.height);
-		assert(image_src.data);
+		// contiguous shades, read 8 at a time
 
-		int width = static_cast<int>(image_src.width);
-		int height = static_cast<int>(image_src.height);
-		int channels = 1;
-		auto const data = image_src.data;
+		u32 i = 0;
+		for (; i + 8 <= length; i += 8)
+		{
+			u64 shades;
+			memcpy(&shades, src + i, sizeof(shades));
+
+			++sub[0][shades & 0xFF];
+			++sub[1][(shades >> 8) & 0xFF];
+			++sub[2][(shades >> 16) & 0xFF];
+			++sub[3][(shades >> 24) & 0xFF];
+			++sub[0][(shades >> 32) & 0xFF];
+			++sub[1][(shades >> 40) & 0xFF];
+			++sub[2][(shades >> 48) & 0xFF];
+			++sub[3][(shades >> 56) & 0xFF];
+		}
 
-		int result = 0;
+		for (; i < length; ++i)
+		{
+			++sub[0][src[i]];
+		}
+	}
 
-		auto ext = fs::path(file_path_dst).extension();
 
-		assert(ext == ".bmp" || ext == ".png");
+	static void count_shades(u8 const* src, u32 length, u32 stride, sub_hists_t& sub)
+	{
+		// shades interleaved with other channels
 
-		if (ext == ".bmp" || ext == ".BMP")
+		u32 i = 0;
+		for (; i + N_SUB_HISTS <= length; i += N_SUB_HISTS)
 		{
-			result = stbi_write_bmp(file_path_dst, width, height, channels, data);
+			++sub[0][src[(i + 0) * stride]];
+			++sub[1][src[(i + 1) * stride]];
+			++sub[2][src[(i + 2) * stride]];
+			++sub[3][src[(i + 3) * stride]];
 		}
-		else if (ext == ".png" || ext == ".PNG")
-		{
-			int stride_in_bytes = width * channels;
 
-			result = stbi_write_png(file_path_dst, width, height, channels, data, stride_in_bytes);
-		}
-		else if (ext == ".jpg" || ext == ".jpeg" || ext == ".JPG" || ext == ".JPEG")
+		for (; i < length; ++i)
 		{
-			// TODO: quality?
-			// stbi_write_jpg(char const *filename, int w, int h, int comp, const void *data, int quality);
+			++sub[0][src[i * stride]];
 		}
-
-		assert(result);
 	}
 
 
-	static void make_image(gray::view_t const& view_src, gray::image_t& image_dst)
+	static void add_sub_hists(sub_hists_t const& sub, shade_hist_t& shades)
 	{
-		make_image(image_dst, view_src.width, view_src.height);
-
-		std::transform(view_src.begin(), view_src.end(), image_dst.begin(), [](auto p) { return p; });
+		for (auto const& hist : sub)
+		{
+			for (u32 shade = 0; shade < CHANNEL_SIZE; ++shade)
+			{
+				shades[shade] += hist[shade];
+			}
+		}
 	}
 
 
-	void write_view(gray::view_t const& view_src, const char* file_path_dst)
+	static hist_t to_hist(shade_hist_t const& shades)
 	{
-		gray::image_t image;
-		make_image(view_src, image);
+		// combine shades into histogram buckets
 
-		write_image(image, file_path_dst);
-	}
+		auto const divisor = CHANNEL_SIZE / N_HIST_BUCKETS;
 
-#endif // !LIBIMAGE_NO_WRITE
+		hist_t hist = { 0 };
 
+		for (u32 shade = 0; shade < CHANNEL_SIZE; ++shade)
+		{
+			hist[shade / divisor] += static_cast<u32>(shades[shade]);
+		}
 
-#ifndef LIBIMAGE_NO_RESIZE
+		return hist;
+	}
 
-	void resize_image(gray::image_t const& image_src, gray::image_t& image_dst)
+
+	static stats_t to_stats(shade_hist_t const& shades)
 	{
-		assert(image_src.width);
-		assert(image_src.height);
-		assert(image_src.data);
-		assert(image_dst.width);
-		assert(image_dst.height);
+		// integer totals, floating point only for the final results
 
-		int channels = 1;
+		u64 qty_total = 0;
+		u64 shade_total = 0;
 
-		int width_src = static_cast<int>(image_src.width);
-		int height_src = static_cast<int>(image_src.height);
-		int stride_bytes_src = width_src * channels;
+		for (u32 shade = 0; shade < CHANNEL_SIZE; ++shade)
+		{
+			qty_total += shades[shade];
+			shade_total += shades[shade] * shade;
+		}
+
+		if (!qty_total)
+		{
+			return { 0.0f, 0.0f, to_hist(shades) };
+		}
 
-		int width_dst = static_cast<int>(image_dst.width);
-		int height_dst = static_cast<int>(image_dst.height);
-		int stride_bytes_dst = width_dst * channels;
+		auto const mean = static_cast<r64>(shade_total) / qty_total;
+		assert(mean >= 0);
+		assert(mean < CHANNEL_SIZE);
 
-		int result = 0;
+		r64 diff_sq_total = 0.0;
+		for (u32 shade = 0; shade < CHANNEL_SIZE; ++shade)
+		{
+			if (!shades[shade])
+				continue;
 
-		image_dst.data = (gray::pixel_t*)malloc(sizeof(gray::pixel_t) * image_dst.width * image_dst.height);
+			auto const diff = shade - mean;
+			diff_sq_total += shades[shade] * diff * diff;
+		}
 
-		result = stbir_resize_uint8(
-			(u8*)image_src.data, width_src, height_src, stride_bytes_src,
-			(u8*)image_dst.data, width_dst, height_dst, stride_bytes_dst,
-			channels);
+		auto const std_dev = std::sqrt(diff_sq_total / qty_total);
 
-		assert(result);
+		return { static_cast<r32>(mean), static_cast<r32>(std_dev), to_hist(shades) };
 	}
 
 
-	gray::view_t make_resized_view(gray::image_t const& image_src, gray::image_t& image_dst)
+	// tiles are bands of full rows so that each row is read from start to end
+	static u32 count_tile_rows(u32 width)
 	{
-		resize_image(image_src, image_dst);
-
-		return make_view(image_dst);
+		return static_cast<u32>(PARALLEL_TASK_PIXELS / width + 1);
 	}
 
-#endif // !LIBIMAGE_NO_RESIZE
-
-#endif // !#ifndef LIBIMAGE_NO_GRAYSCALE
-
-#ifndef LIBIMAGE_NO_MATH
 
 #ifndef LIBIMAGE_NO_COLOR
 
-	rgb_stats_t calc_stats(view_t const& view)
+	static std::array<shade_hist_t, RGB_CHANNELS> count_shades(view_t const& view)
 	{
-		constexpr auto n_channels = RGBA_CHANNELS - 1;
+		using c_sub_hists_t = std::array<sub_hists_t, RGB_CHANNELS>;
 
-		auto const divisor = CHANNEL_SIZE / N_HIST_BUCKETS;
-
-		std::array<hist_t, n_channels> c_hists = { 0 };
-		std::array<r32, n_channels> c_counts = { 0 };
+		std::array<shade_hist_t, RGB_CHANNELS> c_shades = {};
+		std::mutex shades_mutex;
 
-		auto const update = [&](pixel_t const& p)
+		auto const count_tile = [&](view_t const& tile)
 		{
-			for (u32 c = 0; c < n_channels; ++c)
+			c_sub_hists_t c_sub = {};
+
+			for_each_row(tile, [&](row_span_t const& row)
 			{
-				auto bucket = p.channels[c] / divisor;
+				auto const src = (u8 const*)row.data;
+
+				for (u32 c = 0; c < RGB_CHANNELS; ++c)
+				{
+					count_shades(src + c, row.length, RGBA_CHANNELS, c_sub[c]);
+				}
+			});
 
-				++c_hists[c][bucket];
-				c_counts[c] += p.channels[c];
+			std::lock_guard<std::mutex> lock(shades_mutex);
+
+			for (u32 c = 0; c < RGB_CHANNELS; ++c)
+			{
+				add_sub_hists(c_sub[c], c_shades[c]);
 			}
 		};
 
-		std::for_each(view.begin(), view.end(), update);
+		parallel_for_tiles(view, view.width, count_tile_rows(view.width), count_tile);
 
-		auto num_pixels = static_cast<size_t>(view.width) * view.height;
+		return c_shades;
+	}
 
-		auto c_means = c_counts;
-		for (u32 c = 0; c < n_channels; ++c)
-		{
-			c_means[c] /= num_pixels;
-		}
+#endif // !LIBIMAGE_NO_COLOR
+
+#ifndef LIBIMAGE_NO_GRAYSCALE
 
-		std::array<r32, n_channels> c_diff_sq_totals = { 0 };
-		std::array<size_t, n_channels> c_qty_totals = { 0 };
+	static shade_hist_t count_shades(gray::view_t const& view)
+	{
+		shade_hist_t shades = {};
+		std::mutex shades_mutex;
 
-		for (u32 bucket = 0; bucket < c_hists[0].size(); ++bucket)
+		auto const count_tile = [&](gray::view_t const& tile)
 		{
-			for (u32 c = 0; c < n_channels; ++c)
+			sub_hists_t sub = {};
+
+			for_each_row(tile, [&](gray::row_span_t const& row)
 			{
-				auto qty = c_hists[c][bucket];
+				count_shades(row.data, row.length, sub);
+			});
 
-				if (!qty)
-					continue;
+			std::lock_guard<std::mutex> lock(shades_mutex);
 
-				c_qty_totals[c] += qty;
-				r32 diff = static_cast<r32>(bucket) - c_means[c];
+			add_sub_hists(sub, shades);
+		};
 
-				c_diff_sq_totals[c] += qty * diff * diff;
-			}
+		parallel_for_tiles(view, view.width, count_tile_rows(view.width), count_tile);
+
+		return shades;
+	}
+
+#endif // !LIBIMAGE_NO_GRAYSCALE
+
+
+#ifndef LIBIMAGE_NO_COLOR
+
+	rgb_hist_t calc_hist(view_t const& view)
+	{
+		auto const c_shades = count_shades(view);
+
+		rgb_hist_t c_hists;
+		for (u32 c = 0; c < c_hists.size(); ++c)
+		{
+			c_hists[c] = to_hist(c_shades[c]);
 		}
 
+		return c_hists;
+	}
+
+
+	rgb_stats_t calc_stats(view_t const& view)
+	{
+		auto const c_shades = count_shades(view);
+
 		rgb_stats_t rgb_stats;
 
-		for (u32 c = 0; c < n_channels; ++c)
+		for (u32 c = 0; c < c_shades.size(); ++c)
 		{
-			r32 std_dev = c_qty_totals[c] == 0 ? 0.0f : sqrtf(c_diff_sq_totals[c] / c_qty_totals[c]);
-			rgb_stats.stats[c] = { c_means[c], std_dev, c_hists[c] };
+			rgb_stats.stats[c] = to_stats(c_shades[c]);
 		}
 
 		return rgb_stats;
@@ -737,7 +2731,7 @@ namespace libimage
 					pixel_t color = to_pixel(0, 0, 0, 255);
 					color.channels[c] = shade;
 					auto bar_view = sub_view(image_dst, bar_range);
-					std::fill(bar_view.begin(), bar_view.end(), color);
+					for_each_row(bar_view, [&](row_span_t const& row) { std::fill(row.begin(), row.end(), color); });
 				}
 
 				bar_range.x_begin += (bucket_spacing + bucket_width);
@@ -748,46 +2742,160 @@ namespace libimage
 #endif // !LIBIMAGE_NO_COLOR
 
 #ifndef LIBIMAGE_NO_GRAYSCALE
-	stats_t calc_stats(gray::view_t const& view)
+	hist_t calc_hist(gray::view_t const& view)
 	{
-		hist_t hist = { 0 };
-		r32 count = 0.0f;
+		return to_hist(count_shades(view));
+	}
 
-		auto const divisor = CHANNEL_SIZE / N_HIST_BUCKETS;
 
-		auto const update = [&](gray::pixel_t const& shade)
+	static u32 count_shade_range(u8 const* src, u32 length, u8 min_shade, u8 range)
+	{
+		// shades below min_shade wrap around to large values so one compare checks both ends
+		// a compare sets each matching lane to 0xFF and subtracting it adds 1 to the lane's 8 bit counter
+		// the counters are added up after at most 255 vectors so that they do not overflow
+
+		constexpr u32 block_length = 255;
+
+		u32 count = 0;
+		u32 i = 0;
+
+#if defined(LIBIMAGE_SSE2)
+
+		constexpr u32 vector_length = 16;
+
+		auto const min_v = _mm_set1_epi8(static_cast<char>(min_shade));
+		auto const range_v = _mm_set1_epi8(static_cast<char>(range));
+		auto const zero = _mm_setzero_si128();
+
+		while (i + vector_length <= length)
 		{
-			auto bucket = shade / divisor;
-			++hist[bucket];
-			count += shade;
-		};
+			auto const end = i + std::min((length - i) / vector_length, block_length) * vector_length;
+
+			auto counters = _mm_setzero_si128();
+			for (; i < end; i += vector_length)
+			{
+				auto const shades = _mm_sub_epi8(_mm_loadu_si128((__m128i const*)(src + i)), min_v);
+				auto const in_range = _mm_cmpeq_epi8(_mm_max_epu8(shades, range_v), range_v);
+				counters = _mm_sub_epi8(counters, in_range);
+			}
 
-		std::for_each(view.begin(), view.end(), update);
+			// sum of absolute differences from zero adds the counters in each half
+			auto const totals = _mm_sad_epu8(counters, zero);
+			count += static_cast<u32>(_mm_cvtsi128_si32(totals) + _mm_cvtsi128_si32(_mm_srli_si128(totals, 8)));
+		}
 
-		auto num_pixels = static_cast<size_t>(view.width) * view.height;
+#elif defined(LIBIMAGE_NEON)
 
-		auto mean = count / num_pixels;
-		assert(mean >= 0);
-		assert(mean < CHANNEL_SIZE);
+		constexpr u32 vector_length = 16;
 
-		r32 diff_sq_total = 0.0f;
-		size_t qty_total = 0;
-		for (u32 bucket = 0; bucket < hist.size(); ++bucket)
+		auto const min_v = vdupq_n_u8(min_shade);
+		auto const range_v = vdupq_n_u8(range);
+
+		while (i + vector_length <= length)
 		{
-			auto qty = hist[bucket];
+			auto const end = i + std::min((length - i) / vector_length, block_length) * vector_length;
 
-			if (!qty)
-				continue;
+			auto counters = vdupq_n_u8(0);
+			for (; i < end; i += vector_length)
+			{
+				auto const shades = vsubq_u8(vld1q_u8(src + i), min_v);
+				counters = vsubq_u8(counters, vcleq_u8(shades, range_v));
+			}
 
-			qty_total += qty;
-			r32 diff = static_cast<r32>(bucket) - mean;
+			// pairwise widening adds, 32 bit ARM has no add across vector
+			auto const totals = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(counters)));
+			count += static_cast<u32>(vgetq_lane_u64(totals, 0) + vgetq_lane_u64(totals, 1));
+		}
+
+#endif
+
+		// the rest of the row, or all of it without SIMD
+		// the same 8 bit counting in plain loops that the compiler can vectorize
+
+		while (i < length)
+		{
+			auto const end = std::min(length, i + block_length);
+
+			u8 block_count = 0;
+			for (; i < end; ++i)
+			{
+				block_count += static_cast<u8>(src[i] - min_shade) <= range;
+			}
+
+			count += block_count;
+		}
+
+		return count;
+	}
+
+
+	u32 count_shade_range(gray::view_t const& view, u8 min_shade, u8 max_shade)
+	{
+		assert(min_shade <= max_shade);
+
+		auto const range = static_cast<u8>(max_shade - min_shade);
+
+		auto const n_bands = count_bands(view.width, view.height);
+		std::vector<u32> band_counts(n_bands, 0);
+
+		auto const count_band = [&](u32 band, u32 y_begin, u32 y_end)
+		{
+			u32 count = 0;
+
+			for (u32 y = y_begin; y < y_end; ++y)
+			{
+				auto const row = view.row_span(y);
+				count += count_shade_range(row.data, row.length, min_shade, range);
+			}
+
+			band_counts[band] = count;
+		};
+
+		process_bands(view.height, n_bands, count_band);
+
+		return std::accumulate(band_counts.begin(), band_counts.end(), 0u);
+	}
+
+
+	hist_t read_gray_hist_from_file(const char* file_path_src)
+	{
+		image_pool_t pool;
+
+		return read_gray_hist_from_file(file_path_src, pool);
+	}
 
-			diff_sq_total += qty * diff * diff;
+
+	hist_t read_gray_hist_from_file(const char* file_path_src, image_pool_t& pool)
+	{
+		// each row is counted as soon as it is inflated and converted to gray
+		// no image is made and no statistics are calculated
+
+		u32 width = 0;
+		sub_hists_t sub = {};
+
+		auto const on_size = [&](u32 w, u32) { width = w; return true; };
+
+		auto const count_row = [&](u32, u8 const* row) { count_shades(row, width, sub); return true; };
+
+		auto const result = read_rows(file_path_src, 1, pool, on_size, count_row);
+
+		assert(result);
+
+		if (!result)
+		{
+			return { 0 };
 		}
 
-		r32 std_dev = qty_total == 0 ? 0.0f : sqrtf(diff_sq_total / qty_total);
+		shade_hist_t shades = {};
+		add_sub_hists(sub, shades);
+
+		return to_hist(shades);
+	}
+
 
-		return { mean, std_dev, hist };
+	stats_t calc_stats(gray::view_t const& view)
+	{
+		return to_stats(count_shades(view));
 	}
 
 
@@ -832,7 +2940,7 @@ namespace libimage
 			{
 				u8 shade = 50;// n_buckets* (bucket + 1) - 1;
 				auto bar_view = sub_view(image_dst, bar_range);
-				std::fill(bar_view.begin(), bar_view.end(), shade);
+				for_each_row(bar_view, [&](gray::row_span_t const& row) { std::fill(row.begin(), row.end(), shade); });
 			}
 
 			bar_range.x_begin += (bucket_spacing + bucket_width);
@@ -842,6 +2950,149 @@ namespace libimage
 	}
 #endif // !LIBIMAGE_NO_GRAYSCALE
 
+
+	//======= INTEGRAL IMAGE =================
+
+	static void make_table(u32 width, u32 height, integral_image_t& table_dst)
+	{
+		assert(width);
+		assert(height);
+
+		table_dst.width = width;
+		table_dst.height = height;
+		table_dst.sums.resize(static_cast<size_t>(width + 1) * (height + 1));
+
+		// the first row is always zero, the first column is set with each row
+		std::fill_n(table_dst.sums.begin(), width + 1, 0);
+	}
+
+
+	// totals for row y of the source
+	// each total is the one above it plus the running total of the row
+	template <class SPAN, class FUNC>
+	static void add_table_row(SPAN const& row, u32 y, integral_image_t& table_dst, FUNC const& shade)
+	{
+		auto const stride = static_cast<size_t>(table_dst.width) + 1;
+
+		auto const above = table_dst.sums.data() + y * stride;
+		auto const sums = above + stride;
+
+		sums[0] = 0;
+
+		u64 row_total = 0;
+
+		for (u32 x = 0; x < row.length; ++x)
+		{
+			row_total += shade(row.data[x]);
+			sums[x + 1] = above[x + 1] + row_total;
+		}
+	}
+
+
+	// rounded average of each block, same blocks and rounding as downscale_image()
+	// func(x, y, shade) sets the destination
+	template <class FUNC>
+	static void downscale_table(integral_image_t const& table_src, u32 width_dst, u32 height_dst, FUNC const& func)
+	{
+		auto const x_blocks = make_blocks(table_src.width, width_dst);
+		auto const y_blocks = make_blocks(table_src.height, height_dst);
+
+		pixel_range_t range;
+
+		for (u32 y = 0; y < height_dst; ++y)
+		{
+			range.y_begin = y_blocks[y].begin;
+			range.y_end = y_blocks[y].end;
+
+			for (u32 x = 0; x < width_dst; ++x)
+			{
+				range.x_begin = x_blocks[x].begin;
+				range.x_end = x_blocks[x].end;
+
+				auto const count = static_cast<u64>(range.x_end - range.x_begin) * (range.y_end - range.y_begin);
+
+				func(x, y, static_cast<u8>((rect_sum(table_src, range) + count / 2) / count));
+			}
+		}
+	}
+
+
+	u64 rect_sum(integral_image_t const& table, pixel_range_t const& range)
+	{
+		assert(range.x_begin <= range.x_end);
+		assert(range.y_begin <= range.y_end);
+		assert(range.x_end <= table.width);
+		assert(range.y_end <= table.height);
+
+		auto const outer = table.sum_at(range.x_end, range.y_end) + table.sum_at(range.x_begin, range.y_begin);
+		auto const inner = table.sum_at(range.x_begin, range.y_end) + table.sum_at(range.x_end, range.y_begin);
+
+		return outer - inner;
+	}
+
+
+	r32 rect_mean(integral_image_t const& table, pixel_range_t const& range)
+	{
+		auto const count = static_cast<u64>(range.x_end - range.x_begin) * (range.y_end - range.y_begin);
+
+		assert(count);
+
+		return static_cast<r32>(static_cast<r64>(rect_sum(table, range)) / count);
+	}
+
+
+#ifndef LIBIMAGE_NO_COLOR
+
+	void make_integral_image(view_t const& view_src, rgba_integral_image_t& table_dst)
+	{
+		for (auto& table : table_dst)
+		{
+			make_table(view_src.width, view_src.height, table);
+		}
+
+		for (u32 y = 0; y < view_src.height; ++y)
+		{
+			auto const row = view_src.row_span(y);
+
+			// the row stays in cache while each channel is added
+			for (u32 c = 0; c < RGBA_CHANNELS; ++c)
+			{
+				add_table_row(row, y, table_dst[c], [&](pixel_t const& p) { return p.channels[c]; });
+			}
+		}
+	}
+
+
+	void downscale_image(rgba_integral_image_t const& table_src, view_t const& view_dst)
+	{
+		for (u32 c = 0; c < RGBA_CHANNELS; ++c)
+		{
+			downscale_table(table_src[c], view_dst.width, view_dst.height, [&](u32 x, u32 y, u8 shade) { view_dst.xy_at(x, y)->channels[c] = shade; });
+		}
+	}
+
+#endif // !LIBIMAGE_NO_COLOR
+
+#ifndef LIBIMAGE_NO_GRAYSCALE
+
+	void make_integral_image(gray::view_t const& view_src, integral_image_t& table_dst)
+	{
+		make_table(view_src.width, view_src.height, table_dst);
+
+		for (u32 y = 0; y < view_src.height; ++y)
+		{
+			add_table_row(view_src.row_span(y), y, table_dst, [](gray::pixel_t p) { return p; });
+		}
+	}
+
+
+	void downscale_image(integral_image_t const& table_src, gray::view_t const& view_dst)
+	{
+		downscale_table(table_src, view_dst.width, view_dst.height, [&](u32 x, u32 y, u8 shade) { *view_dst.xy_at(x, y) = shade; });
+	}
+
+#endif // !LIBIMAGE_NO_GRAYSCALE
+
 #endif // !LIBIMAGE_NO_MATH
 
 }
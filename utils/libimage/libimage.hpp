@@ -6,11 +6,18 @@
 //#define LIBIMAGE_NO_RESIZE
 //#define LIBIMAGE_NO_FS
 //#define LIBIMAGE_NO_MATH
+//#define LIBIMAGE_NO_PARALLEL
+//#define LIBIMAGE_NO_SIMD
 
 #include <cstdint>
+#include <cstdlib>
 #include <iterator>
+#include <vector>
+#include <functional>
 #include <cassert>
 
+#include "../thread_pool.hpp"
+
 #ifndef LIBIMAGE_NO_FS
 #include <filesystem>
 namespace fs = std::filesystem;
@@ -21,6 +28,7 @@ namespace fs = std::filesystem;
 #endif // !LIBIMAGE_NO_MATH
 
 using u8 = uint8_t;
+using u16 = uint16_t;
 using u32 = uint32_t;
 using u64 = uint64_t;
 using r32 = float;
@@ -29,6 +37,7 @@ using r64 = double;
 namespace libimage
 {
 	constexpr auto RGBA_CHANNELS = 4u;
+	constexpr auto RGB_CHANNELS = 3u;
 	constexpr size_t CHANNEL_SIZE = 256; // 8 bit channel
 
 #ifndef LIBIMAGE_NO_MATH
@@ -38,6 +47,41 @@ namespace libimage
 #endif // !LIBIMAGE_NO_MATH
 	
 
+	//======= image_pool.hpp =============
+
+	// reusable memory for image data
+	// buffers are returned to the pool instead of being freed and are handed out again for the next image
+	// use one pool per thread, a pool is not thread safe
+	// images that borrow from a pool must be destroyed before the pool
+	class image_pool_t
+	{
+	private:
+
+		std::vector<void*> m_free; // buffers available for reuse
+
+	public:
+
+		image_pool_t() = default;
+
+		image_pool_t(image_pool_t const&) = delete;
+		image_pool_t& operator = (image_pool_t const&) = delete;
+
+		~image_pool_t() { purge(); }
+
+		// a buffer of at least n_bytes
+		void* acquire(size_t n_bytes);
+
+		// same as realloc()
+		void* resize(void* buffer, size_t n_bytes);
+
+		// give a buffer back for reuse
+		void release(void* buffer);
+
+		// frees all buffers that are not in use
+		void purge();
+	};
+
+
 	//======= image_view.hpp =============
 
 	// region of interest in an image
@@ -50,6 +94,15 @@ namespace libimage
 
 	} pixel_range_t;
 
+
+	// every pixel of an image
+	// ranges are clipped to the image when a file is read
+	constexpr pixel_range_t FULL_RANGE = { 0, UINT32_MAX, 0, UINT32_MAX };
+
+
+	// called with the image size before any rows of a file, false skips the image
+	using read_size_func_t = std::function<bool(u32 width, u32 height)>;
+
 #ifndef LIBIMAGE_NO_COLOR
 
 	// color pixel
@@ -76,12 +129,30 @@ namespace libimage
 	// owns the memory
 	class rgba_image_t
 	{
+	private:
+
+		// transfer ownership of memory from another image
+		void take(rgba_image_t& other)
+		{
+			width = other.width;
+			height = other.height;
+			data = other.data;
+			pool = other.pool;
+
+			other.width = 0;
+			other.height = 0;
+			other.data = 0;
+			other.pool = 0;
+		}
+
 	public:
 		u32 width = 0;
 		u32 height = 0;
 
 		pixel_t* data = 0;
 
+		image_pool_t* pool = 0; // memory is borrowed from a pool when set
+
 		pixel_t* row_begin(u32 y) const
 		{
 			assert(y < height);
@@ -105,8 +176,41 @@ namespace libimage
 		{
 			if (data)
 			{
-				free(data);
+				if (pool)
+				{
+					pool->release(data);
+				}
+				else
+				{
+					free(data);
+				}
+			}
+
+			data = 0;
+			pool = 0;
+		}
+
+		rgba_image_t() = default;
+
+		// images own their memory and can only be moved
+		// use copy_image() for a deep copy
+		rgba_image_t(rgba_image_t const&) = delete;
+		rgba_image_t& operator = (rgba_image_t const&) = delete;
+
+		rgba_image_t(rgba_image_t&& other) noexcept
+		{
+			take(other);
+		}
+
+		rgba_image_t& operator = (rgba_image_t&& other) noexcept
+		{
+			if (this != &other)
+			{
+				clear();
+				take(other);
 			}
+
+			return *this;
 		}
 
 		~rgba_image_t()
@@ -123,6 +227,27 @@ namespace libimage
 	using image_t = rgba_image_t;
 
 
+	// contiguous pixels in one row of an image or view
+	class rgba_row_span_t
+	{
+	public:
+
+		pixel_t* data = 0;
+		u32 length = 0;
+
+		pixel_t& operator [] (u32 x) const
+		{
+			assert(x < length);
+			return data[x];
+		}
+
+		pixel_t* begin() const { return data; }
+		pixel_t* end() const { return data + length; }
+	};
+
+	using row_span_t = rgba_row_span_t;
+
+
 	// subset of existing image data
 	class rgba_image_view_t
 	{
@@ -158,6 +283,11 @@ namespace libimage
 			return row_begin(y) + x;
 		}
 
+		row_span_t row_span(u32 y) const
+		{
+			return { row_begin(y), width };
+		}
+
 
 		/******* ITERATOR ************/
 
@@ -270,6 +400,32 @@ namespace libimage
 	using view_t = rgba_image_view_t;
 
 
+	// iterate over the rows of a view
+	// func(row_span_t) is given contiguous memory so that simple loops can be vectorized
+	template <class FUNC>
+	inline void for_each_row(view_t const& view, FUNC const& func)
+	{
+		for (u32 y = 0; y < view.height; ++y)
+		{
+			func(view.row_span(y));
+		}
+	}
+
+
+	// iterate over the rows of a pair of views with the same dimensions
+	template <class FUNC>
+	inline void for_each_row(view_t const& view_a, view_t const& view_b, FUNC const& func)
+	{
+		assert(view_a.width == view_b.width);
+		assert(view_a.height == view_b.height);
+
+		for (u32 y = 0; y < view_a.height; ++y)
+		{
+			func(view_a.row_span(y), view_b.row_span(y));
+		}
+	}
+
+
 	constexpr pixel_t to_pixel(u8 red, u8 green, u8 blue, u8 alpha)
 	{
 		pixel_t pixel{};
@@ -305,12 +461,30 @@ namespace libimage
 		// grayscale image
 		class image_t
 		{
+		private:
+
+			// transfer ownership of memory from another image
+			void take(image_t& other)
+			{
+				width = other.width;
+				height = other.height;
+				data = other.data;
+				pool = other.pool;
+
+				other.width = 0;
+				other.height = 0;
+				other.data = 0;
+				other.pool = 0;
+			}
+
 		public:
 			u32 width = 0;
 			u32 height = 0;
 
 			pixel_t* data = 0;
 
+			image_pool_t* pool = 0; // memory is borrowed from a pool when set
+
 			pixel_t* row_begin(u32 y) const
 			{
 				assert(y < height);
@@ -334,8 +508,41 @@ namespace libimage
 			{
 				if (data)
 				{
-					free(data);
+					if (pool)
+					{
+						pool->release(data);
+					}
+					else
+					{
+						free(data);
+					}
 				}
+
+				data = 0;
+				pool = 0;
+			}
+
+			image_t() = default;
+
+			// images own their memory and can only be moved
+			// use copy_image() for a deep copy
+			image_t(image_t const&) = delete;
+			image_t& operator = (image_t const&) = delete;
+
+			image_t(image_t&& other) noexcept
+			{
+				take(other);
+			}
+
+			image_t& operator = (image_t&& other) noexcept
+			{
+				if (this != &other)
+				{
+					clear();
+					take(other);
+				}
+
+				return *this;
 			}
 
 			~image_t()
@@ -353,6 +560,25 @@ namespace libimage
 		};
 
 
+		// contiguous pixels in one row of an image or view
+		class row_span_t
+		{
+		public:
+
+			pixel_t* data = 0;
+			u32 length = 0;
+
+			pixel_t& operator [] (u32 x) const
+			{
+				assert(x < length);
+				return data[x];
+			}
+
+			pixel_t* begin() const { return data; }
+			pixel_t* end() const { return data + length; }
+		};
+
+
 		// subset of grayscale image data
 		class image_view_t
 		{
@@ -380,6 +606,11 @@ namespace libimage
 				return row_begin(y) + x;
 			}
 
+			row_span_t row_span(u32 y) const
+			{
+				return { row_begin(y), width };
+			}
+
 			/******* ITERATOR ************/
 
 			class iterator
@@ -487,11 +718,36 @@ namespace libimage
 
 		using view_t = image_view_t;
 
-
 	}
 
 	namespace grey = gray;
 
+
+	// iterate over the rows of a view
+	// func(gray::row_span_t) is given contiguous memory so that simple loops can be vectorized
+	template <class FUNC>
+	inline void for_each_row(gray::view_t const& view, FUNC const& func)
+	{
+		for (u32 y = 0; y < view.height; ++y)
+		{
+			func(view.row_span(y));
+		}
+	}
+
+
+	// iterate over the rows of a pair of views with the same dimensions
+	template <class FUNC>
+	inline void for_each_row(gray::view_t const& view_a, gray::view_t const& view_b, FUNC const& func)
+	{
+		assert(view_a.width == view_b.width);
+		assert(view_a.height == view_b.height);
+
+		for (u32 y = 0; y < view_a.height; ++y)
+		{
+			func(view_a.row_span(y), view_b.row_span(y));
+		}
+	}
+
 #endif // !LIBIMAGE_NO_GRAYSCALE
 
 	//======= libimage.hpp ==================
@@ -499,8 +755,26 @@ namespace libimage
 
 	void read_image_from_file(const char* img_path_src, image_t& image_dst);
 
+	void read_image_from_file(const char* img_path_src, image_t& image_dst, image_pool_t& pool);
+
+	// only the pixels in range are kept
+	// 8 bit png files are decoded one row at a time, rows below the range are not decoded
+	void read_image_from_file(const char* img_path_src, pixel_range_t const& range, image_t& image_dst, image_pool_t& pool);
+
+	// called with each row from the top, false when no more rows are needed
+	using read_row_func_t = std::function<bool(u32 y, row_span_t const& row)>;
+
+	// rows are handed out as they are read without keeping the image
+	// 8 bit png files are decoded one row at a time
+	// false if the file could not be read
+	bool read_rows_from_file(const char* img_path_src, image_pool_t& pool, read_size_func_t const& on_size, read_row_func_t const& on_row);
+
 	void make_image(image_t& image_dst, u32 width, u32 height);
 
+	void make_image(image_t& image_dst, u32 width, u32 height, image_pool_t& pool);
+
+	void copy_image(image_t const& image_src, image_t& image_dst);
+
 	view_t make_view(image_t const& image);
 
 	view_t sub_view(image_t const& image, pixel_range_t const& range);
@@ -536,8 +810,29 @@ namespace libimage
 
 	void resize_image(image_t const& image_src, image_t& image_dst);
 
+	void resize_image(image_t const& image_src, image_t& image_dst, image_pool_t& pool);
+
 	view_t make_resized_view(image_t const& image_src, image_t& image_dst);
 
+	view_t make_resized_view(image_t const& image_src, image_t& image_dst, image_pool_t& pool);
+
+	// each destination pixel is the rounded average of the block of source pixels it covers
+	// block edges are at src_size * i / dst_size, so any grid size can be used
+	// a source smaller than the destination is upscaled by repeating its pixels
+	// stb's resize filters also sample neighboring blocks so results differ from resize_image()
+	// e.g. 500x500 to 16x16: 3 shades on average, up to 60 at sharp edges
+	void downscale_image(view_t const& view_src, view_t const& view_dst);
+
+	void downscale_image(image_t const& image_src, image_t& image_dst);
+
+	void downscale_image(image_t const& image_src, image_t& image_dst, image_pool_t& pool);
+
+	view_t make_downscaled_view(image_t const& image_src, image_t& image_dst, image_pool_t& pool);
+
+	// pixels in range are averaged down to image_dst.width x image_dst.height
+	// 8 bit png rows are added to the averages as they are decoded, no image of the whole file is made
+	void read_downscaled_image_from_file(const char* img_path_src, pixel_range_t const& range, image_t& image_dst, image_pool_t& pool);
+
 #endif // !LIBIMAGE_NO_RESIZE
 
 #endif // !LIBIMAGE_NO_COLOR
@@ -546,8 +841,23 @@ namespace libimage
 #ifndef LIBIMAGE_NO_GRAYSCALE
 	void read_image_from_file(const char* file_path_src, gray::image_t& image_dst);
 
+	void read_image_from_file(const char* file_path_src, gray::image_t& image_dst, image_pool_t& pool);
+
+	void read_image_from_file(const char* file_path_src, pixel_range_t const& range, gray::image_t& image_dst, image_pool_t& pool);
+
 	void make_image(gray::image_t& image_dst, u32 width, u32 height);
 
+	void make_image(gray::image_t& image_dst, u32 width, u32 height, image_pool_t& pool);
+
+	void copy_image(gray::image_t const& image_src, gray::image_t& image_dst);
+
+#ifndef LIBIMAGE_NO_COLOR
+
+	// same conversion that stb_image uses when decoding a color file to one channel
+	void convert_to_gray(view_t const& view_src, gray::view_t const& view_dst);
+
+#endif // !LIBIMAGE_NO_COLOR
+
 	gray::view_t make_view(gray::image_t const& image);
 
 	gray::view_t sub_view(gray::image_t const& image, pixel_range_t const& range);
@@ -583,8 +893,22 @@ namespace libimage
 
 	void resize_image(gray::image_t const& img_src, gray::image_t& img_dst);
 
+	void resize_image(gray::image_t const& img_src, gray::image_t& img_dst, image_pool_t& pool);
+
 	gray::view_t make_resized_view(gray::image_t const& image_src, gray::image_t& image_dst);
 
+	gray::view_t make_resized_view(gray::image_t const& image_src, gray::image_t& image_dst, image_pool_t& pool);
+
+	void downscale_image(gray::view_t const& view_src, gray::view_t const& view_dst);
+
+	void downscale_image(gray::image_t const& image_src, gray::image_t& image_dst);
+
+	void downscale_image(gray::image_t const& image_src, gray::image_t& image_dst, image_pool_t& pool);
+
+	gray::view_t make_downscaled_view(gray::image_t const& image_src, gray::image_t& image_dst, image_pool_t& pool);
+
+	void read_downscaled_image_from_file(const char* file_path_src, pixel_range_t const& range, gray::image_t& image_dst, image_pool_t& pool);
+
 #endif // !LIBIMAGE_NO_RESIZE
 
 #endif // !LIBIMAGE_NO_GRAYSCALE
@@ -602,6 +926,41 @@ namespace libimage
 	}
 
 
+	inline void read_image_from_file(fs::path const& img_path_src, image_t& image_dst, image_pool_t& pool)
+	{
+		auto file_path_str = img_path_src.string();
+
+		read_image_from_file(file_path_str.c_str(), image_dst, pool);
+	}
+
+
+	inline void read_image_from_file(fs::path const& img_path_src, pixel_range_t const& range, image_t& image_dst, image_pool_t& pool)
+	{
+		auto file_path_str = img_path_src.string();
+
+		read_image_from_file(file_path_str.c_str(), range, image_dst, pool);
+	}
+
+
+	inline bool read_rows_from_file(fs::path const& img_path_src, image_pool_t& pool, read_size_func_t const& on_size, read_row_func_t const& on_row)
+	{
+		auto file_path_str = img_path_src.string();
+
+		return read_rows_from_file(file_path_str.c_str(), pool, on_size, on_row);
+	}
+
+#ifndef LIBIMAGE_NO_RESIZE
+
+	inline void read_downscaled_image_from_file(fs::path const& img_path_src, pixel_range_t const& range, image_t& image_dst, image_pool_t& pool)
+	{
+		auto file_path_str = img_path_src.string();
+
+		read_downscaled_image_from_file(file_path_str.c_str(), range, image_dst, pool);
+	}
+
+#endif // !LIBIMAGE_NO_RESIZE
+
+
 	inline void write_image(image_t const& image_src, fs::path const& file_path)
 	{
 		auto file_path_str = file_path.string();
@@ -627,6 +986,33 @@ namespace libimage
 	}
 
 
+	inline void read_image_from_file(fs::path const& img_path_src, gray::image_t& image_dst, image_pool_t& pool)
+	{
+		auto file_path_str = img_path_src.string();
+
+		return read_image_from_file(file_path_str.c_str(), image_dst, pool);
+	}
+
+
+	inline void read_image_from_file(fs::path const& img_path_src, pixel_range_t const& range, gray::image_t& image_dst, image_pool_t& pool)
+	{
+		auto file_path_str = img_path_src.string();
+
+		read_image_from_file(file_path_str.c_str(), range, image_dst, pool);
+	}
+
+#ifndef LIBIMAGE_NO_RESIZE
+
+	inline void read_downscaled_image_from_file(fs::path const& img_path_src, pixel_range_t const& range, gray::image_t& image_dst, image_pool_t& pool)
+	{
+		auto file_path_str = img_path_src.string();
+
+		read_downscaled_image_from_file(file_path_str.c_str(), range, image_dst, pool);
+	}
+
+#endif // !LIBIMAGE_NO_RESIZE
+
+
 	inline void write_image(gray::image_t const& image_src, fs::path const& file_path_dst)
 	{
 		auto file_path_str = file_path_dst.string();
@@ -650,6 +1036,8 @@ namespace libimage
 
 	using hist_t = std::array<u32, N_HIST_BUCKETS>;
 
+	using rgb_hist_t = std::array<hist_t, RGB_CHANNELS>;
+
 
 	typedef struct channel_stats_t
 	{
@@ -674,21 +1062,184 @@ namespace libimage
 	} rgb_stats_t;
 
 
+	// summed-area table of one channel
+	// sums has (width + 1) x (height + 1) totals, each is the sum of every pixel above and to the left of it
+	// the first row and column are zero so the total of any rectangle is found with four lookups
+	class integral_image_t
+	{
+	public:
+
+		u32 width = 0;
+		u32 height = 0;
+
+		std::vector<u64> sums;
+
+		u64 sum_at(u32 x, u32 y) const { return sums[static_cast<size_t>(y) * (width + 1) + x]; }
+	};
+
+	// one table for each of red, green, blue and alpha
+	using rgba_integral_image_t = std::array<integral_image_t, RGBA_CHANNELS>;
+
+
+	// total of the pixels in the range, in O(1)
+	u64 rect_sum(integral_image_t const& table, pixel_range_t const& range);
+
+	// mean shade of the pixels in the range, in O(1)
+	r32 rect_mean(integral_image_t const& table, pixel_range_t const& range);
+
+
 #ifndef LIBIMAGE_NO_COLOR
 
+	// histograms only, skips the mean and standard deviation
+	rgb_hist_t calc_hist(view_t const& view);
+
 	rgb_stats_t calc_stats(view_t const& view);
 
 	void draw_histogram(rgb_stats_t const& rgb_stats, image_t& image_dst);
 
+	// memory in table_dst is reused if it is large enough
+	void make_integral_image(view_t const& view_src, rgba_integral_image_t& table_dst);
+
+	// same result as downscale_image(view_src, view_dst) without another pass over the source pixels
+	// grids of any number of sizes can be made from one table
+	void downscale_image(rgba_integral_image_t const& table_src, view_t const& view_dst);
+
 #endif // !LIBIMAGE_NO_COLOR
 
 #ifndef	LIBIMAGE_NO_GRAYSCALE
+	// histogram only, skips the mean and standard deviation
+	hist_t calc_hist(gray::view_t const& view);
+
+	// number of pixels with min_shade <= shade <= max_shade
+	// faster than reading the count from a histogram
+	// uses SSE2 or NEON when the compiler targets them, plain loops with LIBIMAGE_NO_SIMD or on other targets
+	u32 count_shade_range(gray::view_t const& view, u8 min_shade, u8 max_shade);
+
 	stats_t calc_stats(gray::view_t const& view);
 
+	// grayscale histogram of an image file
+	// 8 bit png rows are counted as they are inflated, no image is made
+	hist_t read_gray_hist_from_file(const char* file_path_src);
+
+	hist_t read_gray_hist_from_file(const char* file_path_src, image_pool_t& pool);
+
 	void draw_histogram(hist_t const& hist, gray::image_t& image_dst);
+
+	// memory in table_dst is reused if it is large enough
+	void make_integral_image(gray::view_t const& view_src, integral_image_t& table_dst);
+
+	// same result as downscale_image(view_src, view_dst) without another pass over the source pixels
+	void downscale_image(integral_image_t const& table_src, gray::view_t const& view_dst);
+
+#ifndef LIBIMAGE_NO_FS
+
+	inline hist_t read_gray_hist_from_file(fs::path const& file_path_src)
+	{
+		auto file_path_str = file_path_src.string();
+
+		return read_gray_hist_from_file(file_path_str.c_str());
+	}
+
+
+	inline hist_t read_gray_hist_from_file(fs::path const& file_path_src, image_pool_t& pool)
+	{
+		auto file_path_str = file_path_src.string();
+
+		return read_gray_hist_from_file(file_path_str.c_str(), pool);
+	}
+
+#endif // !LIBIMAGE_NO_FS
+
 #endif // !LIBIMAGE_NO_GRAYSCALE
 
 #endif // !LIBIMAGE_NO_MATH
 
 
+	//======= libimage_parallel.hpp ==================
+
+	// views with fewer pixels are processed on the calling thread
+	constexpr size_t PARALLEL_MIN_PIXELS = 1024 * 1024;
+
+	// about how many pixels parallel_transform() gives a thread at a time
+	constexpr size_t PARALLEL_TASK_PIXELS = 64 * 1024;
+
+
+	// tasks run on the worker threads of utils/thread_pool
+	template <class TASK>
+	inline void execute_tasks(u32 n_tasks, size_t n_pixels, TASK const& task)
+	{
+#ifndef LIBIMAGE_NO_PARALLEL
+
+		if (n_pixels >= PARALLEL_MIN_PIXELS)
+		{
+			thread_pool::execute_in_parallel(n_tasks, task);
+			return;
+		}
+
+#endif // !LIBIMAGE_NO_PARALLEL
+
+		for (u32 i = 0; i < n_tasks; ++i)
+		{
+			task(i);
+		}
+	}
+
+
+	// runs func(tile) for each tile of the view
+	// tiles are sub views of at most tile_width x tile_height, func must only write to its own tile
+	// tile.x_begin and tile.y_begin are the position of the tile in the image memory
+	template <class VIEW, class FUNC>
+	inline void parallel_for_tiles(VIEW const& view, u32 tile_width, u32 tile_height, FUNC const& func)
+	{
+		assert(tile_width);
+		assert(tile_height);
+
+		auto const n_columns = (view.width + tile_width - 1) / tile_width;
+		auto const n_rows = (view.height + tile_height - 1) / tile_height;
+
+		auto const process_tile = [&](u32 tile)
+		{
+			pixel_range_t range;
+			range.x_begin = (tile % n_columns) * tile_width;
+			range.x_end = range.x_begin + tile_width < view.width ? range.x_begin + tile_width : view.width;
+			range.y_begin = (tile / n_columns) * tile_height;
+			range.y_end = range.y_begin + tile_height < view.height ? range.y_begin + tile_height : view.height;
+
+			func(sub_view(view, range));
+		};
+
+		execute_tasks(n_columns * n_rows, static_cast<size_t>(view.width) * view.height, process_tile);
+	}
+
+
+	// sets each pixel of view_dst to func(pixel) of the same pixel in view_src
+	// bands of rows are given to each thread so that simple functions can be vectorized
+	template <class VIEW_SRC, class VIEW_DST, class FUNC>
+	inline void parallel_transform(VIEW_SRC const& view_src, VIEW_DST const& view_dst, FUNC const& func)
+	{
+		assert(view_src.width == view_dst.width);
+		assert(view_src.height == view_dst.height);
+
+		auto const band_height = static_cast<u32>(PARALLEL_TASK_PIXELS / view_src.width + 1);
+		auto const n_bands = (view_src.height + band_height - 1) / band_height;
+
+		auto const transform_band = [&](u32 band)
+		{
+			auto const y_begin = band * band_height;
+			auto const y_end = y_begin + band_height < view_src.height ? y_begin + band_height : view_src.height;
+
+			for (u32 y = y_begin; y < y_end; ++y)
+			{
+				auto const row_src = view_src.row_span(y);
+				auto const row_dst = view_dst.row_span(y);
+
+				for (u32 x = 0; x < row_src.length; ++x)
+				{
+					row_dst[x] = func(row_src[x]);
+				}
+			}
+		};
+
+		execute_tasks(n_bands, static_cast<size_t>(view_src.width) * view_src.height, transform_band);
+	}
 }
@@ -2,7 +2,7 @@
 
 #include <cstddef>
 #include <functional>
-#include <array>
+#include <vector>
 
 /*
 
@@ -11,6 +11,9 @@ Values before MLClass::Count are used as the array indeces when clustering.
 MLClass::Count is used for loop counting etc.
 Define as many classes as you like.
 
+Classes can also be added at runtime by their index, see ModelGenerator::add_class_data().
+Indeces from MLClass::Count on have no MLClass value and are inspected with data_inspector::inspect_class_index().
+
 */
 
 enum class MLClass : size_t
@@ -43,26 +46,38 @@ namespace mlclass
 	constexpr size_t ML_CLASS_COUNT = to_class_index(MLClass::Count);
 
 
+	// Returned instead of a class index when data can not be classified
+	constexpr size_t NO_CLASS_INDEX = static_cast<size_t>(-1);
+
+
 	// Pass a function for iterating over all of the classes.
 	// Using the same for loop over and over again gets annoying.
 	using class_func_t = std::function<void(size_t c)>;
-	inline void for_each_class(class_func_t const& func)
+	inline void for_each_class(size_t n_classes, class_func_t const& func)
 	{
-		for (size_t class_index = 0; class_index < ML_CLASS_COUNT; ++class_index)
+		for (size_t class_index = 0; class_index < n_classes; ++class_index)
 		{
 			func(class_index);
 		}
 	}
 
 
-	// Make a size_t array where each element index is a class index
+	inline void for_each_class(class_func_t const& func)
+	{
+		for_each_class(ML_CLASS_COUNT, func);
+	}
+
+
+	// The number of clusters in each class, indexed by class
+	using class_clusters_t = std::vector<size_t>;
+
+
+	// Make a list where each element index is a class index
 	//  and each element is the number of clusters in that class
-	// Must have the correct number elements.
-	// In this case there are two elements, Fail and Pass.
 	// Each class will have the same number of clusters.
-	inline std::array<size_t, ML_CLASS_COUNT> make_class_clusters(size_t clusters_per_class)
+	inline class_clusters_t make_class_clusters(size_t clusters_per_class, size_t n_classes = ML_CLASS_COUNT)
 	{
-		return std::array<size_t, ML_CLASS_COUNT> { clusters_per_class, clusters_per_class };
+		return class_clusters_t(n_classes, clusters_per_class);
 	}
 }
 
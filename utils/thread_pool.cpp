@@ -0,0 +1,198 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace thread_pool
+{
+	// threads that tasks on this thread may use, 0 until the thread runs a task
+	static thread_local u32 thread_budget = 0;
+
+
+	static u32 hardware_thread_count()
+	{
+		return std::max(std::thread::hardware_concurrency(), 1u);
+	}
+
+
+	// one call to execute_in_parallel()
+	typedef struct
+	{
+		std::function<void(u32)> const* task;
+		u32 n_tasks;
+		std::atomic<u32> next_task;
+
+		u32 budget;
+		u32 n_threads;
+
+		// guarded by the pool mutex
+		u32 n_joined;
+		u32 n_running;
+		std::condition_variable finished;
+
+	} job_t;
+
+
+	static void run_tasks(job_t& job, u32 thread_index)
+	{
+		// the budget is shared by the threads so that nested calls do not start more threads than it allows
+		auto const caller_budget = thread_budget;
+		thread_budget = job.budget / job.n_threads + (thread_index < job.budget % job.n_threads);
+
+		for (auto i = job.next_task++; i < job.n_tasks; i = job.next_task++)
+		{
+			(*job.task)(i);
+		}
+
+		thread_budget = caller_budget;
+	}
+
+
+	// one worker for every core except the one the caller runs on
+	// a job is queued once for each worker it asks for, entries that have not started when the caller finishes are removed
+	class worker_pool_t
+	{
+	private:
+
+		std::mutex m_mutex;
+		std::condition_variable m_queued;
+		std::deque<job_t*> m_queue;
+		std::vector<std::thread> m_workers;
+		bool m_stop = false;
+
+		void work()
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+
+			while (true)
+			{
+				m_queued.wait(lock, [&]() { return m_stop || !m_queue.empty(); });
+
+				if (m_queue.empty())
+				{
+					return;
+				}
+
+				auto& job = *m_queue.front();
+				m_queue.pop_front();
+
+				auto const thread_index = job.n_joined++;
+				++job.n_running;
+
+				lock.unlock();
+
+				run_tasks(job, thread_index);
+
+				lock.lock();
+
+				if (!--job.n_running)
+				{
+					job.finished.notify_all();
+				}
+			}
+		}
+
+	public:
+
+		worker_pool_t()
+		{
+			auto const n_workers = hardware_thread_count() - 1;
+
+			m_workers.reserve(n_workers);
+			for (u32 i = 0; i < n_workers; ++i)
+			{
+				m_workers.emplace_back([this]() { work(); });
+			}
+		}
+
+		worker_pool_t(worker_pool_t const&) = delete;
+		worker_pool_t& operator = (worker_pool_t const&) = delete;
+
+		~worker_pool_t()
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_stop = true;
+			}
+
+			m_queued.notify_all();
+
+			for (auto& worker : m_workers)
+			{
+				worker.join();
+			}
+		}
+
+		void execute(job_t& job)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_queue.insert(m_queue.end(), job.n_threads - 1, &job);
+			}
+
+			m_queued.notify_all();
+
+			run_tasks(job, 0);
+
+			// workers that are busy with other calls do not join, the caller has run their tasks
+			std::unique_lock<std::mutex> lock(m_mutex);
+
+			m_queue.erase(std::remove(m_queue.begin(), m_queue.end(), &job), m_queue.end());
+
+			job.finished.wait(lock, [&]() { return !job.n_running; });
+		}
+	};
+
+
+	static worker_pool_t& worker_pool()
+	{
+		// started by the first call that uses more than one thread
+		static worker_pool_t pool;
+
+		return pool;
+	}
+
+
+	u32 parallel_thread_count()
+	{
+		return thread_budget ? thread_budget : hardware_thread_count();
+	}
+
+
+	void execute_in_parallel(u32 n_tasks, std::function<void(u32)> const& task)
+	{
+		if (!n_tasks)
+		{
+			return;
+		}
+
+		auto const budget = parallel_thread_count();
+		auto const n_threads = std::min(budget, n_tasks);
+
+		if (n_threads == 1)
+		{
+			for (u32 i = 0; i < n_tasks; ++i)
+			{
+				task(i);
+			}
+
+			return;
+		}
+
+		job_t job;
+		job.task = &task;
+		job.n_tasks = n_tasks;
+		job.next_task = 0;
+		job.budget = budget;
+		job.n_threads = n_threads;
+		job.n_joined = 1;
+		job.n_running = 0;
+
+		worker_pool().execute(job);
+	}
+}
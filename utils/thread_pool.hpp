@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+using u32 = uint32_t;
+
+/*
+
+Worker threads that are started once and reused by every parallel call in the application.
+Image processing in libimage and clustering in the ModelGenerator both run their tasks here.
+
+*/
+
+namespace thread_pool
+{
+	// threads that execute_in_parallel() may use from the calling thread
+	// every core at first, a share of the threads of the call that a task is running in
+	u32 parallel_thread_count();
+
+
+	// runs task(i) for each i from 0 to n_tasks - 1 on the calling thread and on workers of the pool
+	// tasks are handed out one at a time so threads that finish early take more of them
+	// calls made by a task share the threads of this call, a call with one thread runs every task on the calling thread
+	void execute_in_parallel(u32 n_tasks, std::function<void(u32)> const& task);
+}